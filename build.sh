@@ -1,8 +1,19 @@
 #!/bin/bash
 
-if [[ $1 = "-R" ]]
+BUILD_RELEASE=0
+BUILD_HEADLESS=0
+
+for arg in "$@"
+do
+    case $arg in
+        -R) BUILD_RELEASE=1 ;;
+        -H) BUILD_HEADLESS=1 ;;
+    esac
+done
+
+if [[ $BUILD_RELEASE = 1 ]]
 then
-    SHADER_COMPILER_ARGS="-V"
+    SHADER_COMPILER_ARGS="-V --target-env vulkan1.1"
     APP_PREPROC_DEFINES="-DRB_RELEASE"
     APP_COMPILER_ARGS="-O2"
     BUILD_FOLDER="build/Release"
@@ -10,7 +21,7 @@ then
     echo "Starting RELEASE build..."
     echo ""
 else
-    SHADER_COMPILER_ARGS="-V -Od"
+    SHADER_COMPILER_ARGS="-V --target-env vulkan1.1 -Od"
     APP_PREPROC_DEFINES="-DRB_DEBUG"
     APP_COMPILER_ARGS="-g -O0"
     BUILD_FOLDER="build/Debug"
@@ -19,6 +30,13 @@ else
     echo ""
 fi
 
+# headless builds render offscreen and don't need GLFW or a display
+if [[ $BUILD_HEADLESS = 1 ]]
+then
+    APP_PREPROC_DEFINES="$APP_PREPROC_DEFINES -DRB_HEADLESS"
+    BUILD_FOLDER="${BUILD_FOLDER}Headless"
+fi
+
 rm -rf $BUILD_FOLDER
 mkdir -p $BUILD_FOLDER/shaders
 
@@ -35,24 +53,72 @@ for filename in shaders/*.frag; do
     glslangValidator $SHADER_COMPILER_ARGS $filename -o $BUILD_FOLDER/shaders/$base.fs.spv
 done
 
+for filename in shaders/*.comp; do
+    name=${filename##*/}
+    base=${name%.comp}
+    glslangValidator $SHADER_COMPILER_ARGS $filename -o $BUILD_FOLDER/shaders/$base.cs.spv
+done
+
+# build the compile-time variants listed in the manifest, each from its source with its defines
+while read -r variant source defines; do
+    if [[ -z $variant || $variant = \#* ]]
+    then
+        continue
+    fi
+
+    case $source in
+        *.vert) stage="vs" ;;
+        *.frag) stage="fs" ;;
+        *.comp) stage="cs" ;;
+    esac
+
+    DEFINE_ARGS=""
+    for define in $defines; do
+        DEFINE_ARGS="$DEFINE_ARGS -D$define"
+    done
+
+    glslangValidator $SHADER_COMPILER_ARGS $DEFINE_ARGS shaders/$source -o $BUILD_FOLDER/shaders/$variant.$stage.spv
+done < shaders/permutations.txt
+
 # build the app
-GLFW_INCLUDE_PATH="/opt/homebrew/include"
 EXTERNAL_INCLUDE_PATH="external"
 
-GLFW_LIBRARY_PATH="/opt/homebrew/lib"
-VULKAN_LIBRARY_PATH="/Users/bart/VulkanSDK/1.3.224.1/macOS/lib"
-
-GLFW_LIB="glfw.3.3"
-VULKAN_LIB="vulkan.1.3.224"
-
-clang++ -Wall -std=c++17 \
-        $APP_COMPILER_ARGS \
-        $APP_PREPROC_DEFINE \
-        -o $BUILD_FOLDER/RenderBox \
-        -I$GLFW_INCLUDE_PATH -I$EXTERNAL_INCLUDE_PATH \
-        -L$GLFW_LIBRARY_PATH -L$VULKAN_LIBRARY_PATH \
-        -l$VULKAN_LIB -l$GLFW_LIB \
-        external/volk/volk.c \
-        external/fast_obj/fast_obj.c \
-        external/meshoptimizer/src/indexgenerator.cpp \
-        main_macOS.cpp
\ No newline at end of file
+EXTERNAL_SOURCES="external/volk/volk.c \
+                  external/fast_obj/fast_obj.c \
+                  external/meshoptimizer/src/*.cpp"
+
+if [[ $BUILD_HEADLESS = 1 ]]
+then
+    # volk loads the Vulkan loader at runtime, so only the system libraries are linked
+    if [[ $(uname) = "Linux" ]]
+    then
+        SYSTEM_LIBS="-ldl -lpthread"
+    fi
+
+    clang++ -Wall -std=c++17 \
+            $APP_COMPILER_ARGS \
+            $APP_PREPROC_DEFINES \
+            -o $BUILD_FOLDER/RenderBoxHeadless \
+            -I$EXTERNAL_INCLUDE_PATH \
+            $EXTERNAL_SOURCES \
+            main_headless.cpp \
+            $SYSTEM_LIBS
+else
+    GLFW_INCLUDE_PATH="/opt/homebrew/include"
+
+    GLFW_LIBRARY_PATH="/opt/homebrew/lib"
+    VULKAN_LIBRARY_PATH="/Users/bart/VulkanSDK/1.3.224.1/macOS/lib"
+
+    GLFW_LIB="glfw.3.3"
+    VULKAN_LIB="vulkan.1.3.224"
+
+    clang++ -Wall -std=c++17 \
+            $APP_COMPILER_ARGS \
+            $APP_PREPROC_DEFINES \
+            -o $BUILD_FOLDER/RenderBox \
+            -I$GLFW_INCLUDE_PATH -I$EXTERNAL_INCLUDE_PATH \
+            -L$GLFW_LIBRARY_PATH -L$VULKAN_LIBRARY_PATH \
+            -l$VULKAN_LIB -l$GLFW_LIB \
+            $EXTERNAL_SOURCES \
+            main_macOS.cpp
+fi
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include <stdint.h>
+#include <assert.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+// Jobs get the index of the thread that runs them: 0 is the thread that started the job system, workers follow.
+// Per-thread resources (e.g. command pools) are indexed with it.
+using JobFunction = std::function<void(uint32_t threadID)>;
+
+// Counts the unfinished jobs of a batch; waitForJobs returns once it drops to zero
+struct JobCounter{
+    std::atomic<uint32_t> pending;
+};
+
+struct Job{
+    JobFunction function;
+    JobCounter* counter;
+};
+
+// The owner pushes and pops at the back, idle threads steal from the front
+struct JobQueue{
+    std::mutex mutex;
+    std::deque<Job> jobs;
+};
+
+struct JobSystem{
+    std::vector<std::thread> workers;
+    std::vector<JobQueue*> queues;  // one per thread, including the main thread
+
+    std::atomic<uint32_t> queuedJobs;
+    std::atomic<bool> running;
+
+    std::mutex sleepMutex;
+    std::condition_variable wakeCondition;
+};
+
+static JobSystem jobSystem{};
+static thread_local uint32_t jobThreadID{};
+static thread_local bool jobThreadOwnsQueue{};  // set on the thread that started the job system and on the workers
+
+bool popJob(uint32_t threadID, Job& job){
+    {
+        JobQueue& queue{ *jobSystem.queues[threadID] };
+        std::lock_guard<std::mutex> lock{ queue.mutex };
+
+        if (!queue.jobs.empty()){
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+            jobSystem.queuedJobs--;
+            return true;
+        }
+    }
+
+    // Steal the oldest job of the next busy thread, starting after our own queue so thieves spread out
+    uint32_t queueCount{ (uint32_t)jobSystem.queues.size() };
+    for (uint32_t i{ 1 }; i < queueCount; i++){
+        JobQueue& queue{ *jobSystem.queues[(threadID + i) % queueCount] };
+        std::lock_guard<std::mutex> lock{ queue.mutex };
+
+        if (!queue.jobs.empty()){
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            jobSystem.queuedJobs--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void runJob(uint32_t threadID, Job& job){
+    job.function(threadID);
+    job.counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+void jobWorkerLoop(uint32_t threadID){
+    jobThreadID = threadID;
+    jobThreadOwnsQueue = true;
+
+    while (jobSystem.running.load(std::memory_order_acquire)){
+        Job job{};
+        if (popJob(threadID, job)){
+            runJob(threadID, job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock{ jobSystem.sleepMutex };
+        jobSystem.wakeCondition.wait(lock, [](){ return jobSystem.queuedJobs > 0 || !jobSystem.running; });
+    }
+}
+
+// workerCount 0 sizes the pool to the core count, with the calling thread taking one core
+void initializeJobSystem(uint32_t workerCount = 0){
+    if (workerCount == 0){
+        workerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    }
+
+    jobSystem.running = true;
+
+    for (uint32_t i{}; i < workerCount + 1; i++){
+        jobSystem.queues.push_back(new JobQueue{});
+    }
+
+    jobThreadID = 0;
+    jobThreadOwnsQueue = true;
+    for (uint32_t i{ 1 }; i <= workerCount; i++){
+        jobSystem.workers.emplace_back(jobWorkerLoop, i);
+    }
+}
+
+// Waits for the workers to finish their current job; jobs still queued are dropped
+void shutdownJobSystem(){
+    {
+        std::lock_guard<std::mutex> lock{ jobSystem.sleepMutex };
+        jobSystem.running = false;
+    }
+    jobSystem.wakeCondition.notify_all();
+
+    for (std::thread& worker : jobSystem.workers){
+        worker.join();
+    }
+
+    for (JobQueue* queue : jobSystem.queues){
+        delete queue;
+    }
+
+    jobSystem.workers.clear();
+    jobSystem.queues.clear();
+    jobSystem.queuedJobs = 0;
+    jobThreadOwnsQueue = false;
+}
+
+// False before initializeJobSystem and on threads outside of the job system, which have no queue to submit to
+bool isJobThread(){
+    return jobThreadOwnsQueue;
+}
+
+// Number of threads that can run jobs, so per-thread resources can be sized up front
+uint32_t jobThreadCount(){
+    return jobSystem.queues.size();
+}
+
+// Can be called from any thread taking part in the job system, including from inside a job
+void submitJob(JobCounter& counter, JobFunction function){
+    assert(isJobThread() && "submitJob needs an initialized job system and a thread that owns a queue");
+
+    counter.pending.fetch_add(1, std::memory_order_relaxed);
+
+    {
+        JobQueue& queue{ *jobSystem.queues[jobThreadID] };
+        std::lock_guard<std::mutex> lock{ queue.mutex };
+        queue.jobs.push_back({ std::move(function), &counter });
+        jobSystem.queuedJobs++;
+    }
+
+    // Taking the lock orders the notification after a sleeping worker's predicate check
+    {
+        std::lock_guard<std::mutex> lock{ jobSystem.sleepMutex };
+    }
+    jobSystem.wakeCondition.notify_one();
+}
+
+// The waiting thread runs jobs itself (its own first, then stolen ones) instead of blocking
+void waitForJobs(JobCounter& counter){
+    assert(isJobThread());
+
+    while (counter.pending.load(std::memory_order_acquire) > 0){
+        Job job{};
+        if (popJob(jobThreadID, job)){
+            runJob(jobThreadID, job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// Splits [0, count) into rangeCount contiguous ranges, one job each, and waits for all of them. A range ID always
+// covers the same slice, so per-range results can be combined in order regardless of which thread ran them.
+void parallelForRanges(uint32_t rangeCount, size_t count, const std::function<void(uint32_t rangeID, size_t begin, size_t end)>& function){
+    JobCounter counter{};
+
+    for (uint32_t rangeID{}; rangeID < rangeCount; rangeID++){
+        submitJob(counter, [&, rangeID](uint32_t threadID){
+            function(rangeID, count * rangeID / rangeCount, count * (rangeID + 1) / rangeCount);
+        });
+    }
+
+    waitForJobs(counter);
+}
\ No newline at end of file
@@ -0,0 +1,1657 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "vulkan/vk_helpers.h"
+#include "vulkan/vk_init.cpp"
+#include "vulkan/vk_pipeline.cpp"
+#include "vulkan/vk_renderpass.cpp"
+#include "vulkan/vk_descriptor_set.cpp"
+#include "vulkan/vk_cmd_buffers.cpp"
+#include "vulkan/vk_memory.cpp"
+#include "vulkan/vk_staging.cpp"
+#include "vulkan/vk_queries.cpp"
+
+#include "profiler.cpp"
+#include "jobs.cpp"
+#include "mesh.cpp"
+#include "scene.cpp"
+#include "meshlet_cull.cpp"
+#include "occlusion.cpp"
+
+enum DepthMode : uint32_t{
+    DEPTH_OFF,          // no depth test, every fragment is shaded in draw order
+    DEPTH_TEST,         // LESS test and write in the main pass
+    DEPTH_PREPASS,      // a depth-only pass from the position stream, then the main pass shades with EQUAL
+    DEPTH_MODE_COUNT
+};
+
+// How the main pass vertex shader treats its vertex format and input switches
+enum ShaderPermutationMode : uint32_t{
+    SHADER_BRANCHY,         // one pipeline per depth mode, mesh.vert branches on the uniforms every vertex
+    SHADER_SPECIALIZED      // a pipeline per permutation, specialized to the phase's vertex format and input mode
+};
+
+struct BenchmarkOptions{
+    const char* meshFile{ "../../data/roadBike.obj" };
+    uint32_t width{ 1024 };
+    uint32_t height{ 768 };
+    uint32_t warmupFrames{ 60 };
+    uint32_t frames{ 1000 };
+    uint32_t framesInFlight{ 2 };
+    bool compareMeshLoad{ false };
+    bool optimizeMesh{ false };
+    bool meshStats{ false };
+    bool packedVertices{ false };
+    bool hostVisibleGeometry{ false };
+    bool transferQueue{ true };
+    bool drawIndirectCount{ true };
+    bool subgroupOps{ true };
+    const char* device{ nullptr };          // index or part of the name, overrides RB_DEVICE
+    const char* pipelineCacheFile{ "pipeline_cache.bin" };
+    uint32_t pipelineVariants{ 0 };
+    uint32_t pipelineThreads{ std::max(1u, std::thread::hardware_concurrency()) };
+    const char* gpuTraceFile{ nullptr };
+    const char* cpuStatsFile{ nullptr };
+    double cpuStatsInterval{ 5.0 };
+    MeshletCullMode meshletCull{ MESHLET_CULL_NONE };
+    std::vector<uint32_t> sceneInstanceCounts{};
+    std::vector<const char*> sceneMeshFiles{};
+    bool sceneInstancing{ true };
+    bool sceneLods{ false };
+    bool occlusionCull{ false };
+    std::vector<uint32_t> recordThreadCounts{ 0 };
+    std::vector<uint32_t> importJobCounts{};
+    std::vector<VertexInputMode> vertexInputs{ VERTEX_INPUT_PULL };
+    std::vector<DepthMode> depthModes{ DEPTH_TEST };
+    std::vector<ShaderPermutationMode> shaderPermutations{ SHADER_BRANCHY };
+    uint32_t sceneLayers{ 1 };
+};
+
+// What the frames of one benchmark phase render
+struct BenchmarkPhase{
+    bool cullMeshlets;
+    int32_t sceneID;            // -1 without a scene
+    uint32_t recordThreads;     // 0 records on the main thread into the primary command buffer
+    bool lods;
+    VertexInputMode vertexInput;
+    DepthMode depth;
+    bool occlusionCull;         // two-phase Hi-Z culling of the scene's instances
+    ShaderPermutationMode permutation;
+};
+
+// Comma separated counts, e.g. "1000,10000,100000"
+std::vector<uint32_t> parseCountList(const char* value){
+    std::vector<uint32_t> counts{};
+
+    while (*value){
+        char* end{};
+        counts.push_back((uint32_t)strtoul(value, &end, 10));
+
+        if (*end != ','){
+            break;
+        }
+
+        value = end + 1;
+    }
+
+    return counts;
+}
+
+const char* const kVertexInputNames[]{ "pull", "indexed", "attributes" };
+const char* const kDepthModeNames[]{ "off", "test", "prepass" };
+const char* const kShaderPermutationNames[]{ "branchy", "specialized" };
+
+// GPU zones whose times are reported per phase
+const char* const kDepthPrepassZone{ "DepthPrepass" };
+const char* const kOcclusionCullZone{ "OcclusionCull" };
+const char* const kDepthPyramidZone{ "DepthPyramid" };
+
+// Room for the uniforms of one frame; each allocation takes at least minUniformBufferOffsetAlignment bytes
+const VkDeviceSize kUniformRingFrameSize{ 64 * 1024 };
+
+// Alignment headroom of the per-frame linear allocators the transient cull buffers come from
+const VkDeviceSize kTransientAlignmentSlack{ 64 * 1024 };
+
+// Upper bound of bytes the startup defragmentation pass copies
+const VkDeviceSize kDefragmentBudget{ 256 * 1024 * 1024 };
+
+// Comma separated mode names, e.g. "pull,indexed,attributes"; returns the indices into names
+template<typename Mode, uint32_t nameCount>
+std::vector<Mode> parseModeList(const char* value, const char* const (&names)[nameCount], const char* kind){
+    std::vector<Mode> modes{};
+
+    while (*value){
+        size_t length{ strcspn(value, ",") };
+
+        bool known{};
+        for (uint32_t mode{}; mode < nameCount; mode++){
+            if (strlen(names[mode]) == length && strncmp(value, names[mode], length) == 0){
+                modes.push_back((Mode)mode);
+                known = true;
+            }
+        }
+
+        if (!known){
+            fprintf(stderr, "Unknown %s mode: %.*s\n", kind, (int)length, value);
+            exit(1);
+        }
+
+        value += length + (value[length] == ',' ? 1 : 0);
+    }
+
+    return modes;
+}
+
+BenchmarkOptions parseBenchmarkOptions(int argc, char** argv){
+    BenchmarkOptions options{};
+
+    for (int i{ 1 }; i < argc; i++){
+        const char* arg{ argv[i] };
+        const char* value{ i + 1 < argc ? argv[i + 1] : nullptr };
+
+        if (strcmp(arg, "--compare-mesh-load") == 0){
+            options.compareMeshLoad = true;
+            continue;
+        } else if (strcmp(arg, "--optimize-mesh") == 0){
+            options.optimizeMesh = true;
+            continue;
+        } else if (strcmp(arg, "--mesh-stats") == 0){
+            options.meshStats = true;
+            continue;
+        } else if (strcmp(arg, "--packed-vertices") == 0){
+            options.packedVertices = true;
+            continue;
+        } else if (strcmp(arg, "--host-visible-geometry") == 0){
+            options.hostVisibleGeometry = true;
+            continue;
+        } else if (strcmp(arg, "--no-transfer-queue") == 0){
+            options.transferQueue = false;
+            continue;
+        } else if (strcmp(arg, "--no-draw-indirect-count") == 0){
+            options.drawIndirectCount = false;
+            continue;
+        } else if (strcmp(arg, "--no-subgroup-ops") == 0){
+            options.subgroupOps = false;
+            continue;
+        } else if (strcmp(arg, "--scene-no-instancing") == 0){
+            options.sceneInstancing = false;
+            continue;
+        } else if (strcmp(arg, "--scene-lod") == 0){
+            options.sceneLods = true;
+            continue;
+        } else if (strcmp(arg, "--occlusion-cull") == 0){
+            options.occlusionCull = true;
+            continue;
+        }
+
+        if (strcmp(arg, "--mesh") == 0 && value){
+            options.meshFile = value;
+        } else if (strcmp(arg, "--device") == 0 && value){
+            options.device = value;
+        } else if (strcmp(arg, "--width") == 0 && value){
+            options.width = (uint32_t)atoi(value);
+        } else if (strcmp(arg, "--height") == 0 && value){
+            options.height = (uint32_t)atoi(value);
+        } else if (strcmp(arg, "--warmup") == 0 && value){
+            options.warmupFrames = (uint32_t)atoi(value);
+        } else if (strcmp(arg, "--frames") == 0 && value){
+            options.frames = (uint32_t)atoi(value);
+        } else if (strcmp(arg, "--pipeline-cache") == 0 && value){
+            options.pipelineCacheFile = value;
+        } else if (strcmp(arg, "--pipeline-variants") == 0 && value){
+            options.pipelineVariants = (uint32_t)atoi(value);
+        } else if (strcmp(arg, "--pipeline-threads") == 0 && value){
+            options.pipelineThreads = std::max(1, atoi(value));
+        } else if (strcmp(arg, "--frames-in-flight") == 0 && value){
+            options.framesInFlight = std::min(std::max(atoi(value), 1), 3);
+        } else if (strcmp(arg, "--gpu-trace") == 0 && value){
+            options.gpuTraceFile = value;
+        } else if (strcmp(arg, "--cpu-stats") == 0 && value){
+            options.cpuStatsFile = value;
+        } else if (strcmp(arg, "--cpu-stats-interval") == 0 && value){
+            options.cpuStatsInterval = atof(value);
+        } else if (strcmp(arg, "--meshlet-cull") == 0 && value){
+            options.meshletCull = strcmp(value, "gpu") == 0 ? MESHLET_CULL_GPU :
+                                  strcmp(value, "cpu") == 0 ? MESHLET_CULL_CPU : MESHLET_CULL_NONE;
+        } else if (strcmp(arg, "--scene") == 0 && value){
+            options.sceneInstanceCounts = parseCountList(value);
+        } else if (strcmp(arg, "--scene-mesh") == 0 && value){
+            options.sceneMeshFiles.push_back(value);
+        } else if (strcmp(arg, "--record-threads") == 0 && value){
+            options.recordThreadCounts = parseCountList(value);
+        } else if (strcmp(arg, "--import-scaling") == 0 && value){
+            options.importJobCounts = parseCountList(value);
+        } else if (strcmp(arg, "--vertex-input") == 0 && value){
+            options.vertexInputs = parseModeList<VertexInputMode>(value, kVertexInputNames, "vertex input");
+        } else if (strcmp(arg, "--depth") == 0 && value){
+            options.depthModes = parseModeList<DepthMode>(value, kDepthModeNames, "depth");
+        } else if (strcmp(arg, "--shader-permutation") == 0 && value){
+            options.shaderPermutations = parseModeList<ShaderPermutationMode>(value, kShaderPermutationNames, "shader permutation");
+        } else if (strcmp(arg, "--scene-layers") == 0 && value){
+            options.sceneLayers = std::max(1, atoi(value));
+        } else {
+            fprintf(stderr, "Unknown or incomplete argument: %s\n", arg);
+            exit(1);
+        }
+
+        i++;
+    }
+
+    assert(options.frames > 0);
+    assert(!options.vertexInputs.empty() && !options.depthModes.empty() && !options.shaderPermutations.empty());
+
+    if (!options.sceneInstanceCounts.empty() && options.meshletCull != MESHLET_CULL_NONE){
+        fprintf(stderr, "--meshlet-cull is ignored in scene mode\n");
+        options.meshletCull = MESHLET_CULL_NONE;
+    }
+
+    // Culled meshlets are drawn from non-indexed indirect commands, and the culling report compares exactly two phases
+    if (options.meshletCull != MESHLET_CULL_NONE && options.vertexInputs.size() > 1){
+        fprintf(stderr, "--meshlet-cull compares a single vertex input mode, using %s\n", kVertexInputNames[options.vertexInputs[0]]);
+        options.vertexInputs.resize(1);
+    }
+    if (options.meshletCull == MESHLET_CULL_GPU && options.vertexInputs[0] != VERTEX_INPUT_PULL){
+        fprintf(stderr, "--meshlet-cull gpu needs --vertex-input pull\n");
+        options.vertexInputs = { VERTEX_INPUT_PULL };
+    }
+    if (options.meshletCull != MESHLET_CULL_NONE && options.depthModes.size() > 1){
+        fprintf(stderr, "--meshlet-cull compares a single depth mode, using %s\n", kDepthModeNames[options.depthModes[0]]);
+        options.depthModes.resize(1);
+    }
+    if (options.meshletCull != MESHLET_CULL_NONE && options.shaderPermutations.size() > 1){
+        fprintf(stderr, "--meshlet-cull compares a single shader permutation mode, using %s\n",
+                kShaderPermutationNames[options.shaderPermutations[0]]);
+        options.shaderPermutations.resize(1);
+    }
+
+    // The prepass draws every triangle of the position stream, and its depth only matches the main pass bit for bit
+    // when both transform the same float positions. Its draws are recorded inline ahead of the main pass draws.
+    const bool depthPrepass{ std::find(options.depthModes.begin(), options.depthModes.end(), DEPTH_PREPASS) != options.depthModes.end() };
+    if (depthPrepass && options.meshletCull != MESHLET_CULL_NONE){
+        fprintf(stderr, "--depth prepass draws whole meshes, ignoring --meshlet-cull\n");
+        options.meshletCull = MESHLET_CULL_NONE;
+    }
+    if (depthPrepass && options.packedVertices){
+        fprintf(stderr, "--depth prepass needs float vertices, ignoring --packed-vertices\n");
+        options.packedVertices = false;
+    }
+    if (depthPrepass && options.recordThreadCounts != std::vector<uint32_t>{ 0 }){
+        fprintf(stderr, "--depth prepass records on the main thread, ignoring --record-threads\n");
+        options.recordThreadCounts = { 0 };
+    }
+
+    // Only scene draw lists are split across threads
+    if (options.sceneInstanceCounts.empty() && options.recordThreadCounts != std::vector<uint32_t>{ 0 }){
+        fprintf(stderr, "--record-threads needs --scene, recording on the main thread\n");
+        options.recordThreadCounts = { 0 };
+    }
+
+    if (options.sceneInstanceCounts.empty() && options.sceneLayers > 1){
+        fprintf(stderr, "--scene-layers needs --scene, ignoring it\n");
+        options.sceneLayers = 1;
+    }
+
+    // Occlusion culling phases draw scene instances from indirect commands recorded on the main thread, and test them
+    // against the depth of the LESS-tested early pass
+    if (options.occlusionCull && options.sceneInstanceCounts.empty()){
+        fprintf(stderr, "--occlusion-cull needs --scene, ignoring it\n");
+        options.occlusionCull = false;
+    }
+    if (options.occlusionCull && std::find(options.depthModes.begin(), options.depthModes.end(), DEPTH_TEST) == options.depthModes.end()){
+        fprintf(stderr, "--occlusion-cull needs --depth test, ignoring it\n");
+        options.occlusionCull = false;
+    }
+    if (options.occlusionCull && std::find(options.recordThreadCounts.begin(), options.recordThreadCounts.end(), 0u) == options.recordThreadCounts.end()){
+        fprintf(stderr, "--occlusion-cull needs main thread recording (--record-threads 0), ignoring it\n");
+        options.occlusionCull = false;
+    }
+
+    if (options.sceneInstanceCounts.empty() && options.sceneLods){
+        fprintf(stderr, "--scene-lod needs --scene, drawing full resolution meshes\n");
+        options.sceneLods = false;
+    }
+
+    // Quantized meshes have their own position ranges, which scene draws push per mesh, but an indirect draw of
+    // every mesh only gets one
+    if (!options.sceneMeshFiles.empty() && options.packedVertices && options.occlusionCull){
+        fprintf(stderr, "--occlusion-cull with --scene-mesh needs float vertices, ignoring --packed-vertices\n");
+        options.packedVertices = false;
+    }
+
+    return options;
+}
+
+// Nearest-rank percentile of sorted samples
+double samplePercentile(const std::vector<double>& samples, double p){
+    if (samples.empty()){
+        return 0.0;
+    }
+
+    size_t rank{ (size_t)(p * samples.size() + 0.999999) };
+    return samples[std::min(std::max(rank, (size_t)1), samples.size()) - 1];
+}
+
+// Sorts the samples in place
+void printFrameTimeStats(const char* name, std::vector<double>& samples, bool last, const char* indent = "    "){
+    std::sort(samples.begin(), samples.end());
+
+    printf("%s\"%s\": { \"min\": %.4f, \"median\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }%s\n",
+           indent, name, samples.front(), samplePercentile(samples, 0.5), samplePercentile(samples, 0.95),
+           samplePercentile(samples, 0.99), samples.back(), last ? "" : ",");
+}
+
+void printMeshStats(const char* name, const MeshStats& stats, bool last){
+    printf("        \"%s\": { \"acmr\": %.4f, \"atvr\": %.4f, \"overdraw\": %.4f, \"overfetch\": %.4f }%s\n",
+           name, stats.vertexCache.acmr, stats.vertexCache.atvr, stats.overdraw.overdraw, stats.vertexFetch.overfetch,
+           last ? "" : ",");
+}
+
+int main(int argc, char** argv) {
+    BenchmarkOptions options{ parseBenchmarkOptions(argc, argv) };
+
+    initializeJobSystem();
+
+    VulkanState vkState{ initializeVulkanState(options.device) };
+
+    // Forces the paths that run without subgroup operations, to compare against them
+    if (!options.subgroupOps){
+        vkState.caps.subgroupComputeOperations = 0;
+    }
+
+    MemoryAllocator allocator{ createMemoryAllocator(vkState) };
+    vkState.allocator = &allocator;
+
+    VkPhysicalDeviceProperties physDevProps{};
+    vkGetPhysicalDeviceProperties(vkState.physicalDevice, &physDevProps);
+    assert(physDevProps.limits.timestampComputeAndGraphics);
+
+    if (options.occlusionCull && !vkState.caps.drawIndirectFirstInstance){
+        fprintf(stderr, "--occlusion-cull needs drawIndirectFirstInstance, ignoring it\n");
+        options.occlusionCull = false;
+    }
+
+    const uint32_t framesInFlight{ options.framesInFlight };
+    const VkFormat colorFormat{ VK_FORMAT_B8G8R8A8_UNORM };
+    const VkExtent2D extent{ options.width, options.height };
+
+    std::vector<VkCommandBuffer> cmdBuffers(framesInFlight);
+    VkCommandPool cmdPool{ allocateCommandBuffers(vkState, cmdBuffers.data(), cmdBuffers.size()) };
+
+    VkFenceCreateInfo fenceCreateInfo{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+    fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    std::vector<VkFence> fences(framesInFlight);
+    for (int i{}; i < framesInFlight; i++){
+        VK_CHECK(vkCreateFence(vkState.device, &fenceCreateInfo, nullptr, &fences[i]));
+    }
+
+    GPUProfiler gpuProfiler{ createGPUProfiler(vkState, framesInFlight, 16) };
+    gpuProfiler.captureTrace = options.gpuTraceFile != nullptr;
+
+    const VkFormat depthFormat{ chooseDepthFormat(vkState.physicalDevice) };
+    VkRenderPass renderPass{ createRenderPass(vkState.device, colorFormat, depthFormat, options.occlusionCull) };
+
+    // Occlusion culling continues with a late pass on top of the early pass's color and depth
+    VkRenderPass lateRenderPass{};
+    if (options.occlusionCull){
+        lateRenderPass = createRenderPass(vkState.device, colorFormat, depthFormat, true, true);
+    }
+
+    // Offscreen render targets take the place of the swapchain images
+    std::vector<Image> colorTargets(framesInFlight);
+    std::vector<Image> depthTargets(framesInFlight);
+    std::vector<VkFramebuffer> framebuffers(framesInFlight);
+    for (int i{}; i < framesInFlight; i++){
+        colorTargets[i] = createImage(vkState, extent, colorFormat,
+                                      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+                                      VK_IMAGE_ASPECT_COLOR_BIT);
+        depthTargets[i] = createImage(vkState, extent, depthFormat,
+                                      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                                      (options.occlusionCull ? VK_IMAGE_USAGE_SAMPLED_BIT : 0u),
+                                      VK_IMAGE_ASPECT_DEPTH_BIT);
+        framebuffers[i] = createFramebuffer(vkState.device, renderPass, colorTargets[i].imageView, depthTargets[i].imageView,
+                                            colorFormat, extent);
+    }
+
+    auto meshLoadBegin{ std::chrono::steady_clock::now() };
+    const bool meshletCulling{ options.meshletCull != MESHLET_CULL_NONE };
+    const bool depthPrepass{ std::find(options.depthModes.begin(), options.depthModes.end(), DEPTH_PREPASS) != options.depthModes.end() };
+    uint32_t meshImportFlags{ (options.optimizeMesh ? MESH_IMPORT_OPTIMIZE : 0u) |
+                              (options.packedVertices ? MESH_IMPORT_QUANTIZE : 0u) |
+                              (meshletCulling ? MESH_IMPORT_MESHLETS : 0u) |
+                              (options.sceneLods ? MESH_IMPORT_LODS : 0u) |
+                              (depthPrepass ? MESH_IMPORT_POSITIONS : 0u) };
+    MappedMesh mesh{ loadMesh(options.meshFile, meshImportFlags, jobThreadCount()) };
+    if (mesh.indexCount == 0){
+        fprintf(stderr, "Failed to load %s\n", options.meshFile);
+        return 1;
+    }
+    double meshLoadTime{ std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - meshLoadBegin).count() };
+
+    // Times the full OBJ import the cache replaces, for comparison with the cached load above
+    double objImportTime{};
+    if (options.compareMeshLoad){
+        auto objImportBegin{ std::chrono::steady_clock::now() };
+        Mesh objMesh{ loadObjMesh(options.meshFile, meshImportFlags, jobThreadCount()) };
+        objImportTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - objImportBegin).count();
+    }
+
+    // Imports the OBJ once per job count without post-processing and checks each result against the serial import
+    std::vector<ObjImportTimings> importTimings(options.importJobCounts.size());
+    std::vector<bool> importsIdentical(options.importJobCounts.size());
+    ObjImportTimings serialImportTimings{};
+    if (!options.importJobCounts.empty()){
+        Mesh serialMesh{ loadObjMesh(options.meshFile, 0, 1, &serialImportTimings) };
+
+        for (uint32_t i{}; i < options.importJobCounts.size(); i++){
+            Mesh importedMesh{ loadObjMesh(options.meshFile, 0, options.importJobCounts[i], &importTimings[i]) };
+
+            importsIdentical[i] = importedMesh.vertices.size() == serialMesh.vertices.size() &&
+                                  importedMesh.indices == serialMesh.indices &&
+                                  memcmp(importedMesh.vertices.data(), serialMesh.vertices.data(), serialMesh.vertices.size() * sizeof(Vertex)) == 0;
+        }
+    }
+
+    MeshStats unoptimizedStats{}, optimizedStats{};
+    if (options.meshStats){
+        Mesh statsMesh{ loadObjMesh(options.meshFile) };
+        unoptimizedStats = analyzeMesh(statsMesh.vertices.data(), statsMesh.vertices.size(),
+                                       statsMesh.indices.data(), statsMesh.indices.size());
+
+        optimizeMesh(statsMesh);
+        optimizedStats = analyzeMesh(statsMesh.vertices.data(), statsMesh.vertices.size(),
+                                     statsMesh.indices.data(), statsMesh.indices.size());
+    }
+
+    // Scene meshes share the main mesh's buffers: their vertices follow its vertices and their indices are rebased to match
+    std::vector<MappedMesh> sceneMeshes{};
+    for (const char* sceneMeshFile : options.sceneMeshFiles){
+        sceneMeshes.push_back(loadMesh(sceneMeshFile, meshImportFlags, jobThreadCount()));
+    }
+
+    std::vector<SceneMesh> meshRanges{ createSceneMesh(mesh, 0) };
+    std::vector<std::vector<uint32_t>> sceneMeshIndices(sceneMeshes.size());
+
+    uint32_t totalVertexCount{ mesh.vertexCount };
+    uint32_t totalIndexCount{ mesh.indexCount };
+    for (uint32_t i{}; i < sceneMeshes.size(); i++){
+        sceneMeshIndices[i].assign(sceneMeshes[i].indices, sceneMeshes[i].indices + sceneMeshes[i].indexCount);
+        for (uint32_t& index : sceneMeshIndices[i]){
+            index += totalVertexCount;
+        }
+
+        meshRanges.push_back(createSceneMesh(sceneMeshes[i], totalIndexCount));
+
+        totalVertexCount += sceneMeshes[i].vertexCount;
+        totalIndexCount += sceneMeshes[i].indexCount;
+    }
+
+    const void* vertexData{ options.packedVertices ? (const void*)mesh.packedVertices : (const void*)mesh.vertices };
+    const size_t vertexStride{ options.packedVertices ? sizeof(PackedVertex) : sizeof(Vertex) };
+    size_t vertexDataSize{ totalVertexCount * vertexStride };
+
+    // Device-local geometry is filled through the staging ring; host-visible geometry is kept for comparison
+    VkMemoryPropertyFlags geometryMemoryFlags{ options.hostVisibleGeometry ?
+                                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT :
+                                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT };
+
+    StagingUploader uploader{ createStagingUploader(vkState, 64 * 1024 * 1024, options.transferQueue) };
+
+    // Only geometry the uploader copies into is shared with its queue; host-visible geometry is written by memcpy
+    auto createGeometryBuffer = [&](VkDeviceSize size, VkBufferUsageFlags usage){
+        return options.hostVisibleGeometry ? createBuffer(vkState, size, usage, geometryMemoryFlags) :
+                                             createUploadBuffer(vkState, uploader, size, usage, geometryMemoryFlags);
+    };
+
+    // Usable both for vertex pulling and as fixed-function vertex and index buffers. Static buffers are also a transfer
+    // source so the defragmentation pass can move them.
+    const VkBufferUsageFlags staticBufferUsage{ VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT };
+
+    Buffer meshVertices{ createGeometryBuffer(vertexDataSize,
+                                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | staticBufferUsage) };
+
+    Buffer meshIndices{ createGeometryBuffer(totalIndexCount * sizeof(uint32_t),
+                                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | staticBufferUsage) };
+
+    // The position stream for the depth prepass, laid out like meshVertices so the same indices apply
+    Buffer meshPositions{};
+    if (depthPrepass){
+        meshPositions = createGeometryBuffer(totalVertexCount * 3 * sizeof(float),
+                                             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | staticBufferUsage);
+    }
+
+    auto uploadGeometry = [&](Buffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size){
+        if (options.hostVisibleGeometry){
+            memcpy((uint8_t*)dst.data + dstOffset, data, size);
+        } else {
+            uploadBuffer(vkState.device, uploader, dst, dstOffset, data, size);
+        }
+    };
+
+    auto uploadBegin{ std::chrono::steady_clock::now() };
+    {
+        uploadGeometry(meshVertices, 0, vertexData, mesh.vertexCount * vertexStride);
+        uploadGeometry(meshIndices, 0, mesh.indices, mesh.indexCount * sizeof(uint32_t));
+        if (depthPrepass){
+            uploadGeometry(meshPositions, 0, mesh.positions, mesh.vertexCount * 3 * sizeof(float));
+        }
+
+        VkDeviceSize vertexOffset{ mesh.vertexCount * vertexStride };
+        VkDeviceSize positionOffset{ mesh.vertexCount * 3 * sizeof(float) };
+        for (uint32_t i{}; i < sceneMeshes.size(); i++){
+            const void* sceneVertexData{ options.packedVertices ? (const void*)sceneMeshes[i].packedVertices : (const void*)sceneMeshes[i].vertices };
+            uploadGeometry(meshVertices, vertexOffset, sceneVertexData, sceneMeshes[i].vertexCount * vertexStride);
+            uploadGeometry(meshIndices, meshRanges[i + 1].lods[0].indexOffset * sizeof(uint32_t),
+                           sceneMeshIndices[i].data(), sceneMeshIndices[i].size() * sizeof(uint32_t));
+            if (depthPrepass){
+                uploadGeometry(meshPositions, positionOffset, sceneMeshes[i].positions, sceneMeshes[i].vertexCount * 3 * sizeof(float));
+            }
+
+            vertexOffset += sceneMeshes[i].vertexCount * vertexStride;
+            positionOffset += sceneMeshes[i].vertexCount * 3 * sizeof(float);
+        }
+
+        waitForUploads(vkState.device, uploader);
+    }
+    double uploadTime{ std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - uploadBegin).count() };
+
+    std::vector<Instance> instances{ kIdentityInstance };
+    std::vector<Scene> scenes{};
+    for (uint32_t instanceCount : options.sceneInstanceCounts){
+        scenes.push_back(buildScene(instances, instanceCount, meshRanges, options.sceneLayers));
+    }
+
+    Buffer instanceBuffer{ createUploadBuffer(vkState, uploader, instances.size() * sizeof(Instance),
+                                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | staticBufferUsage,
+                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) };
+
+    uploadBuffer(vkState.device, uploader, instanceBuffer, 0, instances.data(), instances.size() * sizeof(Instance));
+    waitForUploads(vkState.device, uploader);
+
+    // Per-frame uniforms are written into the slot's region each frame and reached through a dynamic offset
+    UniformRing uniformRing{ createUniformRing(vkState, kUniformRingFrameSize, framesInFlight) };
+
+    // GPU meshlet culling writes per-slot draws and counts, the other slots may still be in flight
+    const bool useDrawIndirectCount{ vkState.caps.drawIndirectCount && options.drawIndirectCount };
+
+    // The draws and counts only live for one frame, so they are created from the slot's linear allocators each time the
+    // slot is recorded, see createCullBuffers
+    std::vector<LinearAllocator> drawCommandMemory(framesInFlight);
+    std::vector<LinearAllocator> drawCountMemory(framesInFlight);
+    if (options.meshletCull == MESHLET_CULL_GPU){
+        for (uint32_t i{}; i < framesInFlight; i++){
+            drawCommandMemory[i] = createLinearAllocator(allocator, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                                         mesh.meshletCount * sizeof(VkDrawIndirectCommand) + kTransientAlignmentSlack);
+            drawCountMemory[i] = createLinearAllocator(allocator,
+                                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                       2 * sizeof(uint32_t) + kTransientAlignmentSlack);
+        }
+    }
+
+    // Nothing holds the static buffers' handles yet, so they can still move: the least used block of each memory type
+    // is emptied into the others and released
+    for (Buffer* staticBuffer : { &meshVertices, &meshIndices, &meshPositions, &instanceBuffer }){
+        if (staticBuffer->buffer){
+            setAllocationUserData(staticBuffer->allocation, staticBuffer);
+        }
+    }
+
+    uint32_t blocksBeforeDefrag{};
+    for (const MemoryHeapStats& heap : getMemoryHeapStats(allocator)){
+        blocksBeforeDefrag += heap.blockCount;
+    }
+
+    BufferMover bufferMover{ vkState, &uploader };
+    auto defragBegin{ std::chrono::steady_clock::now() };
+    VkDeviceSize defragMovedBytes{ defragmentMemory(allocator, moveBufferMemory, &bufferMover, kDefragmentBudget) };
+    double defragTime{ std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - defragBegin).count() };
+
+    uint32_t blocksAfterDefrag{};
+    for (const MemoryHeapStats& heap : getMemoryHeapStats(allocator)){
+        blocksAfterDefrag += heap.blockCount;
+    }
+
+    // Every frame binds the same set; only the uniform offset changes
+    VkDescriptorSetLayout descrLayout{};
+    VkDescriptorPool descrPool{};
+    VkDescriptorSet descrSet{};
+    {
+        VkDescriptorPoolSize descrPoolSizes[2]{};
+        descrPoolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        descrPoolSizes[0].descriptorCount = 1;
+
+        descrPoolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descrPoolSizes[1].descriptorCount = 3;
+
+        VkDescriptorPoolCreateInfo descrPoolCreateInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+        descrPoolCreateInfo.maxSets = 1;
+        descrPoolCreateInfo.poolSizeCount = 2;
+        descrPoolCreateInfo.pPoolSizes = descrPoolSizes;
+
+        VK_CHECK(vkCreateDescriptorPool(vkState.device, &descrPoolCreateInfo, nullptr, &descrPool));
+
+        VkDescriptorSetLayoutBinding bindings[4]{};
+        bindings[0].binding = 0;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[0].descriptorCount = 1;
+        bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        bindings[1].binding = 1;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[1].descriptorCount = 1;
+        bindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        bindings[2].binding = 2;
+        bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        bindings[2].descriptorCount = 1;
+        bindings[2].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        bindings[3].binding = 3;
+        bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[3].descriptorCount = 1;
+        bindings[3].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        VkDescriptorSetLayoutCreateInfo descrSetLayoutInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+        descrSetLayoutInfo.bindingCount = 4;
+        descrSetLayoutInfo.pBindings = bindings;
+
+        VK_CHECK(vkCreateDescriptorSetLayout(vkState.device, &descrSetLayoutInfo, nullptr, &descrLayout));
+
+        VkDescriptorSetAllocateInfo descrSetAllocInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+        descrSetAllocInfo.descriptorPool = descrPool;
+        descrSetAllocInfo.descriptorSetCount = 1;
+        descrSetAllocInfo.pSetLayouts = &descrLayout;
+
+        VK_CHECK(vkAllocateDescriptorSets(vkState.device, &descrSetAllocInfo, &descrSet));
+
+        VkDescriptorBufferInfo bufferInfos[4]{};
+        bufferInfos[0].buffer = meshVertices.buffer;
+        bufferInfos[0].range = VK_WHOLE_SIZE;
+
+        bufferInfos[1].buffer = meshIndices.buffer;
+        bufferInfos[1].range = VK_WHOLE_SIZE;
+
+        bufferInfos[2].buffer = uniformRing.buffer.buffer;
+        bufferInfos[2].range = sizeof(UniformData);
+
+        bufferInfos[3].buffer = instanceBuffer.buffer;
+        bufferInfos[3].range = VK_WHOLE_SIZE;
+
+        VkWriteDescriptorSet descrWrites[4]{};
+        for (int j{}; j < 4; j++){
+            descrWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descrWrites[j].dstSet = descrSet;
+            descrWrites[j].dstBinding = j;
+            descrWrites[j].descriptorCount = 1;
+            descrWrites[j].descriptorType = bindings[j].descriptorType;
+            descrWrites[j].pBufferInfo = &bufferInfos[j];
+        }
+
+        vkUpdateDescriptorSets(vkState.device, 4, descrWrites, 0, nullptr);
+    }
+
+    VkPipelineLayout pipelineLayout{};
+    {
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        pushConstantRange.size = sizeof(DrawConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{ VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &descrLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        VK_CHECK(vkCreatePipelineLayout(vkState.device, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+    }
+
+    VkViewport viewport{ 0.0f, 0.0f, (float)extent.width, (float)extent.height, 0.0f, 1.0f };
+
+    auto pipelineCacheBegin{ std::chrono::steady_clock::now() };
+    bool pipelineCacheLoaded{};
+    VkPipelineCache pipelineCache{ loadPipelineCache(vkState, options.pipelineCacheFile, &pipelineCacheLoaded) };
+    double pipelineCacheLoadTime{ std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pipelineCacheBegin).count() };
+
+    // Every instance of every scene is an object; a phase culls the range of its scene
+    std::vector<SceneObject> sceneObjects{};
+    std::vector<uint32_t> sceneFirstObjects{};
+    OcclusionCuller occlusionCuller{};
+    if (options.occlusionCull){
+        for (const Scene& scene : scenes){
+            sceneFirstObjects.push_back(sceneObjects.size());
+            appendSceneObjects(sceneObjects, scene, meshRanges);
+        }
+
+        occlusionCuller = createOcclusionCuller(vkState, pipelineCache, uploader, sceneObjects, instanceBuffer, depthTargets, extent);
+    }
+
+    GraphicsPipelineDesc pipelineDesc{};
+    pipelineDesc.vertexShaderFile = "shaders/mesh.vs.spv";
+    pipelineDesc.fragmentShaderFile = "shaders/mesh.fs.spv";
+    pipelineDesc.renderPass = renderPass;
+    pipelineDesc.pipelineLayout = pipelineLayout;
+    pipelineDesc.viewport = viewport;
+    pipelineDesc.cullMode = VK_CULL_MODE_BACK_BIT;
+    pipelineDesc.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    pipelineDesc.depthTest = VK_TRUE;
+    pipelineDesc.depthWrite = VK_TRUE;
+    pipelineDesc.depthCompareOp = VK_COMPARE_OP_LESS;
+
+    // After a prepass the depth buffer already holds the nearest surface, so only fragments on it are shaded
+    auto setDepthMode = [](GraphicsPipelineDesc& desc, DepthMode depthMode){
+        desc.depthTest = depthMode != DEPTH_OFF;
+        desc.depthWrite = depthMode == DEPTH_TEST;
+        desc.depthCompareOp = depthMode == DEPTH_PREPASS ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS;
+    };
+
+    const VertexFormat vertexFormat{ options.packedVertices ? VERTEX_FORMAT_PACKED : VERTEX_FORMAT_FLOAT };
+
+    // Values of mesh.vert's switches for a phase; mesh_attributes.vert has none, so attributes phases draw the same
+    // pipeline in both modes
+    auto meshPermutation = [&](ShaderPermutationMode permutation, VertexInputMode vertexInput){
+        bool specialized{ permutation == SHADER_SPECIALIZED && vertexInput != VERTEX_INPUT_ATTRIBUTES };
+        return specialized ? meshShaderPermutation(vertexFormat, vertexInput) : ShaderPermutation{};
+    };
+
+    // Main pass pipelines per depth mode, indexed by DepthMode, and within it by shader permutation; the permutations
+    // the phases draw with are created here, ahead of the frames
+    auto pipelineBegin{ std::chrono::steady_clock::now() };
+    PermutedPipelines meshPipelines[DEPTH_MODE_COUNT]{};
+    for (DepthMode depthMode : options.depthModes){
+        meshPipelines[depthMode].desc = pipelineDesc;
+        setDepthMode(meshPipelines[depthMode].desc, depthMode);
+
+        for (VertexInputMode vertexInput : options.vertexInputs){
+            for (ShaderPermutationMode permutation : options.shaderPermutations){
+                if (vertexInput != VERTEX_INPUT_ATTRIBUTES){
+                    getPermutedPipeline(vkState.device, pipelineCache, meshPipelines[depthMode], meshPermutation(permutation, vertexInput));
+                }
+            }
+        }
+    }
+    double pipelineCreationTime{ std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pipelineBegin).count() };
+
+    GraphicsPipeline attributesPipelines[DEPTH_MODE_COUNT]{};
+    if (std::find(options.vertexInputs.begin(), options.vertexInputs.end(), VERTEX_INPUT_ATTRIBUTES) != options.vertexInputs.end()){
+        GraphicsPipelineDesc attributesPipelineDesc{ pipelineDesc };
+        attributesPipelineDesc.vertexShaderFile = "shaders/mesh_attributes.vs.spv";
+        setVertexAttributes(attributesPipelineDesc, vertexFormat);
+
+        for (DepthMode depthMode : options.depthModes){
+            setDepthMode(attributesPipelineDesc, depthMode);
+
+            if (!attributesPipelines[depthMode].pipeline){
+                attributesPipelines[depthMode] = createGraphicsPipeline(vkState.device, pipelineCache, attributesPipelineDesc);
+            }
+        }
+    }
+
+    GraphicsPipeline depthPrepassPipeline{};
+    if (depthPrepass){
+        GraphicsPipelineDesc depthPrepassPipelineDesc{ pipelineDesc };
+        depthPrepassPipelineDesc.vertexShaderFile = "shaders/depth_prepass.vs.spv";
+        depthPrepassPipelineDesc.depthOnly = true;
+        setPositionAttributes(depthPrepassPipelineDesc);
+
+        depthPrepassPipeline = createGraphicsPipeline(vkState.device, pipelineCache, depthPrepassPipelineDesc);
+    }
+
+    MeshletCuller meshletCuller{};
+    if (options.meshletCull == MESHLET_CULL_GPU){
+        meshletCuller = createMeshletCuller(vkState, pipelineCache, uploader, mesh, framesInFlight);
+    }
+
+    // Replaces the slot's draws and counts with new buffers from its linear allocators; the slot's fence must have
+    // signaled and its counts must have been read back
+    uint32_t transientBufferCount{};
+    auto createCullBuffers = [&](uint32_t slotID){
+        resetLinearAllocator(drawCommandMemory[slotID]);
+        resetLinearAllocator(drawCountMemory[slotID]);
+
+        createMeshletCullBuffers(vkState, meshletCuller, slotID, nullptr, &drawCommandMemory[slotID], &drawCountMemory[slotID]);
+        transientBufferCount += 2;
+    };
+
+    // Extra state variants compiled in parallel to measure batch pipeline creation
+    std::vector<GraphicsPipelineDesc> variantDescs(options.pipelineVariants, pipelineDesc);
+    for (uint32_t i{}; i < options.pipelineVariants; i++){
+        const VkCullModeFlags cullModes[]{ VK_CULL_MODE_NONE, VK_CULL_MODE_BACK_BIT, VK_CULL_MODE_FRONT_BIT, VK_CULL_MODE_FRONT_AND_BACK };
+        variantDescs[i].cullMode = cullModes[i % 4];
+        variantDescs[i].frontFace = (i / 4) % 2 ? VK_FRONT_FACE_CLOCKWISE : VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        variantDescs[i].blendEnable = (i / 8) % 2;
+        variantDescs[i].viewport.width = viewport.width - (float)(i / 16);
+    }
+
+    auto variantsBegin{ std::chrono::steady_clock::now() };
+    std::vector<GraphicsPipeline> variantPipelines{ createGraphicsPipelines(vkState.device, pipelineCache, variantDescs, options.pipelineThreads) };
+    double variantsCreationTime{ std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - variantsBegin).count() };
+
+    // Each phase renders warmup + frames frames: with meshlet culling the monolithic baseline and then the culled
+    // run, in scene mode one phase per instance count and record thread count, each without and then with LOD
+    // selection if enabled. All of that repeats for every vertex input mode, depth mode and shader permutation mode.
+    // GPU zones are reported for the last phase.
+    std::vector<BenchmarkPhase> phases{};
+    for (VertexInputMode vertexInput : options.vertexInputs){
+        for (DepthMode depth : options.depthModes){
+            for (ShaderPermutationMode permutation : options.shaderPermutations){
+                if (meshletCulling){
+                    phases.push_back({ false, -1, 0, false, vertexInput, depth, false, permutation });
+                    phases.push_back({ true, -1, 0, false, vertexInput, depth, false, permutation });
+                    continue;
+                }
+
+                for (int32_t sceneID{ scenes.empty() ? -1 : 0 }; sceneID < (int32_t)scenes.size(); sceneID++){
+                    for (uint32_t recordThreads : options.recordThreadCounts){
+                        phases.push_back({ false, sceneID, recordThreads, false, vertexInput, depth, false, permutation });
+
+                        if (options.occlusionCull && recordThreads == 0 && depth == DEPTH_TEST){
+                            phases.push_back({ false, sceneID, recordThreads, false, vertexInput, depth, true, permutation });
+                        }
+
+                        if (options.sceneLods){
+                            phases.push_back({ false, sceneID, recordThreads, true, vertexInput, depth, false, permutation });
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    const uint32_t phaseCount{ (uint32_t)phases.size() };
+    const uint32_t phaseFrames{ options.warmupFrames + options.frames };
+    const uint32_t totalFrames{ phaseFrames * phaseCount };
+
+    auto phaseOf = [&](uint64_t frameID){ return (uint32_t)(frameID / phaseFrames); };
+    auto isMeasuredFrame = [&](uint64_t frameID){ return frameID % phaseFrames >= options.warmupFrames; };
+
+    // Every thread of the job system gets a pool per slot, so recording never contends on a pool
+    const uint32_t threadCount{ jobThreadCount() };
+    std::vector<SecondaryCommandPool> secondaryPools(framesInFlight * threadCount);
+    for (SecondaryCommandPool& secondaryPool : secondaryPools){
+        secondaryPool = createSecondaryCommandPool(vkState);
+    }
+
+    std::vector<std::vector<double>> phaseCPUFrameTimes(phaseCount);
+    std::vector<std::vector<double>> phaseGPUFrameTimes(phaseCount);
+    std::vector<std::vector<double>> phaseRecordTimes(phaseCount);
+    std::vector<uint64_t> phaseTriangles(phaseCount);
+    std::vector<uint32_t> phaseDraws(phaseCount);
+    std::vector<std::vector<double>> phasePrepassTimes(phaseCount);
+
+    // Per frame sums of the culling passes' GPU times
+    std::vector<std::vector<double>> phaseOcclusionCullTimes(phaseCount);
+    std::vector<std::vector<double>> phaseDepthPyramidTimes(phaseCount);
+
+    // Sums over the measured frames of the counters in OcclusionCullCounts
+    std::vector<uint64_t> phaseEarlyDraws(phaseCount);
+    std::vector<uint64_t> phaseLateDraws(phaseCount);
+    std::vector<uint64_t> phaseFrustumCulled(phaseCount);
+    std::vector<uint64_t> phaseOccluded(phaseCount);
+    std::vector<uint64_t> phaseOcclusionTriangles(phaseCount);
+    std::vector<uint32_t> phaseOcclusionFrames(phaseCount);
+
+    // Selected level per instance, carried across frames for the LOD hysteresis
+    std::vector<uint8_t> instanceLods{};
+    const float pixelsPerUnit{ extent.height / 2.0f };
+
+    uint64_t submittedTriangles{};
+    uint32_t cullStatsFrames{};
+
+    // Vertex statistics bracket the render pass; secondary command buffers would need inheritedQueries, so phases
+    // that record on worker threads go without
+    std::vector<VkQueryPool> vertexStatsQueryPools(vkState.caps.pipelineStatistics ? framesInFlight : 0);
+    for (VkQueryPool& queryPool : vertexStatsQueryPools){
+        queryPool = createVertexStatisticsQueryPool(vkState.device, 1);
+    }
+
+    auto hasVertexStats = [&](const BenchmarkPhase& phase){ return vkState.caps.pipelineStatistics && phase.recordThreads == 0; };
+
+    std::vector<uint64_t> phaseInputVertices(phaseCount);
+    std::vector<uint64_t> phaseVertexInvocations(phaseCount);
+    std::vector<uint32_t> phaseVertexStatsFrames(phaseCount);
+
+    auto collectVertexStats = [&](uint32_t recordedFrameID){
+        uint32_t phase{ phaseOf(recordedFrameID) };
+        if (!hasVertexStats(phases[phase]) || !isMeasuredFrame(recordedFrameID)){
+            return;
+        }
+
+        uint64_t statistics[2]{};
+        VkResult queryRes{ vkGetQueryPoolResults(vkState.device, vertexStatsQueryPools[recordedFrameID % framesInFlight], 0, 1,
+                                                 sizeof(statistics), statistics, sizeof(statistics), VK_QUERY_RESULT_64_BIT) };
+        if (queryRes != VK_SUCCESS){
+            return;
+        }
+
+        phaseInputVertices[phase] += statistics[0];
+        phaseVertexInvocations[phase] += statistics[1];
+        phaseVertexStatsFrames[phase]++;
+    };
+
+    // GPU counters of a slot are read once its fence has signaled, before the slot is recorded again
+    auto collectCullStats = [&](uint32_t recordedFrameID){
+        if (options.meshletCull != MESHLET_CULL_GPU || !phases[phaseOf(recordedFrameID)].cullMeshlets || !isMeasuredFrame(recordedFrameID)){
+            return;
+        }
+
+        submittedTriangles += meshletCullTriangles(meshletCuller, recordedFrameID % framesInFlight);
+        cullStatsFrames++;
+    };
+
+    auto collectOcclusionStats = [&](uint32_t recordedFrameID){
+        uint32_t phase{ phaseOf(recordedFrameID) };
+        if (!phases[phase].occlusionCull || !isMeasuredFrame(recordedFrameID)){
+            return;
+        }
+
+        const OcclusionFrame& frame{ occlusionCuller.frames[recordedFrameID % framesInFlight] };
+        const OcclusionCullCounts& earlyCounts{ *(const OcclusionCullCounts*)frame.drawCounts[OCCLUSION_PASS_EARLY].data };
+        const OcclusionCullCounts& lateCounts{ *(const OcclusionCullCounts*)frame.drawCounts[OCCLUSION_PASS_LATE].data };
+
+        phaseEarlyDraws[phase] += earlyCounts.drawCount;
+        phaseLateDraws[phase] += lateCounts.drawCount;
+        phaseFrustumCulled[phase] += lateCounts.frustumCulled;
+        phaseOccluded[phase] += lateCounts.occluded;
+        phaseOcclusionTriangles[phase] += earlyCounts.drawnTriangles + lateCounts.drawnTriangles;
+        phaseOcclusionFrames[phase]++;
+    };
+
+    // Zone names are string literals, so they are matched by pointer and kept in first-seen order
+    std::vector<std::pair<const char*, std::vector<double>>> gpuZoneTimes{};
+
+    auto collectGPUZones = [&](){
+        if (!isMeasuredFrame(gpuProfiler.resolvedFrameID)){
+            return;
+        }
+
+        uint32_t phase{ phaseOf(gpuProfiler.resolvedFrameID) };
+        phaseGPUFrameTimes[phase].push_back(gpuProfiler.resolvedFrameTimeMs);
+
+        double occlusionCullMs{}, depthPyramidMs{};
+        for (const GPUZoneResult& result : gpuProfiler.results){
+            if (result.name == kDepthPrepassZone){
+                phasePrepassTimes[phase].push_back(result.durationMs);
+            } else if (result.name == kOcclusionCullZone){
+                occlusionCullMs += result.durationMs;
+            } else if (result.name == kDepthPyramidZone){
+                depthPyramidMs += result.durationMs;
+            }
+        }
+
+        if (phases[phase].occlusionCull){
+            phaseOcclusionCullTimes[phase].push_back(occlusionCullMs);
+            phaseDepthPyramidTimes[phase].push_back(depthPyramidMs);
+        }
+
+        if (phase + 1 != phaseCount){
+            return;
+        }
+
+        for (const GPUZoneResult& result : gpuProfiler.results){
+            auto zoneTimes{ std::find_if(gpuZoneTimes.begin(), gpuZoneTimes.end(),
+                                         [&result](const auto& zone){ return zone.first == result.name; }) };
+            if (zoneTimes == gpuZoneTimes.end()){
+                gpuZoneTimes.push_back({ result.name, {} });
+                zoneTimes = gpuZoneTimes.end() - 1;
+            }
+
+            zoneTimes->second.push_back(result.durationMs);
+        }
+    };
+
+    // JSON goes to stdout, so the interval reports are only written when a file is given
+    configureCPUProfiler(options.cpuStatsFile, options.cpuStatsInterval, "Frame");
+    setCPUTraceCapture(options.gpuTraceFile != nullptr);
+
+    for (uint32_t frameID{}; frameID < totalFrames; frameID++){
+        CPU_ZONE("Frame");
+
+        auto beginFrameTimeStamp{ std::chrono::steady_clock::now() };
+
+        uint32_t slotID{ frameID % framesInFlight };
+
+        {
+            CPU_ZONE("FenceWait");
+
+            VK_CHECK(vkWaitForFences(vkState.device, 1, &fences[slotID], VK_FALSE, -1));
+            VK_CHECK(vkResetFences(vkState.device, 1, &fences[slotID]));
+        }
+
+        const BenchmarkPhase& phase{ phases[phaseOf(frameID)] };
+
+        for (uint32_t i{}; i < threadCount; i++){
+            resetSecondaryCommandPool(vkState.device, secondaryPools[slotID * threadCount + i]);
+        }
+
+        if (frameID >= framesInFlight){
+            collectCullStats(frameID - framesInFlight);
+            collectOcclusionStats(frameID - framesInFlight);
+            collectVertexStats(frameID - framesInFlight);
+        }
+
+        const float time{ frameID * 0.02f };
+        const bool cullMeshlets{ phase.cullMeshlets };
+
+        if (cullMeshlets && options.meshletCull == MESHLET_CULL_GPU){
+            CPU_ZONE("CullBuffers");
+            createCullBuffers(slotID);
+        }
+
+        uint32_t uniformOffset{};
+        {
+            CPU_ZONE("UBOUpdate");
+
+            UniformData uniformData{};
+            uniformData.Time = time;
+            uniformData.VertexFormat = vertexFormat;
+            uniformData.VertexInput = phase.vertexInput;
+
+            beginUniformRingFrame(uniformRing, slotID);
+            uniformOffset = writeUniforms(uniformRing, &uniformData, sizeof(uniformData));
+        }
+
+        const bool indexedDraws{ phase.vertexInput != VERTEX_INPUT_PULL };
+        const GraphicsPipeline& drawPipeline{ phase.vertexInput == VERTEX_INPUT_ATTRIBUTES ? attributesPipelines[phase.depth] :
+                                              getPermutedPipeline(vkState.device, pipelineCache, meshPipelines[phase.depth],
+                                                                  meshPermutation(phase.permutation, phase.vertexInput)) };
+
+        VkCommandBufferBeginInfo cmdBeginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+        cmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        auto beginRecordTimeStamp{ std::chrono::steady_clock::now() };
+
+        Scene lodScene{};
+        const Scene* frameScene{ phase.sceneID >= 0 ? &scenes[phase.sceneID] : nullptr };
+        if (phase.lods){
+            CPU_ZONE("LodSelect");
+
+            lodScene = selectSceneLods(*frameScene, instances, meshRanges, pixelsPerUnit, instanceLods);
+            frameScene = &lodScene;
+        }
+
+        if (frameScene){
+            phaseTriangles[phaseOf(frameID)] = frameScene->triangleCount;
+            phaseDraws[phaseOf(frameID)] = countSceneDraws(*frameScene, options.sceneInstancing);
+        }
+
+        VK_CHECK(vkBeginCommandBuffer(cmdBuffers[slotID], &cmdBeginInfo));
+        {
+            CPU_ZONE("Record");
+
+            // The slot's fence has signaled, so the profiler frame it reuses is ready to be read back
+            if (beginGPUProfilerFrame(gpuProfiler, cmdBuffers[slotID])){
+                collectGPUZones();
+            }
+
+            GPU_ZONE(gpuProfiler, cmdBuffers[slotID], "Frame");
+
+            if (cullMeshlets && options.meshletCull == MESHLET_CULL_GPU){
+                GPU_ZONE(gpuProfiler, cmdBuffers[slotID], "MeshletCull");
+
+                recordMeshletCull(cmdBuffers[slotID], meshletCuller, slotID, time, !useDrawIndirectCount);
+            }
+
+            const uint32_t firstSceneObject{ phase.occlusionCull ? sceneFirstObjects[phase.sceneID] : 0 };
+            const uint32_t sceneObjectCount{ phase.occlusionCull ? scenes[phase.sceneID].instanceCount : 0 };
+
+            // The early pass draws what was visible last frame, without testing it against the pyramid
+            if (phase.occlusionCull){
+                GPU_ZONE(gpuProfiler, cmdBuffers[slotID], kOcclusionCullZone);
+
+                recordOcclusionCull(cmdBuffers[slotID], occlusionCuller, slotID, OCCLUSION_PASS_EARLY,
+                                    firstSceneObject, sceneObjectCount, indexedDraws, !useDrawIndirectCount);
+            }
+
+            {
+                GPU_ZONE(gpuProfiler, cmdBuffers[slotID], "LayoutTransition");
+
+                VkImageMemoryBarrier undefinedToRenderBarrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+                undefinedToRenderBarrier.srcAccessMask = 0;
+                undefinedToRenderBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+                undefinedToRenderBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                undefinedToRenderBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+                undefinedToRenderBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                undefinedToRenderBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                undefinedToRenderBarrier.image = colorTargets[slotID].image;
+                undefinedToRenderBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                undefinedToRenderBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+                undefinedToRenderBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+                vkCmdPipelineBarrier(cmdBuffers[slotID],
+                                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                    VK_DEPENDENCY_BY_REGION_BIT,
+                                    0, nullptr, 0, nullptr, 1, &undefinedToRenderBarrier);
+            }
+
+            VkClearValue clearValues[2]{};
+            clearValues[0].color = {{ 0.1f, 0.1f, 0.1f, 1.0f }};
+            clearValues[1].depthStencil = { 1.0f, 0 };
+
+            VkRenderPassBeginInfo renderPassBeginInfo{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+            renderPassBeginInfo.renderPass = renderPass;
+            renderPassBeginInfo.framebuffer = framebuffers[slotID];
+            renderPassBeginInfo.renderArea.extent.width = extent.width;
+            renderPassBeginInfo.renderArea.extent.height = extent.height;
+            renderPassBeginInfo.clearValueCount = 2;
+            renderPassBeginInfo.pClearValues = clearValues;
+
+            {
+                GPU_ZONE(gpuProfiler, cmdBuffers[slotID], "MainPass");
+
+                if (hasVertexStats(phase)){
+                    vkCmdResetQueryPool(cmdBuffers[slotID], vertexStatsQueryPools[slotID], 0, 1);
+                    vkCmdBeginQuery(cmdBuffers[slotID], vertexStatsQueryPools[slotID], 0, 0);
+                }
+
+                vkCmdBeginRenderPass(cmdBuffers[slotID], &renderPassBeginInfo,
+                                     phase.recordThreads > 0 ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+
+                if (phase.recordThreads > 0){
+                    SceneRecordState recordState{};
+                    recordState.device = vkState.device;
+                    recordState.inheritanceInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+                    recordState.inheritanceInfo.renderPass = renderPass;
+                    recordState.inheritanceInfo.framebuffer = framebuffers[slotID];
+                    recordState.pipeline = drawPipeline.pipeline;
+                    recordState.pipelineLayout = pipelineLayout;
+                    recordState.descrSet = descrSet;
+                    recordState.uniformOffset = uniformOffset;
+                    recordState.indexBuffer = indexedDraws ? meshIndices.buffer : VK_NULL_HANDLE;
+                    recordState.vertexBuffer = phase.vertexInput == VERTEX_INPUT_ATTRIBUTES ? meshVertices.buffer : VK_NULL_HANDLE;
+
+                    drawSceneParallel(cmdBuffers[slotID], recordState, &secondaryPools[slotID * threadCount],
+                                      *frameScene, meshRanges, options.sceneInstancing, phase.recordThreads);
+                } else {
+                    vkCmdBindDescriptorSets(cmdBuffers[slotID], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descrSet, 1, &uniformOffset);
+
+                    // Same subpass and draws as the main pass, so the EQUAL test sees exactly the prepass depth
+                    if (phase.depth == DEPTH_PREPASS){
+                        GPU_ZONE(gpuProfiler, cmdBuffers[slotID], kDepthPrepassZone);
+
+                        VkDeviceSize positionBufferOffset{};
+                        vkCmdBindPipeline(cmdBuffers[slotID], VK_PIPELINE_BIND_POINT_GRAPHICS, depthPrepassPipeline.pipeline);
+                        vkCmdBindIndexBuffer(cmdBuffers[slotID], meshIndices.buffer, 0, VK_INDEX_TYPE_UINT32);
+                        vkCmdBindVertexBuffers(cmdBuffers[slotID], 0, 1, &meshPositions.buffer, &positionBufferOffset);
+
+                        if (frameScene){
+                            drawScene(cmdBuffers[slotID], *frameScene, meshRanges, options.sceneInstancing, true);
+                        } else {
+                            vkCmdDrawIndexed(cmdBuffers[slotID], mesh.indexCount, 1, 0, 0, 0);
+                        }
+                    }
+
+                    vkCmdBindPipeline(cmdBuffers[slotID], VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipeline.pipeline);
+
+                    // Scene draws push their mesh's constants themselves; culled draws share the main mesh's
+                    if (!frameScene || phase.occlusionCull){
+                        vkCmdPushConstants(cmdBuffers[slotID], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawConstants),
+                                           &meshRanges[0].drawConstants);
+                    }
+
+                    if (indexedDraws){
+                        vkCmdBindIndexBuffer(cmdBuffers[slotID], meshIndices.buffer, 0, VK_INDEX_TYPE_UINT32);
+                    }
+                    if (phase.vertexInput == VERTEX_INPUT_ATTRIBUTES){
+                        VkDeviceSize vertexBufferOffset{};
+                        vkCmdBindVertexBuffers(cmdBuffers[slotID], 0, 1, &meshVertices.buffer, &vertexBufferOffset);
+                    }
+
+                    if (phase.occlusionCull){
+                        drawOcclusionCulled(cmdBuffers[slotID], occlusionCuller, slotID, OCCLUSION_PASS_EARLY,
+                                            sceneObjectCount, indexedDraws, useDrawIndirectCount, vkState.caps);
+                    } else if (frameScene){
+                        drawScene(cmdBuffers[slotID], *frameScene, meshRanges, options.sceneInstancing, indexedDraws, pipelineLayout);
+                    } else if (!cullMeshlets && indexedDraws){
+                        vkCmdDrawIndexed(cmdBuffers[slotID], mesh.indexCount, 1, 0, 0, 0);
+                    } else if (!cullMeshlets){
+                        vkCmdDraw(cmdBuffers[slotID], mesh.indexCount, 1, 0, 0);
+                    } else if (options.meshletCull == MESHLET_CULL_GPU){
+                        drawMeshletCulled(cmdBuffers[slotID], meshletCuller, slotID, useDrawIndirectCount, vkState.caps);
+                    } else {
+                        // The index buffer is in meshlet order, so firstVertex (firstIndex when indexed) selects a meshlet's triangles
+                        for (uint32_t i{}; i < mesh.meshletCount; i++){
+                            if (isMeshletVisible(mesh.meshlets[i], time)){
+                                if (indexedDraws){
+                                    vkCmdDrawIndexed(cmdBuffers[slotID], mesh.meshlets[i].indexCount, 1, mesh.meshlets[i].indexOffset, 0, 0);
+                                } else {
+                                    vkCmdDraw(cmdBuffers[slotID], mesh.meshlets[i].indexCount, 1, mesh.meshlets[i].indexOffset, 0);
+                                }
+
+                                if (isMeasuredFrame(frameID)){
+                                    submittedTriangles += mesh.meshlets[i].indexCount / 3;
+                                }
+                            }
+                        }
+
+                        cullStatsFrames += isMeasuredFrame(frameID) ? 1 : 0;
+                    }
+                }
+
+                vkCmdEndRenderPass(cmdBuffers[slotID]);
+
+                // The late pass tests every object against a pyramid of the early pass's depth and draws the ones
+                // that became visible, on top of the early pass
+                if (phase.occlusionCull){
+                    {
+                        GPU_ZONE(gpuProfiler, cmdBuffers[slotID], kDepthPyramidZone);
+
+                        recordDepthPyramid(cmdBuffers[slotID], occlusionCuller, slotID, depthTargets[slotID]);
+                    }
+
+                    {
+                        GPU_ZONE(gpuProfiler, cmdBuffers[slotID], kOcclusionCullZone);
+
+                        recordOcclusionCull(cmdBuffers[slotID], occlusionCuller, slotID, OCCLUSION_PASS_LATE,
+                                            firstSceneObject, sceneObjectCount, indexedDraws, !useDrawIndirectCount);
+                    }
+
+                    GPU_ZONE(gpuProfiler, cmdBuffers[slotID], "LatePass");
+
+                    renderPassBeginInfo.renderPass = lateRenderPass;
+                    vkCmdBeginRenderPass(cmdBuffers[slotID], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+                    vkCmdBindDescriptorSets(cmdBuffers[slotID], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descrSet, 1, &uniformOffset);
+                    vkCmdBindPipeline(cmdBuffers[slotID], VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipeline.pipeline);
+                    vkCmdPushConstants(cmdBuffers[slotID], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawConstants),
+                                       &meshRanges[0].drawConstants);
+
+                    if (indexedDraws){
+                        vkCmdBindIndexBuffer(cmdBuffers[slotID], meshIndices.buffer, 0, VK_INDEX_TYPE_UINT32);
+                    }
+                    if (phase.vertexInput == VERTEX_INPUT_ATTRIBUTES){
+                        VkDeviceSize vertexBufferOffset{};
+                        vkCmdBindVertexBuffers(cmdBuffers[slotID], 0, 1, &meshVertices.buffer, &vertexBufferOffset);
+                    }
+
+                    drawOcclusionCulled(cmdBuffers[slotID], occlusionCuller, slotID, OCCLUSION_PASS_LATE,
+                                        sceneObjectCount, indexedDraws, useDrawIndirectCount, vkState.caps);
+
+                    vkCmdEndRenderPass(cmdBuffers[slotID]);
+                }
+
+                if (hasVertexStats(phase)){
+                    vkCmdEndQuery(cmdBuffers[slotID], vertexStatsQueryPools[slotID], 0);
+                }
+            }
+        }
+        VK_CHECK(vkEndCommandBuffer(cmdBuffers[slotID]));
+
+        if (isMeasuredFrame(frameID)){
+            double recordTime{ std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - beginRecordTimeStamp).count() };
+            phaseRecordTimes[phaseOf(frameID)].push_back(recordTime);
+        }
+
+        VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &cmdBuffers[slotID];
+
+        {
+            CPU_ZONE("Submit");
+
+            VK_CHECK(vkQueueSubmit(vkState.renderQueue, 1, &submitInfo, fences[slotID]));
+        }
+
+        endGPUProfilerFrame(gpuProfiler);
+
+        if (isMeasuredFrame(frameID)){
+            auto endFrameTimeStamp{ std::chrono::steady_clock::now() };
+            double cpuFrameTime{ std::chrono::duration<double, std::milli>(endFrameTimeStamp - beginFrameTimeStamp).count() };
+            phaseCPUFrameTimes[phaseOf(frameID)].push_back(cpuFrameTime);
+        }
+
+        updateCPUProfiler();
+    }
+
+    // Workers record CPU zones, so they stop before the profiler releases their rings
+    shutdownJobSystem();
+    shutdownCPUProfiler();
+
+    VK_CHECK(vkDeviceWaitIdle(vkState.device));
+
+    // Collect the frames that were still in flight when the loop ended, oldest first
+    for (uint32_t i{}; i < framesInFlight; i++){
+        if (resolveGPUProfilerFrame(gpuProfiler, (gpuProfiler.frameIndex + i) % framesInFlight)){
+            collectGPUZones();
+        }
+    }
+
+    for (uint32_t frameID{ std::max(totalFrames, framesInFlight) - framesInFlight }; frameID < totalFrames; frameID++){
+        collectCullStats(frameID);
+        collectOcclusionStats(frameID);
+        collectVertexStats(frameID);
+    }
+
+    for (uint32_t i{}; i < phaseCount; i++){
+        std::sort(phaseCPUFrameTimes[i].begin(), phaseCPUFrameTimes[i].end());
+        std::sort(phaseGPUFrameTimes[i].begin(), phaseGPUFrameTimes[i].end());
+        std::sort(phaseRecordTimes[i].begin(), phaseRecordTimes[i].end());
+        std::sort(phasePrepassTimes[i].begin(), phasePrepassTimes[i].end());
+        std::sort(phaseOcclusionCullTimes[i].begin(), phaseOcclusionCullTimes[i].end());
+        std::sort(phaseDepthPyramidTimes[i].begin(), phaseDepthPyramidTimes[i].end());
+    }
+
+    std::vector<double>& cpuFrameTimes{ phaseCPUFrameTimes.back() };
+    std::vector<double>& gpuFrameTimes{ phaseGPUFrameTimes.back() };
+
+    printf("{\n");
+    printf("    \"device\": \"%s\",\n", physDevProps.deviceName);
+    printf("    \"deviceType\": \"%s\",\n", physicalDeviceTypeName(vkState.caps.deviceType));
+    printf("    \"capabilities\": { \"drawIndirectCount\": %s, \"drawIndirectFirstInstance\": %s, \"multiDrawIndirect\": %s, "
+           "\"pipelineStatistics\": %s, \"descriptorIndexing\": %s, \"storageBuffer8Bit\": %s, \"storageBuffer16Bit\": %s, "
+           "\"timelineSemaphores\": %s, \"calibratedTimestamps\": %s, \"subgroupSize\": %u, \"subgroupComputeOperations\": %u },\n",
+           vkState.caps.drawIndirectCount ? "true" : "false", vkState.caps.drawIndirectFirstInstance ? "true" : "false",
+           vkState.caps.multiDrawIndirect ? "true" : "false", vkState.caps.pipelineStatistics ? "true" : "false",
+           vkState.caps.descriptorIndexing ? "true" : "false", vkState.caps.storageBuffer8Bit ? "true" : "false",
+           vkState.caps.storageBuffer16Bit ? "true" : "false", vkState.caps.timelineSemaphores ? "true" : "false",
+           vkState.caps.calibratedTimestamps ? "true" : "false", vkState.caps.subgroupSize,
+           vkState.caps.subgroupComputeOperations);
+    printf("    \"mesh\": \"%s\",\n", options.meshFile);
+    printf("    \"width\": %u,\n", extent.width);
+    printf("    \"height\": %u,\n", extent.height);
+    printf("    \"warmupFrames\": %u,\n", options.warmupFrames);
+    printf("    \"frames\": %u,\n", options.frames);
+    printf("    \"framesInFlight\": %u,\n", framesInFlight);
+    printf("    \"triangles\": %u,\n", mesh.indexCount / 3);
+    printf("    \"vertexFormat\": \"%s\",\n", options.packedVertices ? "packed" : "float");
+    printf("    \"uniformRing\": { \"frameBytes\": %llu, \"alignment\": %llu, \"peakFrameBytes\": %llu },\n",
+           (unsigned long long)uniformRing.frameCapacity, (unsigned long long)uniformRing.alignment,
+           (unsigned long long)uniformRing.peakFrameBytes);
+    printf("    \"vertexBytes\": %zu,\n", vertexDataSize);
+    printf("    \"geometryUpload\": { \"memory\": \"%s\", \"transferQueue\": %s, \"ms\": %.3f },\n",
+           options.hostVisibleGeometry ? "hostVisible" : "deviceLocal",
+           uploader.queue != vkState.renderQueue ? "true" : "false", uploadTime);
+    if (options.packedVertices){
+        QuantizationError quantizationError{ measureQuantizationError(mesh.vertices, mesh.packedVertices, mesh.vertexCount,
+                                                                      mesh.positionOffset, mesh.positionScale) };
+        printf("    \"quantizationError\": { \"maxPosition\": %g, \"maxPositionRelative\": %g, \"maxNormalDegrees\": %.4f, \"maxUV\": %g },\n",
+               quantizationError.maxPositionError, quantizationError.maxPositionErrorRelative,
+               quantizationError.maxNormalErrorDegrees, quantizationError.maxUVError);
+    }
+    printf("    \"meshLoad\": { \"source\": \"%s\", \"ms\": %.3f", mesh.fromCache ? "cache" : "obj", meshLoadTime);
+    if (options.compareMeshLoad){
+        printf(", \"objImportMs\": %.3f", objImportTime);
+    }
+    printf(" },\n");
+    if (!options.importJobCounts.empty()){
+        double serialMs{ serialImportTimings.triangulateMs + serialImportTimings.deduplicateMs };
+
+        printf("    \"importScaling\": { \"jobThreads\": %u, \"serialParseMs\": %.3f, \"serialMs\": %.3f, \"runs\": [\n",
+               jobThreadCount(), serialImportTimings.parseMs, serialMs);
+        for (uint32_t i{}; i < importTimings.size(); i++){
+            double importMs{ importTimings[i].triangulateMs + importTimings[i].deduplicateMs };
+
+            printf("        { \"jobs\": %u, \"parseMs\": %.3f, \"triangulateMs\": %.3f, \"deduplicateMs\": %.3f, "
+                   "\"speedup\": %.3f, \"identical\": %s }%s\n",
+                   options.importJobCounts[i], importTimings[i].parseMs, importTimings[i].triangulateMs,
+                   importTimings[i].deduplicateMs, importMs > 0.0 ? serialMs / importMs : 0.0,
+                   importsIdentical[i] ? "true" : "false", i + 1 < importTimings.size() ? "," : "");
+        }
+        printf("    ] },\n");
+    }
+    if (options.meshStats){
+        printf("    \"meshStats\": {\n");
+        printMeshStats("unoptimized", unoptimizedStats, false);
+        printMeshStats("optimized", optimizedStats, true);
+        printf("    },\n");
+    }
+    printf("    \"pipelines\": { \"cache\": \"%s\", \"cacheLoadMs\": %.3f, \"creationMs\": %.3f, \"variants\": %u, \"threads\": %u, \"variantsCreationMs\": %.3f },\n",
+           pipelineCacheLoaded ? "warm" : "cold", pipelineCacheLoadTime, pipelineCreationTime,
+           options.pipelineVariants, options.pipelineThreads, variantsCreationTime);
+
+    std::vector<MemoryHeapStats> heapStats{ getMemoryHeapStats(allocator) };
+    printf("    \"memoryHeaps\": [\n");
+    for (uint32_t i{}; i < heapStats.size(); i++){
+        printf("        { \"heap\": %u, \"reservedBytes\": %llu, \"usedBytes\": %llu, \"allocations\": %u, \"blocks\": %u, \"fragmentation\": %.4f }%s\n",
+               i, (unsigned long long)heapStats[i].reservedBytes, (unsigned long long)heapStats[i].usedBytes,
+               heapStats[i].allocationCount, heapStats[i].blockCount, heapStats[i].fragmentation,
+               i + 1 < heapStats.size() ? "," : "");
+    }
+    printf("    ],\n");
+    printf("    \"defragmentation\": { \"moves\": %u, \"movedBytes\": %llu, \"blocksBefore\": %u, \"blocksAfter\": %u, \"ms\": %.3f },\n",
+           bufferMover.moveCount, (unsigned long long)defragMovedBytes, blocksBeforeDefrag, blocksAfterDefrag, defragTime);
+    if (meshletCulling){
+        uint32_t meshTriangles{ mesh.indexCount / 3 };
+        double submittedTriangleAvg{ cullStatsFrames ? (double)submittedTriangles / cullStatsFrames : 0.0 };
+        double baselineGPUMs{ samplePercentile(phaseGPUFrameTimes[0], 0.5) };
+        double culledGPUMs{ samplePercentile(phaseGPUFrameTimes[1], 0.5) };
+        double baselineCPUMs{ samplePercentile(phaseCPUFrameTimes[0], 0.5) };
+        double culledCPUMs{ samplePercentile(phaseCPUFrameTimes[1], 0.5) };
+        double baselineRecordMs{ samplePercentile(phaseRecordTimes[0], 0.5) };
+        double culledRecordMs{ samplePercentile(phaseRecordTimes[1], 0.5) };
+
+        printf("    \"meshletCulling\": { \"mode\": \"%s\", \"meshlets\": %u, \"trianglesSubmitted\": %.1f, \"trianglesCulled\": %.1f, "
+               "\"baselineGPUMs\": %.4f, \"culledGPUMs\": %.4f, \"gpuDeltaMs\": %.4f, "
+               "\"baselineCPUMs\": %.4f, \"culledCPUMs\": %.4f, \"cpuDeltaMs\": %.4f, "
+               "\"baselineRecordMs\": %.4f, \"culledRecordMs\": %.4f, \"draw\": \"%s\", \"cullShader\": \"%s\", \"transientBuffers\": %u },\n",
+               options.meshletCull == MESHLET_CULL_GPU ? "gpu" : "cpu", mesh.meshletCount,
+               submittedTriangleAvg, meshTriangles - submittedTriangleAvg,
+               baselineGPUMs, culledGPUMs, culledGPUMs - baselineGPUMs,
+               baselineCPUMs, culledCPUMs, culledCPUMs - baselineCPUMs,
+               baselineRecordMs, culledRecordMs,
+               options.meshletCull == MESHLET_CULL_CPU ? "direct" : useDrawIndirectCount ? "indirectCount" : "indirect",
+               options.meshletCull == MESHLET_CULL_GPU ? meshletCullShaderFile(vkState.caps) : "none", transientBufferCount);
+    }
+    if (!scenes.empty()){
+        printf("    \"sceneScaling\": { \"meshes\": %zu, \"instancing\": %s, \"jobThreads\": %u, \"lodChain\": [",
+               meshRanges.size(), options.sceneInstancing ? "true" : "false", threadCount);
+        for (uint32_t i{}; i < meshRanges[0].lodCount; i++){
+            printf(" { \"triangles\": %u, \"error\": %g }%s", meshRanges[0].lods[i].indexCount / 3, meshRanges[0].lods[i].error,
+                   i + 1 < meshRanges[0].lodCount ? "," : " ");
+        }
+        printf("], \"phases\": [\n");
+        for (uint32_t i{}; i < phaseCount; i++){
+            const Scene& scene{ scenes[phases[i].sceneID] };
+
+            // Draws and triangles of the last frame's selection, which has settled by the end of the warmup
+            printf("        { \"instances\": %u, \"draws\": %u, \"triangles\": %llu, \"lod\": %s, \"recordThreads\": %u, "
+                   "\"cpuMs\": %.4f, \"cpuP95Ms\": %.4f, \"recordMs\": %.4f, \"gpuMs\": %.4f, \"gpuP95Ms\": %.4f }%s\n",
+                   scene.instanceCount, phaseDraws[i], (unsigned long long)phaseTriangles[i],
+                   phases[i].lods ? "true" : "false", phases[i].recordThreads,
+                   samplePercentile(phaseCPUFrameTimes[i], 0.5), samplePercentile(phaseCPUFrameTimes[i], 0.95),
+                   samplePercentile(phaseRecordTimes[i], 0.5),
+                   samplePercentile(phaseGPUFrameTimes[i], 0.5), samplePercentile(phaseGPUFrameTimes[i], 0.95),
+                   i + 1 < phaseCount ? "," : "");
+        }
+        printf("    ] },\n");
+    }
+    if (options.vertexInputs.size() > 1 || options.vertexInputs[0] != VERTEX_INPUT_PULL){
+        printf("    \"vertexInput\": { \"pipelineStatistics\": %s, \"phases\": [\n", vkState.caps.pipelineStatistics ? "true" : "false");
+        for (uint32_t i{}; i < phaseCount; i++){
+            // Without statistics for a phase the counts are reported as -1
+            double inputVertices{ phaseVertexStatsFrames[i] ? (double)phaseInputVertices[i] / phaseVertexStatsFrames[i] : -1.0 };
+            double vertexInvocations{ phaseVertexStatsFrames[i] ? (double)phaseVertexInvocations[i] / phaseVertexStatsFrames[i] : -1.0 };
+
+            printf("        { \"mode\": \"%s\", \"inputVertices\": %.0f, \"vsInvocations\": %.0f, \"vsInvocationsPerVertex\": %.4f, "
+                   "\"cpuMs\": %.4f, \"gpuMs\": %.4f, \"gpuP95Ms\": %.4f }%s\n",
+                   kVertexInputNames[phases[i].vertexInput], inputVertices, vertexInvocations,
+                   inputVertices > 0.0 ? vertexInvocations / inputVertices : -1.0,
+                   samplePercentile(phaseCPUFrameTimes[i], 0.5),
+                   samplePercentile(phaseGPUFrameTimes[i], 0.5), samplePercentile(phaseGPUFrameTimes[i], 0.95),
+                   i + 1 < phaseCount ? "," : "");
+        }
+        printf("    ] },\n");
+    }
+    if (options.depthModes.size() > 1 || options.depthModes[0] != DEPTH_TEST){
+        printf("    \"depth\": { \"format\": \"%s\", \"sceneLayers\": %u, \"phases\": [\n",
+               depthFormat == VK_FORMAT_D32_SFLOAT ? "d32" : "x8d24", options.sceneLayers);
+        for (uint32_t i{}; i < phaseCount; i++){
+            // prepassMs is the depth-only pass alone, shadingMs the rest of the frame
+            double gpuMs{ samplePercentile(phaseGPUFrameTimes[i], 0.5) };
+            double prepassMs{ samplePercentile(phasePrepassTimes[i], 0.5) };
+
+            printf("        { \"mode\": \"%s\", \"vertexInput\": \"%s\", \"instances\": %u, \"gpuMs\": %.4f, \"gpuP95Ms\": %.4f, "
+                   "\"prepassMs\": %.4f, \"shadingMs\": %.4f }%s\n",
+                   kDepthModeNames[phases[i].depth], kVertexInputNames[phases[i].vertexInput],
+                   phases[i].sceneID >= 0 ? scenes[phases[i].sceneID].instanceCount : 1,
+                   gpuMs, samplePercentile(phaseGPUFrameTimes[i], 0.95), prepassMs, gpuMs - prepassMs,
+                   i + 1 < phaseCount ? "," : "");
+        }
+        printf("    ] },\n");
+    }
+    if (options.shaderPermutations.size() > 1 || options.shaderPermutations[0] != SHADER_BRANCHY){
+        printf("    \"shaderPermutations\": { \"pipelines\": [");
+        for (DepthMode depthMode : options.depthModes){
+            printf(" { \"depth\": \"%s\", \"permutations\": %zu }%s", kDepthModeNames[depthMode], meshPipelines[depthMode].pipelines.size(),
+                   depthMode == options.depthModes.back() ? " " : ",");
+        }
+        printf("], \"phases\": [\n");
+        for (uint32_t i{}; i < phaseCount; i++){
+            // Specialized phases are compared against the branchy phase that renders the same frames
+            int32_t branchyPhase{ -1 };
+            for (uint32_t j{}; j < phaseCount && phases[i].permutation == SHADER_SPECIALIZED; j++){
+                const BenchmarkPhase& a{ phases[i] };
+                const BenchmarkPhase& b{ phases[j] };
+
+                if (b.permutation == SHADER_BRANCHY && a.cullMeshlets == b.cullMeshlets && a.sceneID == b.sceneID &&
+                    a.recordThreads == b.recordThreads && a.lods == b.lods && a.vertexInput == b.vertexInput &&
+                    a.depth == b.depth && a.occlusionCull == b.occlusionCull){
+                    branchyPhase = (int32_t)j;
+                }
+            }
+
+            double gpuMs{ samplePercentile(phaseGPUFrameTimes[i], 0.5) };
+            double branchyGPUMs{ branchyPhase >= 0 ? samplePercentile(phaseGPUFrameTimes[branchyPhase], 0.5) : gpuMs };
+
+            printf("        { \"mode\": \"%s\", \"vertexInput\": \"%s\", \"depth\": \"%s\", \"instances\": %u, \"permutationKey\": \"%016llx\", "
+                   "\"cpuMs\": %.4f, \"gpuMs\": %.4f, \"gpuP95Ms\": %.4f, \"branchyGPUMs\": %.4f, \"gpuDeltaMs\": %.4f }%s\n",
+                   kShaderPermutationNames[phases[i].permutation], kVertexInputNames[phases[i].vertexInput], kDepthModeNames[phases[i].depth],
+                   phases[i].sceneID >= 0 ? scenes[phases[i].sceneID].instanceCount : 1,
+                   (unsigned long long)shaderPermutationKey(meshPermutation(phases[i].permutation, phases[i].vertexInput)),
+                   samplePercentile(phaseCPUFrameTimes[i], 0.5), gpuMs, samplePercentile(phaseGPUFrameTimes[i], 0.95),
+                   branchyGPUMs, gpuMs - branchyGPUMs,
+                   i + 1 < phaseCount ? "," : "");
+        }
+        printf("    ] },\n");
+    }
+    if (options.occlusionCull){
+        printf("    \"occlusionCulling\": { \"pyramid\": [%u, %u], \"pyramidLevels\": %u, \"phases\": [\n",
+               occlusionCuller.pyramidExtent.width, occlusionCuller.pyramidExtent.height, occlusionCuller.pyramidLevelCount);
+        for (uint32_t i{}; i < phaseCount; i++){
+            // Phases without culling draw every object and are listed for their gpuMs; counts are per frame averages
+            uint32_t frames{ std::max(phaseOcclusionFrames[i], 1u) };
+
+            printf("        { \"occlusionCull\": %s, \"vertexInput\": \"%s\", \"depth\": \"%s\", \"objects\": %u, "
+                   "\"earlyDraws\": %.1f, \"lateDraws\": %.1f, \"frustumCulled\": %.1f, \"occluded\": %.1f, \"triangles\": %.0f, "
+                   "\"cullMs\": %.4f, \"pyramidMs\": %.4f, \"gpuMs\": %.4f, \"gpuP95Ms\": %.4f }%s\n",
+                   phases[i].occlusionCull ? "true" : "false", kVertexInputNames[phases[i].vertexInput], kDepthModeNames[phases[i].depth],
+                   phases[i].sceneID >= 0 ? scenes[phases[i].sceneID].instanceCount : 1,
+                   (double)phaseEarlyDraws[i] / frames, (double)phaseLateDraws[i] / frames,
+                   (double)phaseFrustumCulled[i] / frames, (double)phaseOccluded[i] / frames,
+                   phases[i].occlusionCull ? (double)phaseOcclusionTriangles[i] / frames : (double)phaseTriangles[i],
+                   samplePercentile(phaseOcclusionCullTimes[i], 0.5), samplePercentile(phaseDepthPyramidTimes[i], 0.5),
+                   samplePercentile(phaseGPUFrameTimes[i], 0.5), samplePercentile(phaseGPUFrameTimes[i], 0.95),
+                   i + 1 < phaseCount ? "," : "");
+        }
+        printf("    ] },\n");
+    }
+    printf("    \"timestampCalibration\": \"%s\",\n", gpuProfiler.calibratedTimestamps ? "calibratedTimestamps" : "submit");
+    printf("    \"gpuZonesMs\": {\n");
+    for (uint32_t i{}; i < gpuZoneTimes.size(); i++){
+        printFrameTimeStats(gpuZoneTimes[i].first, gpuZoneTimes[i].second, i + 1 == gpuZoneTimes.size(), "        ");
+    }
+    printf("    },\n");
+    printFrameTimeStats("cpuFrameTimeMs", cpuFrameTimes, false);
+    printFrameTimeStats("gpuFrameTimeMs", gpuFrameTimes, true);
+    printf("}\n");
+
+    if (options.gpuTraceFile){
+        std::vector<TraceEvent> traceEvents{ gpuProfiler.traceEvents };
+        appendCPUTraceEvents(traceEvents);
+
+        writeChromeTrace(options.gpuTraceFile, traceEvents);
+    }
+
+    {
+        savePipelineCache(vkState.device, pipelineCache, options.pipelineCacheFile);
+        vkDestroyPipelineCache(vkState.device, pipelineCache, nullptr);
+
+        for (GraphicsPipeline& variantPipeline : variantPipelines){
+            destroyPipeline(vkState.device, variantPipeline);
+        }
+
+        for (uint32_t i{}; i < DEPTH_MODE_COUNT; i++){
+            destroyPipelines(vkState.device, meshPipelines[i]);
+            if (attributesPipelines[i].pipeline){
+                destroyPipeline(vkState.device, attributesPipelines[i]);
+            }
+        }
+
+        if (depthPrepass){
+            destroyPipeline(vkState.device, depthPrepassPipeline);
+        }
+
+        if (options.occlusionCull){
+            destroyOcclusionCuller(vkState.device, occlusionCuller);
+        }
+
+        for (VkQueryPool queryPool : vertexStatsQueryPools){
+            destroyQueryPool(vkState.device, queryPool);
+        }
+        vkDestroyPipelineLayout(vkState.device, pipelineLayout, nullptr);
+
+        if (options.meshletCull == MESHLET_CULL_GPU){
+            destroyMeshletCuller(vkState.device, meshletCuller);
+
+            for (uint32_t i{}; i < framesInFlight; i++){
+                destroyLinearAllocator(drawCommandMemory[i]);
+                destroyLinearAllocator(drawCountMemory[i]);
+            }
+        }
+
+        vkDestroyDescriptorPool(vkState.device, descrPool, nullptr);
+
+        vkDestroyDescriptorSetLayout(vkState.device, descrLayout, nullptr);
+
+        destroyUniformRing(vkState.device, uniformRing);
+
+        for (SecondaryCommandPool& secondaryPool : secondaryPools){
+            destroySecondaryCommandPool(vkState.device, secondaryPool);
+        }
+
+        destroyBuffer(vkState.device, instanceBuffer);
+        destroyBuffer(vkState.device, meshIndices);
+        destroyBuffer(vkState.device, meshVertices);
+
+        if (depthPrepass){
+            destroyBuffer(vkState.device, meshPositions);
+        }
+
+        for (MappedMesh& sceneMesh : sceneMeshes){
+            unloadMesh(sceneMesh);
+        }
+
+        unloadMesh(mesh);
+
+        destroyStagingUploader(vkState.device, uploader);
+
+        for (int i{}; i < framesInFlight; i++){
+            vkDestroyFramebuffer(vkState.device, framebuffers[i], nullptr);
+            destroyImage(vkState.device, colorTargets[i]);
+            destroyImage(vkState.device, depthTargets[i]);
+        }
+
+        vkDestroyRenderPass(vkState.device, renderPass, nullptr);
+        if (lateRenderPass){
+            vkDestroyRenderPass(vkState.device, lateRenderPass, nullptr);
+        }
+
+        destroyGPUProfiler(gpuProfiler);
+
+        for (int i{}; i < framesInFlight; i++){
+            vkDestroyFence(vkState.device, fences[i], nullptr);
+        }
+
+        vkDestroyCommandPool(vkState.device, cmdPool, nullptr);
+
+        destroyMemoryAllocator(allocator);
+        destroyVulkanState(vkState);
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
 #include <vector>
+#include <algorithm>
 
 #include "vulkan/vk_helpers.h"
 #include "vulkan/vk_init.cpp"
@@ -9,234 +12,544 @@
 #include "vulkan/vk_descriptor_set.cpp"
 #include "vulkan/vk_cmd_buffers.cpp"
 #include "vulkan/vk_memory.cpp"
+#include "vulkan/vk_staging.cpp"
 #include "vulkan/vk_queries.cpp"
 
+#include "profiler.cpp"
+#include "jobs.cpp"
 #include "mesh.cpp"
+#include "scene.cpp"
+#include "meshlet_cull.cpp"
+#include "streaming.cpp"
 
 #include <GLFW/glfw3.h>
 
-struct UniformData{
-    float Time;
+struct AppOptions{
+    uint32_t framesInFlight{ 2 };
+    VkPresentModeKHR presentMode{ VK_PRESENT_MODE_FIFO_KHR };
+    const char* gpuTraceFile{ nullptr };
+    const char* cpuStatsFile{ "-" };
+    double cpuStatsInterval{ 5.0 };
+    MeshletCullMode meshletCull{ MESHLET_CULL_NONE };
+    uint32_t sceneInstances{ 0 };
+    const char* device{ nullptr };          // index or part of the name, overrides RB_DEVICE
+    const char* streamPath{ nullptr };      // a mesh or a directory of meshes, loaded in the background
+    VkDeviceSize streamBudget{ kStreamingFrameBudget };
 };
 
-int main() {
+AppOptions parseAppOptions(int argc, char** argv){
+    AppOptions options{};
+
+    for (int i{ 1 }; i < argc; i++){
+        const char* arg{ argv[i] };
+        const char* value{ i + 1 < argc ? argv[i + 1] : nullptr };
+
+        if (strcmp(arg, "--frames-in-flight") == 0 && value){
+            options.framesInFlight = std::min(std::max(atoi(value), 1), 3);
+        } else if (strcmp(arg, "--present-mode") == 0 && value){
+            if (strcmp(value, "fifo") == 0){
+                options.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+            } else if (strcmp(value, "mailbox") == 0){
+                options.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+            } else if (strcmp(value, "immediate") == 0){
+                options.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            } else {
+                fprintf(stderr, "Unknown present mode: %s\n", value);
+                exit(1);
+            }
+        } else if (strcmp(arg, "--device") == 0 && value){
+            options.device = value;
+        } else if (strcmp(arg, "--gpu-trace") == 0 && value){
+            options.gpuTraceFile = value;
+        } else if (strcmp(arg, "--cpu-stats") == 0 && value){
+            options.cpuStatsFile = value;
+        } else if (strcmp(arg, "--cpu-stats-interval") == 0 && value){
+            options.cpuStatsInterval = atof(value);
+        } else if (strcmp(arg, "--meshlet-cull") == 0 && value){
+            if (strcmp(value, "none") == 0){
+                options.meshletCull = MESHLET_CULL_NONE;
+            } else if (strcmp(value, "cpu") == 0){
+                options.meshletCull = MESHLET_CULL_CPU;
+            } else if (strcmp(value, "gpu") == 0){
+                options.meshletCull = MESHLET_CULL_GPU;
+            } else {
+                fprintf(stderr, "Unknown meshlet cull mode: %s\n", value);
+                exit(1);
+            }
+        } else if (strcmp(arg, "--scene") == 0 && value){
+            options.sceneInstances = (uint32_t)atoi(value);
+        } else if (strcmp(arg, "--stream") == 0 && value){
+            options.streamPath = value;
+        } else if (strcmp(arg, "--stream-budget") == 0 && value){
+            options.streamBudget = (VkDeviceSize)(std::max(atof(value), 0.0625) * 1024 * 1024);
+        } else {
+            fprintf(stderr, "Unknown or incomplete argument: %s\n", arg);
+            exit(1);
+        }
+
+        i++;
+    }
+
+    if (options.sceneInstances > 0 && options.meshletCull != MESHLET_CULL_NONE){
+        fprintf(stderr, "--meshlet-cull is ignored in scene mode\n");
+        options.meshletCull = MESHLET_CULL_NONE;
+    }
+
+    // Streamed meshes are drawn once each in a grid, and culling and scenes are built from the mesh at startup
+    if (options.streamPath && (options.meshletCull != MESHLET_CULL_NONE || options.sceneInstances > 0)){
+        fprintf(stderr, "--stream ignores --meshlet-cull and --scene\n");
+        options.meshletCull = MESHLET_CULL_NONE;
+        options.sceneInstances = 0;
+    }
+
+    return options;
+}
+
+// Everything the CPU writes for a frame lives here, so the ring size is independent of the swapchain image count
+struct FrameContext{
+    VkCommandBuffer cmdBuffer;
+    VkFence fence;
+    VkSemaphore imageAcquireSemaphore;
+    double inputTimeStamp;
+    bool inFlight;
+};
+
+// Everything sized or counted by the swapchain images, rebuilt with the swapchain on resize
+struct SwapchainTargets{
+    std::vector<Image> depthTargets;
+    std::vector<VkFramebuffer> framebuffers;
+    std::vector<VkSemaphore> imageReleaseSemaphores;
+};
+
+// A replaced swapchain stays alive until every frame that could still reference it has completed
+struct RetiredSwapchain{
+    VulkanSwapchain swapchain;
+    SwapchainTargets targets;
+    int destroyFrameID;
+};
+
+int main(int argc, char** argv) {
+    AppOptions options{ parseAppOptions(argc, argv) };
+
     int glfwInitResult{ glfwInit() };
     assert(glfwInitResult == GLFW_TRUE);
 
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
     GLFWwindow* window = glfwCreateWindow(1024, 768, "Render Box", nullptr, nullptr);
 
-    VulkanState vkState{ initializeVulkanState() };
-    VulkanSwapchain vkSwapchain{ createSwapchain(window, vkState) };
+    bool swapchainDirty{};
+    glfwSetWindowUserPointer(window, &swapchainDirty);
+    glfwSetFramebufferSizeCallback(window, [](GLFWwindow* window, int width, int height){
+        *(bool*)glfwGetWindowUserPointer(window) = true;
+    });
+
+    VulkanState vkState{ initializeVulkanState(options.device) };
+
+    printf("Device: %s (%s)\n", vkState.caps.deviceName, physicalDeviceTypeName(vkState.caps.deviceType));
+
+    if (!vkState.caps.descriptorIndexing){
+        fprintf(stderr, "The device doesn't support the descriptor indexing features of the descriptor heap\n");
+        exit(1);
+    }
+
+    MemoryAllocator allocator{ createMemoryAllocator(vkState) };
+    vkState.allocator = &allocator;
+
+    VulkanSwapchain vkSwapchain{ createSwapchain(window, vkState, options.presentMode) };
 
     VkPhysicalDeviceProperties physDevProps{};
     vkGetPhysicalDeviceProperties(vkState.physicalDevice, &physDevProps);
     assert(physDevProps.limits.timestampComputeAndGraphics);
 
-    std::vector<VkCommandBuffer> cmdBuffers(vkSwapchain.images.size());
+    const uint32_t framesInFlight{ options.framesInFlight };
+    std::vector<FrameContext> frames(framesInFlight);
+
+    std::vector<VkCommandBuffer> cmdBuffers(framesInFlight);
     VkCommandPool cmdPool{ allocateCommandBuffers(vkState, cmdBuffers.data(), cmdBuffers.size()) };
 
     VkSemaphoreCreateInfo semCreateInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
-    VkSemaphore imageAcquireSemaphore{};
-    VK_CHECK(vkCreateSemaphore(vkState.device, &semCreateInfo, nullptr, &imageAcquireSemaphore));
-
-    VkSemaphore imageReleaseSemaphore{};
-    VK_CHECK(vkCreateSemaphore(vkState.device, &semCreateInfo, nullptr, &imageReleaseSemaphore));
 
     VkFenceCreateInfo fenceCreateInfo{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
     fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-    std::vector<VkFence> fences(vkSwapchain.images.size());
-    for (int i{}; i < vkSwapchain.images.size(); i++){
-        VK_CHECK(vkCreateFence(vkState.device, &fenceCreateInfo, nullptr, &fences[i]));
+    for (uint32_t i{}; i < framesInFlight; i++){
+        frames[i].cmdBuffer = cmdBuffers[i];
+        VK_CHECK(vkCreateFence(vkState.device, &fenceCreateInfo, nullptr, &frames[i].fence));
+        VK_CHECK(vkCreateSemaphore(vkState.device, &semCreateInfo, nullptr, &frames[i].imageAcquireSemaphore));
     }
 
-    VkQueryPool queryPool{ createTimestampQueryPool(vkState.device, 2 * vkSwapchain.images.size()) };
+    GPUProfiler gpuProfiler{ createGPUProfiler(vkState, framesInFlight, 16) };
+    gpuProfiler.captureTrace = options.gpuTraceFile != nullptr;
 
-    VkRenderPass renderPass{ createRenderPass(vkState.device, vkSwapchain.surfaceFormat.format) };
+    const VkFormat depthFormat{ chooseDepthFormat(vkState.physicalDevice) };
+    VkRenderPass renderPass{ createRenderPass(vkState.device, vkSwapchain.surfaceFormat.format, depthFormat) };
 
-    std::vector<VkFramebuffer> framebuffers(vkSwapchain.images.size());
-    for (int i{}; i < vkSwapchain.images.size(); i++){
-        framebuffers[i] = createFramebuffer(vkState.device, renderPass, vkSwapchain.imageViews[i],
-                                            vkSwapchain.surfaceFormat.format, vkSwapchain.extent);
-    }
+    auto createSwapchainTargets = [&](){
+        SwapchainTargets targets{};
+        targets.depthTargets.resize(vkSwapchain.images.size());
+        targets.framebuffers.resize(vkSwapchain.images.size());
+        targets.imageReleaseSemaphores.resize(vkSwapchain.images.size());
 
-    Mesh mesh{ loadObjMesh("../../data/roadBike.obj") };
+        for (int i{}; i < vkSwapchain.images.size(); i++){
+            targets.depthTargets[i] = createImage(vkState, vkSwapchain.extent, depthFormat,
+                                                  VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                                                  VK_IMAGE_ASPECT_DEPTH_BIT);
+            targets.framebuffers[i] = createFramebuffer(vkState.device, renderPass, vkSwapchain.imageViews[i], targets.depthTargets[i].imageView,
+                                                        vkSwapchain.surfaceFormat.format, vkSwapchain.extent);
+
+            // Presentation holds on to the release semaphore until the image is reacquired, so there is one per image
+            VK_CHECK(vkCreateSemaphore(vkState.device, &semCreateInfo, nullptr, &targets.imageReleaseSemaphores[i]));
+        }
 
-    Buffer meshVertices{ createBuffer(vkState, mesh.vertices.size() * sizeof(Vertex),
-                                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) };
-
-    Buffer meshIndices{ createBuffer(vkState, mesh.indices.size() * sizeof(uint32_t),
-                                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) };
-
-    memcpy(meshVertices.data, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
-    memcpy(meshIndices.data, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
-
-    std::vector<Buffer> meshUBOs(vkSwapchain.images.size());
-    for (int i{}; i < vkSwapchain.images.size(); i++){
-        meshUBOs[i] = createBuffer(vkState, sizeof(UniformData),
-                                       VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    }
+        return targets;
+    };
 
-    VkDescriptorSetLayout descrLayout{};
-    VkDescriptorPool descrPool{};
-    std::vector<VkDescriptorSet> descrSets(vkSwapchain.images.size());
-    {
-        VkDescriptorPoolSize descrPoolSizes[2]{};
-        descrPoolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descrPoolSizes[0].descriptorCount = (uint32_t)vkSwapchain.images.size();
+    auto destroySwapchainTargets = [&](SwapchainTargets& targets){
+        for (int i{}; i < targets.framebuffers.size(); i++){
+            vkDestroyFramebuffer(vkState.device, targets.framebuffers[i], nullptr);
+            destroyImage(vkState.device, targets.depthTargets[i]);
+            vkDestroySemaphore(vkState.device, targets.imageReleaseSemaphores[i], nullptr);
+        }
 
-        descrPoolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descrPoolSizes[1].descriptorCount = (uint32_t)vkSwapchain.images.size() * 2;
+        targets = SwapchainTargets{};
+    };
 
-        VkDescriptorPoolCreateInfo descrPoolCreateInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
-        descrPoolCreateInfo.maxSets = vkSwapchain.images.size() * 3;
-        descrPoolCreateInfo.poolSizeCount = 2;
-        descrPoolCreateInfo.pPoolSizes = descrPoolSizes;
+    SwapchainTargets swapchainTargets{ createSwapchainTargets() };
 
-        VK_CHECK(vkCreateDescriptorPool(vkState.device, &descrPoolCreateInfo, nullptr, &descrPool));
+    const bool meshletCulling{ options.meshletCull != MESHLET_CULL_NONE };
+    const bool streaming{ options.streamPath != nullptr };
 
-        VkDescriptorSetLayoutBinding bindings[3]{};
-        bindings[0].binding = 0;
-        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        bindings[0].descriptorCount = 1;
-        bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    StagingUploader uploader{ createStagingUploader(vkState, 64 * 1024 * 1024, true) };
 
-        bindings[1].binding = 1;
-        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        bindings[1].descriptorCount = 1;
-        bindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    // Streaming starts right away and the main loop runs while the meshes load, instead of blocking startup
+    MeshStreamer streamer{};
+    if (streaming){
+        std::vector<std::string> streamFiles{ listMeshFiles(options.streamPath) };
+        if (streamFiles.empty()){
+            streamFiles.push_back(options.streamPath);
+        }
 
-        bindings[2].binding = 2;
-        bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        bindings[2].descriptorCount = 1;
-        bindings[2].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        startMeshStreamer(streamer, MESH_IMPORT_OPTIMIZE, options.streamBudget);
+        for (const std::string& file : streamFiles){
+            requestMesh(streamer, file.c_str());
+        }
+    }
 
-        VkDescriptorSetLayoutCreateInfo descrSetLayoutInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
-        descrSetLayoutInfo.bindingCount = 3;
-        descrSetLayoutInfo.pBindings = bindings;
+    MappedMesh mesh{};
+    Buffer meshVertices{};
+    Buffer meshIndices{};
+    if (!streaming){
+        mesh = loadMesh("../../data/roadBike.obj", MESH_IMPORT_OPTIMIZE | (meshletCulling ? MESH_IMPORT_MESHLETS : 0u));
+        assert(mesh.indexCount > 0);
 
-        VK_CHECK(vkCreateDescriptorSetLayout(vkState.device, &descrSetLayoutInfo, nullptr, &descrLayout));
+        meshVertices = createUploadBuffer(vkState, uploader, mesh.vertexCount * sizeof(Vertex),
+                                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-        std::vector<VkDescriptorSetLayout> descrSetLayouts(vkSwapchain.images.size(), descrLayout);
+        meshIndices = createUploadBuffer(vkState, uploader, mesh.indexCount * sizeof(uint32_t),
+                                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-        VkDescriptorSetAllocateInfo descrSetAllocInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
-        descrSetAllocInfo.descriptorPool = descrPool;
-        descrSetAllocInfo.descriptorSetCount = vkSwapchain.images.size();
-        descrSetAllocInfo.pSetLayouts = descrSetLayouts.data();
+        uploadBuffer(vkState.device, uploader, meshVertices, 0, mesh.vertices, mesh.vertexCount * sizeof(Vertex));
+        uploadBuffer(vkState.device, uploader, meshIndices, 0, mesh.indices, mesh.indexCount * sizeof(uint32_t));
+    }
 
-        VK_CHECK(vkAllocateDescriptorSets(vkState.device, &descrSetAllocInfo, descrSets.data()));
+    waitForUploads(vkState.device, uploader);
 
-        std::vector<VkDescriptorBufferInfo> bufferInfos(vkSwapchain.images.size() * 3);
-        for (int i{}; i < vkSwapchain.images.size() * 3; i++)
-        {
-            bufferInfos[i].buffer = meshVertices.buffer;
-            bufferInfos[i].offset = 0;
-            bufferInfos[i].range = sizeof(Vertex);
+    std::vector<SceneMesh> meshRanges{ createSceneMesh(mesh, 0) };
+    std::vector<Instance> instances{ kIdentityInstance };
 
-            i++;
+    Scene scene{};
+    if (options.sceneInstances > 0){
+        scene = buildScene(instances, options.sceneInstances, meshRanges);
+    }
 
-            bufferInfos[i].buffer = meshIndices.buffer;
-            bufferInfos[i].offset = 0;
-            bufferInfos[i].range = sizeof(uint32_t);
+    // Streamed mesh i is drawn with instance 1 + i, a grid cell written once the mesh is resident and its size known.
+    // Until then no frame reads the instance, so it can be written in place while frames are in flight.
+    const uint32_t streamGridColumns{ (uint32_t)ceilf(sqrtf((float)streamer.meshes.size())) };
+    instances.resize(instances.size() + streamer.meshes.size());
 
-            i++;
+    Buffer instanceBuffer{};
+    if (streaming){
+        instanceBuffer = createBuffer(vkState, instances.size() * sizeof(Instance),
+                                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-            bufferInfos[i].buffer = meshUBOs[i / 3].buffer;
-            bufferInfos[i].offset = 0;
-            bufferInfos[i].range = sizeof(UniformData);
-        }
+        memcpy(instanceBuffer.data, instances.data(), instances.size() * sizeof(Instance));
+    } else {
+        instanceBuffer = createUploadBuffer(vkState, uploader, instances.size() * sizeof(Instance),
+                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-        std::vector<VkWriteDescriptorSet> descrWrites(vkSwapchain.images.size() * 3);
-        for (int i{}; i < vkSwapchain.images.size() * 3; i++)
-        {
-            descrWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descrWrites[i].dstSet = descrSets[i / 3];
-            descrWrites[i].dstBinding = 0;
-            descrWrites[i].dstArrayElement = 0;
-            descrWrites[i].descriptorCount = 1;
-            descrWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-            descrWrites[i].pBufferInfo = &bufferInfos[i];
-
-            i++;
-
-            descrWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descrWrites[i].dstSet = descrSets[i / 3];
-            descrWrites[i].dstBinding = 1;
-            descrWrites[i].dstArrayElement = 0;
-            descrWrites[i].descriptorCount = 1;
-            descrWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-            descrWrites[i].pBufferInfo = &bufferInfos[i];
-
-            i++;
-
-            descrWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descrWrites[i].dstSet = descrSets[i / 3];
-            descrWrites[i].dstBinding = 2;
-            descrWrites[i].dstArrayElement = 0;
-            descrWrites[i].descriptorCount = 1;
-            descrWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descrWrites[i].pBufferInfo = &bufferInfos[i];
-        }
+        uploadBuffer(vkState.device, uploader, instanceBuffer, 0, instances.data(), instances.size() * sizeof(Instance));
+        waitForUploads(vkState.device, uploader);
+    }
+
+    // Per-frame uniforms go into the frame context's region of the ring; draws push the index of their entry
+    UniformRing uniformRing{ createUniformRing(vkState, sizeof(UniformData), framesInFlight, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) };
 
-        vkUpdateDescriptorSets(vkState.device, descrWrites.size(), descrWrites.data(), 0, nullptr);
+    // A single set holds every buffer the meshes read; draws pick theirs by index through push constants
+    DescriptorHeap descrHeap{ createDescriptorHeap(vkState, kDescriptorHeapStorageBuffers, kDescriptorHeapSampledImages, framesInFlight) };
+
+    BindlessConstants drawConstants{};
+    drawConstants.instanceBufferID = registerStorageBuffer(vkState.device, descrHeap, instanceBuffer);
+    drawConstants.uniformBufferID = registerStorageBuffer(vkState.device, descrHeap, uniformRing.buffer);
+    drawConstants.draw = meshRanges[0].drawConstants;
+
+    if (!streaming){
+        drawConstants.vertexBufferID = registerStorageBuffer(vkState.device, descrHeap, meshVertices);
+        drawConstants.indexBufferID = registerStorageBuffer(vkState.device, descrHeap, meshIndices);
     }
 
+    // Set once a streamed mesh is resident; the others are skipped
+    std::vector<BindlessConstants> streamedDrawConstants(streamer.meshes.size(), drawConstants);
+    std::vector<bool> streamedDrawable(streamer.meshes.size());
+
     VkPipelineLayout pipelineLayout{};
     {
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        pushConstantRange.size = sizeof(BindlessConstants);
+
         VkPipelineLayoutCreateInfo pipelineLayoutInfo{ VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
         pipelineLayoutInfo.setLayoutCount = 1;
-        pipelineLayoutInfo.pSetLayouts = &descrLayout;
+        pipelineLayoutInfo.pSetLayouts = &descrHeap.descrLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
         VK_CHECK(vkCreatePipelineLayout(vkState.device, &pipelineLayoutInfo, nullptr, &pipelineLayout));
     }
 
-    VkViewport viewport{ 0.0f, 0.0f, (float)vkSwapchain.extent.width, (float)vkSwapchain.extent.height, 0.0f, 1.0f };
-    GraphicsPipeline pipeline{ createGraphicsPipeline(vkState.device, renderPass, viewport, pipelineLayout) };
+    double pipelineBeginTimeStamp{ glfwGetTime() };
+
+    bool pipelineCacheLoaded{};
+    VkPipelineCache pipelineCache{ loadPipelineCache(vkState, "pipeline_cache.bin", &pipelineCacheLoaded) };
+
+    GraphicsPipelineDesc pipelineDesc{};
+    pipelineDesc.vertexShaderFile = "shaders/mesh_bindless.vs.spv";
+    pipelineDesc.fragmentShaderFile = "shaders/mesh.fs.spv";
+    pipelineDesc.renderPass = renderPass;
+    pipelineDesc.pipelineLayout = pipelineLayout;
+    pipelineDesc.dynamicViewport = true;
+    pipelineDesc.cullMode = VK_CULL_MODE_BACK_BIT;
+    pipelineDesc.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    pipelineDesc.depthTest = VK_TRUE;
+    pipelineDesc.depthWrite = VK_TRUE;
+    pipelineDesc.depthCompareOp = VK_COMPARE_OP_LESS;
+    // Every draw here pulls float vertices, so the shader's vertex format and input branches are compiled out
+    pipelineDesc.vertexPermutation = meshShaderPermutation(VERTEX_FORMAT_FLOAT, VERTEX_INPUT_PULL);
+
+    GraphicsPipeline pipeline{ createGraphicsPipeline(vkState.device, pipelineCache, pipelineDesc) };
+
+    printf("Pipeline creation (%s cache): %.2f ms\n", pipelineCacheLoaded ? "warm" : "cold",
+           (glfwGetTime() - pipelineBeginTimeStamp) * 1000.0);
+
+    MeshletCuller meshletCuller{};
+    MemoryPool drawCountPool{};
+    if (options.meshletCull == MESHLET_CULL_GPU){
+        meshletCuller = createMeshletCuller(vkState, pipelineCache, uploader, mesh, framesInFlight);
+
+        // The counts are tiny and all the same size, so they share pooled slots instead of buddy blocks
+        drawCountPool = createMemoryPool(allocator, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                         2 * sizeof(uint32_t), framesInFlight);
+        for (uint32_t i{}; i < framesInFlight; i++){
+            createMeshletCullBuffers(vkState, meshletCuller, i, &drawCountPool);
+        }
+    }
 
-    double avgCPUFrameTime{};
-    double avgGPUFrameTime{};
+    float animationTime{};
     int frameID{};
 
+    std::vector<double> latencySamples;
+
+    std::vector<RetiredSwapchain> retiredSwapchains;
+    std::vector<double> recreateSamples;
+
+    // glfwGetTime counts from glfwInit, so the first present's time stamp is the time to first frame
+    double firstFrameMs{};
+    double streamingCompleteMs{};
+    double previousFrameTimeStamp{};
+    std::vector<double> streamingFrameTimes;
+    std::vector<double> steadyFrameTimes;
+
+    uint64_t submittedTriangles{};
+    uint32_t cullStatsFrames{};
+
+    // Input-to-GPU-complete latency is sampled when a fence is first seen signaled, without ever blocking on it
+    auto retireCompletedFrames = [&](){
+        for (FrameContext& frame : frames){
+            if (frame.inFlight && vkGetFenceStatus(vkState.device, frame.fence) == VK_SUCCESS){
+                latencySamples.push_back((glfwGetTime() - frame.inputTimeStamp) * 1000.0);
+                frame.inFlight = false;
+            }
+        }
+    };
+
+    configureCPUProfiler(options.cpuStatsFile, options.cpuStatsInterval, "Frame");
+    setCPUTraceCapture(options.gpuTraceFile != nullptr);
+
+    double loopBeginTimeStamp{ glfwGetTime() };
+
     // Main Loop
     while (!glfwWindowShouldClose(window)){
+        CPU_ZONE("Frame");
+
+        glfwPollEvents();
+
+        // A minimized window has no surface area to build a swapchain for
+        int framebufferWidth{}, framebufferHeight{};
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        if (framebufferWidth == 0 || framebufferHeight == 0){
+            glfwWaitEvents();
+            continue;
+        }
+
+        // Frames in flight keep rendering to the old images; they are destroyed once those frames have completed,
+        // so nothing waits for the device here
+        if (swapchainDirty){
+            CPU_ZONE("SwapchainRecreate");
+
+            double recreateBeginTimeStamp{ glfwGetTime() };
+
+            RetiredSwapchain retired{};
+            retired.swapchain = recreateSwapchain(window, vkState, vkSwapchain);
+            retired.targets = swapchainTargets;
+            retired.destroyFrameID = frameID + framesInFlight;
+            retiredSwapchains.push_back(retired);
+
+            swapchainTargets = createSwapchainTargets();
+            swapchainDirty = false;
+
+            recreateSamples.push_back((glfwGetTime() - recreateBeginTimeStamp) * 1000.0);
+        }
+
         double beginFrameTimeStamp{ glfwGetTime() };
 
-        uint32_t nextImageID{};
-        VkResult acquireRes{vkAcquireNextImageKHR(vkState.device, vkSwapchain.swapchain, -1, imageAcquireSemaphore, VK_NULL_HANDLE, &nextImageID)};
-        assert(acquireRes == VK_SUCCESS || acquireRes == VK_SUBOPTIMAL_KHR);
+        if (streaming && frameID > 0){
+            double frameTime{ (beginFrameTimeStamp - previousFrameTimeStamp) * 1000.0 };
+            (streamer.pendingCount > 0 ? streamingFrameTimes : steadyFrameTimes).push_back(frameTime);
+        }
+        previousFrameTimeStamp = beginFrameTimeStamp;
+
+        uint32_t frameIndex{ frameID % framesInFlight };
+        FrameContext& frame{ frames[frameIndex] };
 
-        double gpuFrameTime{};
-        if (frameID > 10)
         {
-            uint64_t queryResults[2];
-            VK_CHECK(vkGetQueryPoolResults(vkState.device, queryPool, nextImageID * 2, 2,
-                                           sizeof(queryResults), queryResults, sizeof(queryResults[0]),
-                                           VK_QUERY_RESULT_WAIT_BIT | VK_QUERY_RESULT_64_BIT));
+            CPU_ZONE("FenceWait");
+
+            retireCompletedFrames();
 
-            gpuFrameTime = double(queryResults[1] - queryResults[0]) * physDevProps.limits.timestampPeriod * 1e-6;
+            VK_CHECK(vkWaitForFences(vkState.device, 1, &frame.fence, VK_TRUE, -1));
+            retireCompletedFrames();
         }
 
-        VK_CHECK(vkWaitForFences(vkState.device, 1, &fences[nextImageID], VK_FALSE, -1));
-        VK_CHECK(vkResetFences(vkState.device, 1, &fences[nextImageID]));
+        // Every frame up to the one that waited on this context's fence has completed
+        for (size_t i{}; i < retiredSwapchains.size();){
+            if (frameID >= retiredSwapchains[i].destroyFrameID){
+                destroySwapchainTargets(retiredSwapchains[i].targets);
+                destroyRetiredSwapchain(vkState.device, retiredSwapchains[i].swapchain);
+                retiredSwapchains.erase(retiredSwapchains.begin() + i);
+            } else {
+                i++;
+            }
+        }
+
+        uint32_t nextImageID{};
+        {
+            CPU_ZONE("Acquire");
 
-        ((UniformData*)(meshUBOs[nextImageID].data))->Time += 0.02f;
+            VkResult acquireRes{vkAcquireNextImageKHR(vkState.device, vkSwapchain.swapchain, -1, frame.imageAcquireSemaphore, VK_NULL_HANDLE, &nextImageID)};
+
+            // The semaphore is left unsignaled and the fence untouched, so the context is reused as is next iteration
+            if (acquireRes == VK_ERROR_OUT_OF_DATE_KHR){
+                swapchainDirty = true;
+                continue;
+            }
+
+            assert(acquireRes == VK_SUCCESS || acquireRes == VK_SUBOPTIMAL_KHR);
+
+            // The image is usable, so this frame is still presented before the swapchain is replaced
+            if (acquireRes == VK_SUBOPTIMAL_KHR){
+                swapchainDirty = true;
+            }
+        }
+
+        VK_CHECK(vkResetFences(vkState.device, 1, &frame.fence));
+
+        beginDescriptorHeapFrame(descrHeap, frameID);
+
+        if (streaming && streamer.pendingCount > 0){
+            CPU_ZONE("Streaming");
+
+            updateMeshStreamer(vkState, uploader, streamer);
+
+            for (uint32_t i{}; i < streamer.meshes.size(); i++){
+                const StreamedMesh& streamedMesh{ streamer.meshes[i] };
+                if (streamedDrawable[i] || streamedMesh.residency != MESH_RESIDENCY_RESIDENT){
+                    continue;
+                }
+
+                streamedDrawConstants[i].vertexBufferID = registerStorageBuffer(vkState.device, descrHeap, streamedMesh.vertices);
+                streamedDrawConstants[i].indexBufferID = registerStorageBuffer(vkState.device, descrHeap, streamedMesh.indices);
+
+                // Grid cells cover x in [-1, 1] and y in [-0.5, 1.5], the view of the orthographic mapping in the shader
+                float cellSize{ 2.0f / streamGridColumns };
+                Instance& instance{ ((Instance*)instanceBuffer.data)[1 + i] };
+                instance.offset[0] = -1.0f + cellSize * (i % streamGridColumns + 0.5f);
+                instance.offset[1] = 1.5f - cellSize * (i / streamGridColumns + 0.5f);
+                instance.scale = 0.5f * cellSize / std::max(streamedMesh.radius, 1e-6f);
+
+                streamedDrawable[i] = true;
+            }
+
+            if (streamer.pendingCount == 0){
+                streamingCompleteMs = glfwGetTime() * 1000.0;
+            }
+        }
+
+        // The context's fence has signaled, so its draw count describes the last frame drawn from it
+        if (options.meshletCull == MESHLET_CULL_GPU && frameID >= (int)framesInFlight){
+            submittedTriangles += meshletCullTriangles(meshletCuller, frameIndex);
+            cullStatsFrames++;
+        }
+
+        {
+            CPU_ZONE("UBOUpdate");
+
+            animationTime += 0.02f;
+
+            UniformData uniformData{};
+            uniformData.Time = animationTime;
+            uniformData.VertexFormat = VERTEX_FORMAT_FLOAT;
+
+            beginUniformRingFrame(uniformRing, frameIndex);
+            drawConstants.uniformIndex = writeUniforms(uniformRing, &uniformData, sizeof(uniformData)) / kBindlessUniformStride;
+        }
 
         VkCommandBufferBeginInfo cmdBeginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
         cmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-        VK_CHECK(vkBeginCommandBuffer(cmdBuffers[nextImageID], &cmdBeginInfo));
+        VK_CHECK(vkBeginCommandBuffer(frame.cmdBuffer, &cmdBeginInfo));
         {
-            vkCmdResetQueryPool(cmdBuffers[nextImageID], queryPool, nextImageID * 2, 2);
-            vkCmdWriteTimestamp(cmdBuffers[nextImageID], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, nextImageID * 2);
+            CPU_ZONE("Record");
+
+            // The context fence has signaled, so the profiler frame it reuses reads back without stalling
+            if (beginGPUProfilerFrame(gpuProfiler, frame.cmdBuffer)){
+                recordCPUProfilerSample("GPUFrame", gpuProfiler.resolvedFrameTimeMs);
+            }
+
+            GPU_ZONE(gpuProfiler, frame.cmdBuffer, "Frame");
+
+            if (options.meshletCull == MESHLET_CULL_GPU){
+                GPU_ZONE(gpuProfiler, frame.cmdBuffer, "MeshletCull");
+
+                recordMeshletCull(frame.cmdBuffer, meshletCuller, frameIndex, animationTime, !vkState.caps.drawIndirectCount);
+            }
 
             {
+                GPU_ZONE(gpuProfiler, frame.cmdBuffer, "AcquireBarrier");
+
                 VkImageMemoryBarrier presentToRenderBarrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
                 presentToRenderBarrier.srcAccessMask = 0;
                 presentToRenderBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
@@ -249,32 +562,73 @@ int main() {
                 presentToRenderBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
                 presentToRenderBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
 
-                vkCmdPipelineBarrier(cmdBuffers[nextImageID],
+                vkCmdPipelineBarrier(frame.cmdBuffer,
                                     VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
                                     VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
                                     VK_DEPENDENCY_BY_REGION_BIT,
                                     0, nullptr, 0, nullptr, 1, &presentToRenderBarrier);
             }
 
-            VkClearValue clearValue{{{0.1f, 0.1f, 0.1f, 1.0f}}};
+            VkClearValue clearValues[2]{};
+            clearValues[0].color = {{ 0.1f, 0.1f, 0.1f, 1.0f }};
+            clearValues[1].depthStencil = { 1.0f, 0 };
 
             VkRenderPassBeginInfo renderPassBeginInfo{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
             renderPassBeginInfo.renderPass = renderPass;
-            renderPassBeginInfo.framebuffer = framebuffers[nextImageID];
+            renderPassBeginInfo.framebuffer = swapchainTargets.framebuffers[nextImageID];
             renderPassBeginInfo.renderArea.extent.width = vkSwapchain.extent.width;
             renderPassBeginInfo.renderArea.extent.height = vkSwapchain.extent.height;
-            renderPassBeginInfo.clearValueCount = 1;
-            renderPassBeginInfo.pClearValues = &clearValue;
+            renderPassBeginInfo.clearValueCount = 2;
+            renderPassBeginInfo.pClearValues = clearValues;
 
-            vkCmdBeginRenderPass(cmdBuffers[nextImageID], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-            vkCmdBindDescriptorSets(cmdBuffers[nextImageID], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descrSets[nextImageID], 0, nullptr);
-            vkCmdBindPipeline(cmdBuffers[nextImageID], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline);
-            vkCmdDraw(cmdBuffers[nextImageID], mesh.indices.size(), 1, 0, 0);
-
-            vkCmdEndRenderPass(cmdBuffers[nextImageID]);
+            {
+                GPU_ZONE(gpuProfiler, frame.cmdBuffer, "MainPass");
+
+                vkCmdBeginRenderPass(frame.cmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+                VkViewport viewport{ 0.0f, 0.0f, (float)vkSwapchain.extent.width, (float)vkSwapchain.extent.height, 0.0f, 1.0f };
+                VkRect2D scissorRect{ {0, 0}, vkSwapchain.extent };
+
+                vkCmdSetViewport(frame.cmdBuffer, 0, 1, &viewport);
+                vkCmdSetScissor(frame.cmdBuffer, 0, 1, &scissorRect);
+
+                vkCmdBindDescriptorSets(frame.cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descrHeap.descrSet, 0, nullptr);
+                vkCmdPushConstants(frame.cmdBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(drawConstants), &drawConstants);
+                vkCmdBindPipeline(frame.cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline);
+
+                if (streaming){
+                    for (uint32_t i{}; i < streamer.meshes.size(); i++){
+                        if (streamedDrawable[i]){
+                            streamedDrawConstants[i].uniformIndex = drawConstants.uniformIndex;
+
+                            vkCmdPushConstants(frame.cmdBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(BindlessConstants), &streamedDrawConstants[i]);
+                            vkCmdDraw(frame.cmdBuffer, streamer.meshes[i].indexCount, 1, 0, 1 + i);
+                        }
+                    }
+                } else if (options.sceneInstances > 0){
+                    drawScene(frame.cmdBuffer, scene, meshRanges, true, false);
+                } else if (options.meshletCull == MESHLET_CULL_NONE){
+                    vkCmdDraw(frame.cmdBuffer, mesh.indexCount, 1, 0, 0);
+                } else if (options.meshletCull == MESHLET_CULL_GPU){
+                    drawMeshletCulled(frame.cmdBuffer, meshletCuller, frameIndex, vkState.caps.drawIndirectCount, vkState.caps);
+                } else {
+                    // The index buffer is in meshlet order, so firstVertex selects a meshlet's triangles
+                    for (uint32_t i{}; i < mesh.meshletCount; i++){
+                        if (isMeshletVisible(mesh.meshlets[i], animationTime)){
+                            vkCmdDraw(frame.cmdBuffer, mesh.meshlets[i].indexCount, 1, mesh.meshlets[i].indexOffset, 0);
+                            submittedTriangles += mesh.meshlets[i].indexCount / 3;
+                        }
+                    }
+
+                    cullStatsFrames++;
+                }
+
+                vkCmdEndRenderPass(frame.cmdBuffer);
+            }
 
             {
+                GPU_ZONE(gpuProfiler, frame.cmdBuffer, "PresentBarrier");
+
                 VkImageMemoryBarrier renderToPresentBarrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
                 renderToPresentBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
                 renderToPresentBarrier.dstAccessMask = 0;
@@ -287,16 +641,14 @@ int main() {
                 renderToPresentBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
                 renderToPresentBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
 
-                vkCmdPipelineBarrier(cmdBuffers[nextImageID],
+                vkCmdPipelineBarrier(frame.cmdBuffer,
                                     VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
                                     VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
                                     VK_DEPENDENCY_BY_REGION_BIT,
                                     0, nullptr, 0, nullptr, 1, &renderToPresentBarrier);
             }
-
-            vkCmdWriteTimestamp(cmdBuffers[nextImageID], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, nextImageID * 2 + 1);
         }
-        VK_CHECK(vkEndCommandBuffer(cmdBuffers[nextImageID]));
+        VK_CHECK(vkEndCommandBuffer(frame.cmdBuffer));
 
         VkPipelineStageFlags waitStages[]{
             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
@@ -304,77 +656,178 @@ int main() {
 
         VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
         submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = &imageAcquireSemaphore;
+        submitInfo.pWaitSemaphores = &frame.imageAcquireSemaphore;
         submitInfo.pWaitDstStageMask = waitStages;
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &cmdBuffers[nextImageID];
+        submitInfo.pCommandBuffers = &frame.cmdBuffer;
         submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores = &imageReleaseSemaphore;
+        submitInfo.pSignalSemaphores = &swapchainTargets.imageReleaseSemaphores[nextImageID];
+
+        {
+            CPU_ZONE("Submit");
+
+            VK_CHECK(vkQueueSubmit(vkState.renderQueue, 1, &submitInfo, frame.fence));
+        }
 
-        VK_CHECK(vkQueueSubmit(vkState.renderQueue, 1, &submitInfo, fences[nextImageID]));
+        frame.inputTimeStamp = beginFrameTimeStamp;
+        frame.inFlight = true;
+
+        endGPUProfilerFrame(gpuProfiler);
 
         VkPresentInfoKHR presentInfo{ VK_STRUCTURE_TYPE_PRESENT_INFO_KHR };
         presentInfo.waitSemaphoreCount = 1;
-        presentInfo.pWaitSemaphores = &imageReleaseSemaphore;
+        presentInfo.pWaitSemaphores = &swapchainTargets.imageReleaseSemaphores[nextImageID];
         presentInfo.swapchainCount = 1;
         presentInfo.pSwapchains = &vkSwapchain.swapchain;
         presentInfo.pImageIndices = &nextImageID;
 
-        VkResult presentRes{ vkQueuePresentKHR(vkState.renderQueue, &presentInfo) };
-        assert(presentRes == VK_SUCCESS || presentRes == VK_SUBOPTIMAL_KHR);
-
         {
-            double endFrameTimeStamp{ glfwGetTime() };
-            double cpuFrameTime{ (endFrameTimeStamp - beginFrameTimeStamp) * 1000.0 };
-            avgCPUFrameTime = frameID > 100 ? avgCPUFrameTime * 0.99 + cpuFrameTime * 0.01 : cpuFrameTime;
-            avgGPUFrameTime = frameID > 100 ? avgGPUFrameTime * 0.99 + gpuFrameTime * 0.01 : gpuFrameTime;
+            CPU_ZONE("Present");
 
-            char frameTimeStr[256];
-            sprintf(frameTimeStr, "CPU: %.2f ms |------| GPU: %.2f ms", avgCPUFrameTime, avgGPUFrameTime);
+            VkResult presentRes{ vkQueuePresentKHR(vkState.renderQueue, &presentInfo) };
+            assert(presentRes == VK_SUCCESS || presentRes == VK_SUBOPTIMAL_KHR || presentRes == VK_ERROR_OUT_OF_DATE_KHR);
 
-            glfwSetWindowTitle(window, frameTimeStr);
+            if (presentRes != VK_SUCCESS){
+                swapchainDirty = true;
+            }
+
+            if (frameID == 0){
+                firstFrameMs = glfwGetTime() * 1000.0;
+            }
         }
 
+        updateCPUProfiler();
+
         frameID++;
+    }
 
-        glfwPollEvents();
+    {
+        double loopTime{ glfwGetTime() - loopBeginTimeStamp };
+
+        VK_CHECK(vkDeviceWaitIdle(vkState.device));
+        retireCompletedFrames();
+
+        std::sort(latencySamples.begin(), latencySamples.end());
+
+        double avgLatency{};
+        for (double latency : latencySamples){
+            avgLatency += latency;
+        }
+        avgLatency /= std::max(latencySamples.size(), (size_t)1);
+
+        double p95Latency{ latencySamples.empty() ? 0.0 : latencySamples[(latencySamples.size() - 1) * 95 / 100] };
+
+        printf("Present mode: %s | Frames in flight: %u | Swapchain images: %zu\n",
+               presentModeName(vkSwapchain.presentMode), framesInFlight, vkSwapchain.images.size());
+        printf("Throughput: %.1f fps | Input-to-GPU-complete latency: avg %.2f ms, p95 %.2f ms\n",
+               loopTime > 0.0 ? frameID / loopTime : 0.0, avgLatency, p95Latency);
+
+        printf("Time to first frame: %.1f ms\n", firstFrameMs);
+
+        if (streaming){
+            uint32_t failedCount{};
+            for (const StreamedMesh& streamedMesh : streamer.meshes){
+                failedCount += streamedMesh.residency == MESH_RESIDENCY_FAILED ? 1 : 0;
+            }
+
+            std::sort(streamingFrameTimes.begin(), streamingFrameTimes.end());
+            std::sort(steadyFrameTimes.begin(), steadyFrameTimes.end());
+
+            printf("Streaming: %zu meshes (%u failed, %u pending) | %.1f MiB, peak %.2f MiB/frame | all resident at %.1f ms\n",
+                   streamer.meshes.size(), failedCount, streamer.pendingCount, streamer.streamedBytes / (1024.0 * 1024.0),
+                   streamer.peakFrameBytes / (1024.0 * 1024.0), streamingCompleteMs);
+            printf("Frame time while streaming: median %.2f ms, worst %.2f ms | after: median %.2f ms\n",
+                   streamingFrameTimes.empty() ? 0.0 : streamingFrameTimes[streamingFrameTimes.size() / 2],
+                   streamingFrameTimes.empty() ? 0.0 : streamingFrameTimes.back(),
+                   steadyFrameTimes.empty() ? 0.0 : steadyFrameTimes[steadyFrameTimes.size() / 2]);
+        }
+
+        if (!recreateSamples.empty()){
+            double avgRecreate{};
+            for (double recreate : recreateSamples){
+                avgRecreate += recreate;
+            }
+            avgRecreate /= recreateSamples.size();
+
+            printf("Swapchain recreations: %zu | CPU time: avg %.2f ms, max %.2f ms\n", recreateSamples.size(),
+                   avgRecreate, *std::max_element(recreateSamples.begin(), recreateSamples.end()));
+        }
+
+        if (options.sceneInstances > 0){
+            printf("Scene: %u instances | %zu draws | %llu triangles\n",
+                   scene.instanceCount, scene.draws.size(), (unsigned long long)scene.triangleCount);
+        }
+
+        if (meshletCulling){
+            printf("Meshlets: %u | Triangles submitted: avg %.0f of %u | Draw: %s\n", mesh.meshletCount,
+                   cullStatsFrames ? (double)submittedTriangles / cullStatsFrames : 0.0, mesh.indexCount / 3,
+                   options.meshletCull == MESHLET_CULL_CPU ? "direct" : vkState.caps.drawIndirectCount ? "indirectCount" : "indirect");
+        }
+
+        shutdownCPUProfiler();
+
+        if (options.gpuTraceFile){
+            for (uint32_t i{}; i < framesInFlight; i++){
+                resolveGPUProfilerFrame(gpuProfiler, (gpuProfiler.frameIndex + i) % framesInFlight);
+            }
+
+            std::vector<TraceEvent> traceEvents{ gpuProfiler.traceEvents };
+            appendCPUTraceEvents(traceEvents);
+
+            writeChromeTrace(options.gpuTraceFile, traceEvents);
+        }
     }
  
     {
         VK_CHECK(vkDeviceWaitIdle(vkState.device));
 
+        savePipelineCache(vkState.device, pipelineCache, "pipeline_cache.bin");
+        vkDestroyPipelineCache(vkState.device, pipelineCache, nullptr);
+
         destroyPipeline(vkState.device, pipeline);
         vkDestroyPipelineLayout(vkState.device, pipelineLayout, nullptr);
 
-        vkDestroyDescriptorPool(vkState.device, descrPool, nullptr);
+        if (options.meshletCull == MESHLET_CULL_GPU){
+            destroyMeshletCuller(vkState.device, meshletCuller);
+            destroyMemoryPool(drawCountPool);
+        }
 
-        vkDestroyDescriptorSetLayout(vkState.device, descrLayout, nullptr);
+        destroyDescriptorHeap(vkState.device, descrHeap);
 
-        for (int i{}; i < vkSwapchain.images.size(); i++){
-            destroyBuffer(vkState.device, meshUBOs[i]);
-        }
+        destroyUniformRing(vkState.device, uniformRing);
 
+        destroyBuffer(vkState.device, instanceBuffer);
         destroyBuffer(vkState.device, meshIndices);
         destroyBuffer(vkState.device, meshVertices);
 
-        for (int i{}; i < vkSwapchain.images.size(); i++){
-            vkDestroyFramebuffer(vkState.device, framebuffers[i], nullptr);
+        unloadMesh(mesh);
+
+        if (streaming){
+            stopMeshStreamer(vkState.device, streamer);
+        }
+
+        destroyStagingUploader(vkState.device, uploader);
+
+        for (RetiredSwapchain& retired : retiredSwapchains){
+            destroySwapchainTargets(retired.targets);
+            destroyRetiredSwapchain(vkState.device, retired.swapchain);
         }
 
+        destroySwapchainTargets(swapchainTargets);
+
         vkDestroyRenderPass(vkState.device, renderPass, nullptr);
 
-        destroyQueryPool(vkState.device, queryPool);
+        destroyGPUProfiler(gpuProfiler);
 
-        for (int i{}; i < vkSwapchain.images.size(); i++){
-            vkDestroyFence(vkState.device, fences[i], nullptr);
+        for (FrameContext& frame : frames){
+            vkDestroyFence(vkState.device, frame.fence, nullptr);
+            vkDestroySemaphore(vkState.device, frame.imageAcquireSemaphore, nullptr);
         }
 
-        vkDestroySemaphore(vkState.device, imageReleaseSemaphore, nullptr);
-        vkDestroySemaphore(vkState.device, imageAcquireSemaphore, nullptr);
-
         vkDestroyCommandPool(vkState.device, cmdPool, nullptr);
 
         destroySwapchain(vkState.instance, vkState.device, vkSwapchain);
+        destroyMemoryAllocator(allocator);
         destroyVulkanState(vkState);
     }
 
@@ -1,31 +1,437 @@
 #include <vector>
+#include <string>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <fast_obj/fast_obj.h>
 #include <meshoptimizer/src/meshoptimizer.h>
 
+#include "vulkan/vk_helpers.h"
+
 struct Vertex{
     float position[3];
     float normal[3];
     float uv[2];
 };
 
+// 16 bytes: unorm16 position relative to the mesh AABB (w unused), octahedral snorm16 normal, half UV
+struct PackedVertex{
+    uint16_t position[4];
+    int16_t normal[2];
+    uint16_t uv[2];
+};
+
+enum VertexFormat : uint32_t{
+    VERTEX_FORMAT_FLOAT,
+    VERTEX_FORMAT_PACKED
+};
+
+// How the vertex shader gets its vertices
+enum VertexInputMode : uint32_t{
+    VERTEX_INPUT_PULL,          // non-indexed draws, the shader reads Indices[gl_VertexIndex] and then the vertex
+    VERTEX_INPUT_INDEXED,       // indexed draws, the shader reads the vertex at gl_VertexIndex
+    VERTEX_INPUT_ATTRIBUTES     // indexed draws from a vertex buffer with fixed-function attributes (mesh_attributes.vert)
+};
+
+// Specializes the switches of shaders/mesh.vert and mesh_bindless.vert, in constant_id order, to draws that always
+// use this vertex format and input mode; the uniforms must still carry the same values for unspecialized pipelines
+ShaderPermutation meshShaderPermutation(VertexFormat vertexFormat, VertexInputMode vertexInput){
+    assert(vertexInput != VERTEX_INPUT_ATTRIBUTES);
+
+    return { 2, { vertexFormat, vertexInput } };
+}
+
+// Mirrors the uniform block in shaders/mesh.vert (std140)
+struct UniformData{
+    float Time;
+    uint32_t VertexFormat;
+    uint32_t VertexInput;
+};
+
+// Mirrors the push constants of shaders/mesh.vert and mesh_attributes.vert, set per draw
+struct DrawConstants{
+    float PositionOffset[4];
+    float PositionScale[4];
+};
+
+// Mirrors the push constants of shaders/mesh_bindless.vert: descriptor heap indices of the buffers a draw reads,
+// followed by the draw's constants and the frame's entry in the uniform ring
+struct BindlessConstants{
+    uint32_t vertexBufferID;
+    uint32_t indexBufferID;
+    uint32_t uniformBufferID;
+    uint32_t instanceBufferID;
+    DrawConstants draw;
+    uint32_t uniformIndex;      // uniform ring offset / kBindlessUniformStride
+};
+
+// Array stride of UniformData in shaders/mesh_bindless.vert, which pads it to 16 bytes; uniform ring offsets are
+// multiples of it
+const uint32_t kBindlessUniformStride{ 16 };
+
+// Mirrors Meshlet in shaders/meshlet_cull.comp (std430); the triangles are indices[indexOffset, indexOffset + indexCount)
+struct Meshlet{
+    float center[3];
+    float radius;
+    float coneAxis[3];
+    float coneCutoff;
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    uint32_t padding[2];
+};
+
+// One level of a mesh's LOD chain: its triangles are indices[indexOffset, indexOffset + indexCount)
+struct MeshLod{
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    float error;            // how far the level may deviate from LOD 0, in mesh units
+};
+
+const uint32_t kMaxMeshLods{ 6 };
+
 struct Mesh{
     std::vector<Vertex> vertices;
     std::vector<uint32_t> indices;
+
+    std::vector<PackedVertex> packedVertices;
+    float positionOffset[3];
+    float positionScale[3];
+
+    std::vector<Meshlet> meshlets;
+
+    std::vector<MeshLod> lods;
+
+    std::vector<float> positions;      // tightly packed xyz per vertex, for depth-only passes
 };
 
-Mesh loadObjMesh(const char* objFile) {
-    fastObjMesh* objMesh{ fast_obj_read(objFile) };
-    assert(objMesh);
+enum MeshImportFlags : uint32_t{
+    MESH_IMPORT_OPTIMIZE = 1 << 0,
+    MESH_IMPORT_QUANTIZE = 1 << 1,
+    MESH_IMPORT_MESHLETS = 1 << 2,
+    MESH_IMPORT_LODS = 1 << 3,
+    MESH_IMPORT_POSITIONS = 1 << 4
+};
+
+struct MeshStats{
+    meshopt_VertexCacheStatistics vertexCache;
+    meshopt_OverdrawStatistics overdraw;
+    meshopt_VertexFetchStatistics vertexFetch;
+};
+
+const uint32_t kMeshAnalysisCacheSize{ 16 };
+const float kMeshOverdrawThreshold{ 1.05f };
+
+MeshStats analyzeMesh(const Vertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount){
+    MeshStats stats{};
+    stats.vertexCache = meshopt_analyzeVertexCache(indices, indexCount, vertexCount, kMeshAnalysisCacheSize, 0, 0);
+    stats.overdraw = meshopt_analyzeOverdraw(indices, indexCount, vertices[0].position, vertexCount, sizeof(Vertex));
+    stats.vertexFetch = meshopt_analyzeVertexFetch(indices, indexCount, vertexCount, sizeof(Vertex));
+
+    return stats;
+}
+
+// Reorders triangles for the post-transform cache, then for overdraw, then reorders vertices in first-use order
+void optimizeMesh(Mesh& mesh){
+    meshopt_optimizeVertexCache(mesh.indices.data(), mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+
+    meshopt_optimizeOverdraw(mesh.indices.data(), mesh.indices.data(), mesh.indices.size(),
+                             mesh.vertices[0].position, mesh.vertices.size(), sizeof(Vertex),
+                             kMeshOverdrawThreshold);
+
+    meshopt_optimizeVertexFetch(mesh.vertices.data(), mesh.indices.data(), mesh.indices.size(),
+                                mesh.vertices.data(), mesh.vertices.size(), sizeof(Vertex));
+}
+
+// Matches the inputs of shaders/mesh_attributes.vert; packed attributes are decoded by the formats where they can be
+void setVertexAttributes(GraphicsPipelineDesc& desc, VertexFormat format){
+    desc.vertexBinding = { 0, format == VERTEX_FORMAT_PACKED ? (uint32_t)sizeof(PackedVertex) : (uint32_t)sizeof(Vertex),
+                           VK_VERTEX_INPUT_RATE_VERTEX };
+    desc.vertexAttributeCount = 3;
+
+    if (format == VERTEX_FORMAT_PACKED){
+        desc.vertexAttributes[0] = { 0, 0, VK_FORMAT_R16G16B16A16_UNORM, (uint32_t)offsetof(PackedVertex, position) };
+        desc.vertexAttributes[1] = { 1, 0, VK_FORMAT_R16G16_SNORM, (uint32_t)offsetof(PackedVertex, normal) };
+        desc.vertexAttributes[2] = { 2, 0, VK_FORMAT_R16G16_SFLOAT, (uint32_t)offsetof(PackedVertex, uv) };
+    } else {
+        desc.vertexAttributes[0] = { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, (uint32_t)offsetof(Vertex, position) };
+        desc.vertexAttributes[1] = { 1, 0, VK_FORMAT_R32G32B32_SFLOAT, (uint32_t)offsetof(Vertex, normal) };
+        desc.vertexAttributes[2] = { 2, 0, VK_FORMAT_R32G32_SFLOAT, (uint32_t)offsetof(Vertex, uv) };
+    }
+}
+
+// Matches the input of shaders/depth_prepass.vert: the position stream split off at import
+void setPositionAttributes(GraphicsPipelineDesc& desc){
+    desc.vertexBinding = { 0, (uint32_t)(3 * sizeof(float)), VK_VERTEX_INPUT_RATE_VERTEX };
+    desc.vertexAttributeCount = 1;
+    desc.vertexAttributes[0] = { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 };
+}
+
+// A depth-only pass fetches 12 bytes per vertex instead of a whole Vertex; the order matches the vertex buffer
+void splitPositions(Mesh& mesh){
+    mesh.positions.resize(mesh.vertices.size() * 3);
+
+    for (size_t i{}; i < mesh.vertices.size(); i++){
+        memcpy(&mesh.positions[i * 3], mesh.vertices[i].position, sizeof(Vertex::position));
+    }
+}
+
+void encodeOctahedral(const float normal[3], int16_t encoded[2]){
+    float length{ fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]) };
+    float x{ length > 0.0f ? normal[0] / length : 0.0f };
+    float y{ length > 0.0f ? normal[1] / length : 0.0f };
+
+    // Fold the lower hemisphere over the diagonals
+    if (normal[2] < 0.0f){
+        float foldedX{ (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f) };
+        float foldedY{ (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f) };
+        x = foldedX;
+        y = foldedY;
+    }
+
+    encoded[0] = (int16_t)meshopt_quantizeSnorm(x, 16);
+    encoded[1] = (int16_t)meshopt_quantizeSnorm(y, 16);
+}
+
+void decodeOctahedral(const int16_t encoded[2], float normal[3]){
+    float x{ std::max(encoded[0] / 32767.0f, -1.0f) };
+    float y{ std::max(encoded[1] / 32767.0f, -1.0f) };
+    float z{ 1.0f - fabsf(x) - fabsf(y) };
+
+    float t{ std::max(-z, 0.0f) };
+    x += x >= 0.0f ? -t : t;
+    y += y >= 0.0f ? -t : t;
+
+    float length{ sqrtf(x * x + y * y + z * z) };
+    normal[0] = x / length;
+    normal[1] = y / length;
+    normal[2] = z / length;
+}
+
+const uint32_t kMeshletMaxVertices{ 64 };
+const uint32_t kMeshletMaxTriangles{ 124 };
+const float kMeshletConeWeight{ 0.25f };
+
+// Reorders the index buffer so each meshlet owns a contiguous range; drawing all of it still renders the whole mesh
+void buildMeshlets(Mesh& mesh){
+    size_t maxMeshlets{ meshopt_buildMeshletsBound(mesh.indices.size(), kMeshletMaxVertices, kMeshletMaxTriangles) };
+
+    std::vector<meshopt_Meshlet> meshlets(maxMeshlets);
+    std::vector<uint32_t> meshletVertices(maxMeshlets * kMeshletMaxVertices);
+    std::vector<uint8_t> meshletTriangles(maxMeshlets * kMeshletMaxTriangles * 3);
+
+    size_t meshletCount{ meshopt_buildMeshlets(meshlets.data(), meshletVertices.data(), meshletTriangles.data(),
+                                               mesh.indices.data(), mesh.indices.size(),
+                                               mesh.vertices[0].position, mesh.vertices.size(), sizeof(Vertex),
+                                               kMeshletMaxVertices, kMeshletMaxTriangles, kMeshletConeWeight) };
+
+    std::vector<uint32_t> indices;
+    indices.reserve(mesh.indices.size());
+
+    mesh.meshlets.resize(meshletCount);
+    for (size_t i{}; i < meshletCount; i++){
+        const meshopt_Meshlet& meshlet{ meshlets[i] };
+
+        meshopt_Bounds bounds{ meshopt_computeMeshletBounds(&meshletVertices[meshlet.vertex_offset],
+                                                            &meshletTriangles[meshlet.triangle_offset],
+                                                            meshlet.triangle_count,
+                                                            mesh.vertices[0].position, mesh.vertices.size(), sizeof(Vertex)) };
+
+        Meshlet& result{ mesh.meshlets[i] };
+        memcpy(result.center, bounds.center, sizeof(result.center));
+        result.radius = bounds.radius;
+        memcpy(result.coneAxis, bounds.cone_axis, sizeof(result.coneAxis));
+        result.coneCutoff = bounds.cone_cutoff;
+        result.indexOffset = indices.size();
+        result.indexCount = meshlet.triangle_count * 3;
+
+        for (uint32_t j{}; j < meshlet.triangle_count * 3; j++){
+            indices.push_back(meshletVertices[meshlet.vertex_offset + meshletTriangles[meshlet.triangle_offset + j]]);
+        }
+    }
+
+    mesh.indices = std::move(indices);
+}
+
+const float kLodReduction{ 0.5f };
+const float kLodMinSavings{ 0.1f };
+
+// Appends each level's indices after the previous level's in mesh.indices, so every level shares the vertex buffer.
+// Stops at kMaxMeshLods or once a level no longer saves at least kLodMinSavings of the previous level's triangles.
+void buildMeshLods(Mesh& mesh){
+    const uint32_t lod0IndexCount{ (uint32_t)mesh.indices.size() };
+    mesh.lods.push_back({ 0, lod0IndexCount, 0.0f });
+
+    // meshopt_simplify reports errors relative to the mesh extents
+    const float errorScale{ meshopt_simplifyScale(mesh.vertices[0].position, mesh.vertices.size(), sizeof(Vertex)) };
+
+    std::vector<uint32_t> lodIndices(lod0IndexCount);
+    while (mesh.lods.size() < kMaxMeshLods){
+        const MeshLod previous{ mesh.lods.back() };
+        size_t targetIndexCount{ (size_t)(previous.indexCount * kLodReduction) / 3 * 3 };
+
+        // Every level is simplified from LOD 0 so errors don't accumulate along the chain
+        float lodError{};
+        size_t indexCount{ meshopt_simplify(lodIndices.data(), mesh.indices.data(), lod0IndexCount,
+                                            mesh.vertices[0].position, mesh.vertices.size(), sizeof(Vertex),
+                                            targetIndexCount, FLT_MAX, 0, &lodError) };
 
-    uint32_t indexCount{};
-    for (int i{}; i < objMesh->face_count; i++){
-        indexCount += 3 * (objMesh->face_vertices[i] - 2);
+        if (indexCount == 0 || indexCount > previous.indexCount * (1.0f - kLodMinSavings)){
+            break;
+        }
+
+        meshopt_optimizeVertexCache(lodIndices.data(), lodIndices.data(), indexCount, mesh.vertices.size());
+
+        // Selection walks the chain assuming coarser levels never have a smaller error
+        mesh.lods.push_back({ (uint32_t)mesh.indices.size(), (uint32_t)indexCount, std::max(lodError * errorScale, previous.error) });
+        mesh.indices.insert(mesh.indices.end(), lodIndices.begin(), lodIndices.begin() + indexCount);
+    }
+}
+
+// The meshlet bounds are in object space, so culling only applies outside of scene mode where instances are placed in
+// view space
+enum MeshletCullMode : uint32_t{
+    MESHLET_CULL_NONE,      // one draw for the whole mesh
+    MESHLET_CULL_CPU,       // visible meshlets are drawn one by one
+    MESHLET_CULL_GPU        // a compute pass compacts the visible meshlets into indirect draws
+};
+
+// Same view as shaders/mesh.vert: rotation around Y by time, then an orthographic projection looking down -Z
+// that shows x in [-1, 1] and y in [-0.5, 1.5]. Must match isMeshletVisible in shaders/meshlet_cull.comp.
+bool isMeshletVisible(const Meshlet& meshlet, float time){
+    float c{ cosf(time) };
+    float s{ sinf(time) };
+
+    float centerX{ meshlet.center[0] * c + meshlet.center[2] * s };
+    float centerY{ meshlet.center[1] };
+
+    if (centerX + meshlet.radius < -1.0f || centerX - meshlet.radius > 1.0f ||
+        centerY + meshlet.radius < -0.5f || centerY - meshlet.radius > 1.5f){
+        return false;
+    }
+
+    // Orthographic cone test: dot(viewDir, axis) >= cutoff means every triangle faces away
+    float axisZ{ -meshlet.coneAxis[0] * s + meshlet.coneAxis[2] * c };
+
+    return -axisZ < meshlet.coneCutoff;
+}
+
+float decodeHalf(uint16_t h){
+    uint32_t sign{ uint32_t(h >> 15) };
+    uint32_t exponent{ uint32_t(h >> 10) & 0x1f };
+    uint32_t mantissa{ uint32_t(h) & 0x3ff };
+
+    float value{ exponent == 0 ? ldexpf((float)mantissa, -24) :
+                 exponent == 31 ? (mantissa ? NAN : INFINITY) :
+                 ldexpf((float)(mantissa | 0x400), (int)exponent - 25) };
+
+    return sign ? -value : value;
+}
+
+void decodePackedPosition(const PackedVertex& vertex, const float offset[3], const float scale[3], float position[3]){
+    for (int i{}; i < 3; i++){
+        position[i] = offset[i] + (vertex.position[i] / 65535.0f) * scale[i];
+    }
+}
+
+void quantizeMesh(Mesh& mesh){
+    float minBounds[3]{ FLT_MAX, FLT_MAX, FLT_MAX };
+    float maxBounds[3]{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (const Vertex& vertex : mesh.vertices){
+        for (int i{}; i < 3; i++){
+            minBounds[i] = std::min(minBounds[i], vertex.position[i]);
+            maxBounds[i] = std::max(maxBounds[i], vertex.position[i]);
+        }
     }
 
-    uint32_t vertexOffset{}, indexOffset{};
-    std::vector<Vertex> vertices(indexCount);
-    for (int i{}; i < objMesh->face_count; i++){
-        for (int j{}; j < objMesh->face_vertices[i]; j++){
+    for (int i{}; i < 3; i++){
+        mesh.positionOffset[i] = minBounds[i];
+        mesh.positionScale[i] = std::max(maxBounds[i] - minBounds[i], FLT_MIN);
+    }
+
+    mesh.packedVertices.resize(mesh.vertices.size());
+    for (size_t i{}; i < mesh.vertices.size(); i++){
+        const Vertex& vertex{ mesh.vertices[i] };
+        PackedVertex& packedVertex{ mesh.packedVertices[i] };
+
+        for (int j{}; j < 3; j++){
+            packedVertex.position[j] = (uint16_t)meshopt_quantizeUnorm((vertex.position[j] - mesh.positionOffset[j]) / mesh.positionScale[j], 16);
+        }
+        packedVertex.position[3] = 0;
+
+        encodeOctahedral(vertex.normal, packedVertex.normal);
+
+        packedVertex.uv[0] = meshopt_quantizeHalf(vertex.uv[0]);
+        packedVertex.uv[1] = meshopt_quantizeHalf(vertex.uv[1]);
+    }
+}
+
+struct QuantizationError{
+    float maxPositionError;
+    float maxPositionErrorRelative; // relative to the AABB diagonal
+    float maxNormalErrorDegrees;
+    float maxUVError;
+};
+
+// Decodes the packed vertices the same way mesh.vert does and compares them with the float vertices
+QuantizationError measureQuantizationError(const Vertex* vertices, const PackedVertex* packedVertices, uint32_t vertexCount,
+                                           const float positionOffset[3], const float positionScale[3]){
+    QuantizationError error{};
+
+    for (uint32_t i{}; i < vertexCount; i++){
+        float position[3], normal[3];
+        decodePackedPosition(packedVertices[i], positionOffset, positionScale, position);
+        decodeOctahedral(packedVertices[i].normal, normal);
+
+        float positionError{};
+        for (int j{}; j < 3; j++){
+            positionError = std::max(positionError, fabsf(position[j] - vertices[i].position[j]));
+        }
+        error.maxPositionError = std::max(error.maxPositionError, positionError);
+
+        const float* sourceNormal{ vertices[i].normal };
+        float sourceLength{ sqrtf(sourceNormal[0] * sourceNormal[0] + sourceNormal[1] * sourceNormal[1] + sourceNormal[2] * sourceNormal[2]) };
+        if (sourceLength > 0.0f){
+            float cosAngle{ (normal[0] * sourceNormal[0] + normal[1] * sourceNormal[1] + normal[2] * sourceNormal[2]) / sourceLength };
+            float angle{ acosf(std::min(std::max(cosAngle, -1.0f), 1.0f)) * 180.0f / (float)M_PI };
+            error.maxNormalErrorDegrees = std::max(error.maxNormalErrorDegrees, angle);
+        }
+
+        for (int j{}; j < 2; j++){
+            error.maxUVError = std::max(error.maxUVError, fabsf(decodeHalf(packedVertices[i].uv[j]) - vertices[i].uv[j]));
+        }
+    }
+
+    float diagonal{ sqrtf(positionScale[0] * positionScale[0] + positionScale[1] * positionScale[1] + positionScale[2] * positionScale[2]) };
+    error.maxPositionErrorRelative = error.maxPositionError / diagonal;
+
+    return error;
+}
+
+// Per-stage wall times of an OBJ import; parsing is always serial
+struct ObjImportTimings{
+    double parseMs;
+    double triangulateMs;
+    double deduplicateMs;
+};
+
+double elapsedMs(std::chrono::steady_clock::time_point begin){
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+// Writes the triangulated corners of faces [firstFace, endFace); objIndexOffset and vertexOffset are where the
+// first face's corners start in objMesh->indices and in vertices
+void triangulateObjFaces(const fastObjMesh* objMesh, uint32_t firstFace, uint32_t endFace,
+                         uint32_t objIndexOffset, uint32_t vertexOffset, Vertex* vertices){
+    for (uint32_t i{ firstFace }; i < endFace; i++){
+        for (uint32_t j{}; j < objMesh->face_vertices[i]; j++){
             // Triangulate: connect current vertex with the first vertex of the face
             if (j >= 3){
                 vertices[vertexOffset + 0] = vertices[vertexOffset - 3];
@@ -33,7 +439,7 @@ Mesh loadObjMesh(const char* objFile) {
                 vertexOffset += 2;
             }
 
-            fastObjIndex objVertID{ objMesh->indices[indexOffset + j] };
+            fastObjIndex objVertID{ objMesh->indices[objIndexOffset + j] };
 
             Vertex& vertex{vertices[vertexOffset++]};
             vertex.position[0] = objMesh->positions[objVertID.p * 3 + 0];
@@ -48,33 +454,558 @@ Mesh loadObjMesh(const char* objFile) {
             vertex.uv[1] = objMesh->texcoords[objVertID.t * 2 + 1];
         }
 
-        indexOffset += objMesh->face_vertices[i];
+        objIndexOffset += objMesh->face_vertices[i];
+    }
+}
+
+// Each job counts the corners of its face range; an exclusive scan over the ranges then gives every job the offsets
+// it reads from and writes to, so all jobs write disjoint parts of the same array
+std::vector<Vertex> triangulateObjMeshParallel(const fastObjMesh* objMesh, uint32_t jobCount){
+    std::vector<uint32_t> objIndexOffsets(jobCount + 1);
+    std::vector<uint32_t> vertexOffsets(jobCount + 1);
+
+    parallelForRanges(jobCount, objMesh->face_count, [&](uint32_t rangeID, size_t begin, size_t end){
+        for (size_t i{ begin }; i < end; i++){
+            objIndexOffsets[rangeID + 1] += objMesh->face_vertices[i];
+            vertexOffsets[rangeID + 1] += 3 * (objMesh->face_vertices[i] - 2);
+        }
+    });
+
+    for (uint32_t i{}; i < jobCount; i++){
+        objIndexOffsets[i + 1] += objIndexOffsets[i];
+        vertexOffsets[i + 1] += vertexOffsets[i];
+    }
+
+    std::vector<Vertex> vertices(vertexOffsets[jobCount]);
+
+    parallelForRanges(jobCount, objMesh->face_count, [&](uint32_t rangeID, size_t begin, size_t end){
+        triangulateObjFaces(objMesh, begin, end, objIndexOffsets[rangeID], vertexOffsets[rangeID], vertices.data());
+    });
+
+    return vertices;
+}
+
+// Bytewise like the comparison in meshopt_generateVertexRemap, so bitwise equal vertices always hash equal
+uint32_t hashVertex(const Vertex& vertex){
+    uint32_t words[sizeof(Vertex) / 4];
+    memcpy(words, &vertex, sizeof(Vertex));
+
+    uint32_t hash{ 0x811c9dc5 };
+    for (uint32_t word : words){
+        hash = (hash ^ word) * 0x01000193;
+    }
+
+    // FNV leaves the high bits weak, which pick the shard
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+
+    return hash;
+}
+
+// Produces the same vertex and index buffers as meshopt_generateVertexRemap + meshopt_remapVertexBuffer: vertices are
+// numbered in order of their first occurrence. Vertices are sharded by hash so each shard's table is built by one job;
+// each shard visits its vertices in ascending order, so it always finds the first occurrence of a duplicate.
+void deduplicateVerticesParallel(const std::vector<Vertex>& vertices, uint32_t jobCount, Mesh& mesh){
+    const size_t vertexCount{ vertices.size() };
+    const uint32_t shardCount{ jobCount };
+
+    std::vector<uint32_t> hashes(vertexCount);
+    std::vector<std::vector<uint32_t>> rangeShardVertices(jobCount * shardCount);
+
+    parallelForRanges(jobCount, vertexCount, [&](uint32_t rangeID, size_t begin, size_t end){
+        for (size_t i{ begin }; i < end; i++){
+            hashes[i] = hashVertex(vertices[i]);
+
+            uint32_t shardID{ (uint32_t)(((uint64_t)hashes[i] * shardCount) >> 32) };
+            rangeShardVertices[rangeID * shardCount + shardID].push_back(i);
+        }
+    });
+
+    // firstOccurrences[i] is the lowest index of a vertex bitwise equal to vertices[i]
+    std::vector<uint32_t> firstOccurrences(vertexCount);
+
+    parallelForRanges(shardCount, shardCount, [&](uint32_t shardID, size_t, size_t){
+        size_t shardVertexCount{};
+        for (uint32_t rangeID{}; rangeID < jobCount; rangeID++){
+            shardVertexCount += rangeShardVertices[rangeID * shardCount + shardID].size();
+        }
+
+        // Open addressing at a load factor of at most 1/2; entries are vertex index + 1 so zero marks an empty slot
+        size_t tableSize{ 1 };
+        while (tableSize < shardVertexCount * 2){
+            tableSize *= 2;
+        }
+
+        std::vector<uint32_t> table(tableSize);
+
+        for (uint32_t rangeID{}; rangeID < jobCount; rangeID++){
+            for (uint32_t vertexID : rangeShardVertices[rangeID * shardCount + shardID]){
+                size_t slot{ hashes[vertexID] & (tableSize - 1) };
+
+                while (table[slot] != 0){
+                    uint32_t candidate{ table[slot] - 1 };
+                    if (hashes[candidate] == hashes[vertexID] && memcmp(&vertices[candidate], &vertices[vertexID], sizeof(Vertex)) == 0){
+                        break;
+                    }
+
+                    slot = (slot + 1) & (tableSize - 1);
+                }
+
+                if (table[slot] == 0){
+                    table[slot] = vertexID + 1;
+                }
+
+                firstOccurrences[vertexID] = table[slot] - 1;
+            }
+        }
+    });
+
+    // Unique vertices are numbered in index order: count them per range, scan, then number each range from its offset
+    std::vector<uint32_t> uniqueOffsets(jobCount + 1);
+
+    parallelForRanges(jobCount, vertexCount, [&](uint32_t rangeID, size_t begin, size_t end){
+        for (size_t i{ begin }; i < end; i++){
+            uniqueOffsets[rangeID + 1] += firstOccurrences[i] == i;
+        }
+    });
+
+    for (uint32_t i{}; i < jobCount; i++){
+        uniqueOffsets[i + 1] += uniqueOffsets[i];
+    }
+
+    mesh.vertices.resize(uniqueOffsets[jobCount]);
+    mesh.indices.resize(vertexCount);
+
+    parallelForRanges(jobCount, vertexCount, [&](uint32_t rangeID, size_t begin, size_t end){
+        uint32_t uniqueID{ uniqueOffsets[rangeID] };
+
+        for (size_t i{ begin }; i < end; i++){
+            if (firstOccurrences[i] == i){
+                mesh.vertices[uniqueID] = vertices[i];
+                mesh.indices[i] = uniqueID++;
+            }
+        }
+    });
+
+    // Duplicates point at an earlier vertex, whose index was written by the pass above
+    parallelForRanges(jobCount, vertexCount, [&](uint32_t rangeID, size_t begin, size_t end){
+        for (size_t i{ begin }; i < end; i++){
+            if (firstOccurrences[i] != i){
+                mesh.indices[i] = mesh.indices[firstOccurrences[i]];
+            }
+        }
+    });
+}
+
+// importJobs > 1 triangulates and deduplicates on the job system; the result is bitwise identical to the serial import.
+// Threads outside of the job system, or calls before it is initialized, import serially. Returns an empty mesh when the
+// file can't be read.
+Mesh loadObjMesh(const char* objFile, uint32_t importFlags = 0, uint32_t importJobs = 1, ObjImportTimings* timings = nullptr) {
+    if (!isJobThread()){
+        importJobs = 1;
+    }
+
+    auto parseBegin{ std::chrono::steady_clock::now() };
+    fastObjMesh* objMesh{ fast_obj_read(objFile) };
+    if (!objMesh){
+        return Mesh{};
+    }
+
+    ObjImportTimings importTimings{};
+    importTimings.parseMs = elapsedMs(parseBegin);
+
+    auto triangulateBegin{ std::chrono::steady_clock::now() };
+    std::vector<Vertex> vertices{};
+    if (importJobs > 1){
+        vertices = triangulateObjMeshParallel(objMesh, importJobs);
+    } else {
+        uint32_t indexCount{};
+        for (int i{}; i < objMesh->face_count; i++){
+            indexCount += 3 * (objMesh->face_vertices[i] - 2);
+        }
+
+        vertices.resize(indexCount);
+        triangulateObjFaces(objMesh, 0, objMesh->face_count, 0, 0, vertices.data());
     }
 
     fast_obj_destroy(objMesh);
+    importTimings.triangulateMs = elapsedMs(triangulateBegin);
 
     Mesh mesh{};
 
-    std::vector<uint32_t> remap(vertices.size());
-    size_t uniqueVertexCount{ meshopt_generateVertexRemap(remap.data(), nullptr,
-                                                            vertices.size(),
-                                                            vertices.data(),
-                                                            vertices.size(),
-                                                            sizeof(Vertex)) };
+    auto deduplicateBegin{ std::chrono::steady_clock::now() };
+    if (importJobs > 1){
+        deduplicateVerticesParallel(vertices, importJobs, mesh);
+    } else {
+        std::vector<uint32_t> remap(vertices.size());
+        size_t uniqueVertexCount{ meshopt_generateVertexRemap(remap.data(), nullptr,
+                                                                vertices.size(),
+                                                                vertices.data(),
+                                                                vertices.size(),
+                                                                sizeof(Vertex)) };
 
-    mesh.vertices.resize(uniqueVertexCount);
-    mesh.indices.resize(vertices.size());
+        mesh.vertices.resize(uniqueVertexCount);
+        mesh.indices.resize(vertices.size());
 
-    meshopt_remapVertexBuffer(mesh.vertices.data(),
-                                vertices.data(),
-                                vertices.size(),
-                                sizeof(Vertex),
-                                remap.data());
+        meshopt_remapVertexBuffer(mesh.vertices.data(),
+                                    vertices.data(),
+                                    vertices.size(),
+                                    sizeof(Vertex),
+                                    remap.data());
 
-    meshopt_remapIndexBuffer(mesh.indices.data(),
-                                nullptr,
-                                vertices.size(),
-                                remap.data());
+        meshopt_remapIndexBuffer(mesh.indices.data(),
+                                    nullptr,
+                                    vertices.size(),
+                                    remap.data());
+    }
+    importTimings.deduplicateMs = elapsedMs(deduplicateBegin);
+
+    if (timings){
+        *timings = importTimings;
+    }
+
+    if (importFlags & MESH_IMPORT_OPTIMIZE){
+        optimizeMesh(mesh);
+    }
+
+    if (importFlags & MESH_IMPORT_MESHLETS){
+        buildMeshlets(mesh);
+    }
+
+    // After the meshlets, which reorder and so must only see LOD 0
+    if (importFlags & MESH_IMPORT_LODS){
+        buildMeshLods(mesh);
+    }
+
+    if (importFlags & MESH_IMPORT_QUANTIZE){
+        quantizeMesh(mesh);
+    }
+
+    // Last, so the stream sees the final vertex order
+    if (importFlags & MESH_IMPORT_POSITIONS){
+        splitPositions(mesh);
+    }
 
     return mesh;
+}
+
+
+// Binary mesh cache: a header followed by 64-byte aligned chunks that can be used straight from an mmap'd file
+const uint32_t kMeshCacheMagic{ 0x434d4252 }; // "RBMC"
+const uint32_t kMeshCacheVersion{ 6 };
+const uint64_t kMeshCacheAlignment{ 64 };
+
+enum MeshCacheChunk : uint32_t{
+    MESH_CACHE_CHUNK_VERTICES,
+    MESH_CACHE_CHUNK_INDICES,
+    MESH_CACHE_CHUNK_PACKED_VERTICES,
+    MESH_CACHE_CHUNK_MESHLETS,
+    MESH_CACHE_CHUNK_LODS,
+    MESH_CACHE_CHUNK_POSITIONS,
+    MESH_CACHE_CHUNK_COUNT
+};
+
+struct MeshCacheChunkRange{
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct MeshCacheHeader{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexStride;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t meshletCount;
+    uint32_t lodCount;
+    uint32_t chunkCount;
+    uint32_t importFlags;
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    uint64_t sourceHash;
+    float positionOffset[3];
+    float positionScale[3];
+    MeshCacheChunkRange chunks[MESH_CACHE_CHUNK_COUNT];
+};
+
+// Mesh data that lives either in a mapped cache file or, if the cache couldn't be written, in importedMesh
+struct MappedMesh{
+    const Vertex* vertices;
+    const uint32_t* indices;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    bool fromCache;
+
+    // Only set when imported with MESH_IMPORT_QUANTIZE
+    const PackedVertex* packedVertices;
+    float positionOffset[3];
+    float positionScale[3];
+
+    // Only set when imported with MESH_IMPORT_MESHLETS
+    const Meshlet* meshlets;
+    uint32_t meshletCount;
+
+    // Only set when imported with MESH_IMPORT_LODS; indexCount then covers every level
+    const MeshLod* lods;
+    uint32_t lodCount;
+
+    // Only set when imported with MESH_IMPORT_POSITIONS; xyz per vertex
+    const float* positions;
+
+    void* mapping;
+    size_t mappingSize;
+    Mesh importedMesh;
+
+    // Without a cache the pointers above point into importedMesh, so a copy would point into the original's vectors.
+    // Moving keeps the vectors' storage.
+    MappedMesh() = default;
+    MappedMesh(const MappedMesh&) = delete;
+    MappedMesh& operator=(const MappedMesh&) = delete;
+    MappedMesh(MappedMesh&&) = default;
+    MappedMesh& operator=(MappedMesh&&) = default;
+};
+
+uint64_t hashFileContents(const char* filename){
+    // FNV-1a
+    uint64_t hash{ 0xcbf29ce484222325ull };
+
+    int fd{ open(filename, O_RDONLY) };
+    if (fd < 0){
+        return 0;
+    }
+
+    struct stat fileStat{};
+    if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0){
+        void* data{ mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0) };
+        if (data != MAP_FAILED){
+            const uint8_t* bytes{ (const uint8_t*)data };
+            for (off_t i{}; i < fileStat.st_size; i++){
+                hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+            }
+
+            munmap(data, fileStat.st_size);
+        }
+    }
+
+    close(fd);
+
+    return hash;
+}
+
+bool writeMeshCache(const char* cacheFile, const char* objFile, uint32_t importFlags, const Mesh& mesh){
+    struct stat sourceStat{};
+    if (stat(objFile, &sourceStat) != 0){
+        return false;
+    }
+
+    MeshCacheHeader header{};
+    header.magic = kMeshCacheMagic;
+    header.version = kMeshCacheVersion;
+    header.vertexStride = sizeof(Vertex);
+    header.vertexCount = mesh.vertices.size();
+    header.indexCount = mesh.indices.size();
+    header.meshletCount = mesh.meshlets.size();
+    header.lodCount = mesh.lods.size();
+    header.chunkCount = MESH_CACHE_CHUNK_COUNT;
+    header.importFlags = importFlags;
+    header.sourceSize = sourceStat.st_size;
+    header.sourceMtime = sourceStat.st_mtime;
+    header.sourceHash = hashFileContents(objFile);
+    memcpy(header.positionOffset, mesh.positionOffset, sizeof(header.positionOffset));
+    memcpy(header.positionScale, mesh.positionScale, sizeof(header.positionScale));
+
+    const void* chunkData[MESH_CACHE_CHUNK_COUNT]{ mesh.vertices.data(), mesh.indices.data(), mesh.packedVertices.data(),
+                                                   mesh.meshlets.data(), mesh.lods.data(), mesh.positions.data() };
+    uint64_t chunkSizes[MESH_CACHE_CHUNK_COUNT]{ mesh.vertices.size() * sizeof(Vertex),
+                                                 mesh.indices.size() * sizeof(uint32_t),
+                                                 mesh.packedVertices.size() * sizeof(PackedVertex),
+                                                 mesh.meshlets.size() * sizeof(Meshlet),
+                                                 mesh.lods.size() * sizeof(MeshLod),
+                                                 mesh.positions.size() * sizeof(float) };
+
+    uint64_t offset{ sizeof(MeshCacheHeader) };
+    for (int i{}; i < MESH_CACHE_CHUNK_COUNT; i++){
+        offset = (offset + kMeshCacheAlignment - 1) & ~(kMeshCacheAlignment - 1);
+        header.chunks[i].offset = offset;
+        header.chunks[i].size = chunkSizes[i];
+        offset += chunkSizes[i];
+    }
+
+    // Write to a temporary file first so a partially written cache is never picked up
+    std::string tempFile{ std::string(cacheFile) + ".tmp" };
+    FILE* file{ fopen(tempFile.c_str(), "wb") };
+    if (!file){
+        return false;
+    }
+
+    bool success{ fwrite(&header, sizeof(header), 1, file) == 1 };
+
+    uint64_t writtenBytes{ sizeof(MeshCacheHeader) };
+    const uint8_t padding[kMeshCacheAlignment]{};
+    for (int i{}; i < MESH_CACHE_CHUNK_COUNT && success; i++){
+        uint64_t paddingSize{ header.chunks[i].offset - writtenBytes };
+        success = fwrite(padding, 1, paddingSize, file) == paddingSize;
+        success = success && fwrite(chunkData[i], 1, chunkSizes[i], file) == chunkSizes[i];
+        writtenBytes = header.chunks[i].offset + chunkSizes[i];
+    }
+
+    success = (fclose(file) == 0) && success;
+    success = success && rename(tempFile.c_str(), cacheFile) == 0;
+
+    if (!success){
+        remove(tempFile.c_str());
+    }
+
+    return success;
+}
+
+bool mapMeshCache(const char* cacheFile, const char* objFile, uint32_t importFlags, MappedMesh& mesh){
+    int fd{ open(cacheFile, O_RDONLY) };
+    if (fd < 0){
+        return false;
+    }
+
+    struct stat cacheStat{};
+    void* mapping{ MAP_FAILED };
+    if (fstat(fd, &cacheStat) == 0 && cacheStat.st_size >= (off_t)sizeof(MeshCacheHeader)){
+        mapping = mmap(nullptr, cacheStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+
+    if (mapping == MAP_FAILED){
+        return false;
+    }
+
+    const MeshCacheHeader& header{ *(const MeshCacheHeader*)mapping };
+
+    bool valid{ header.magic == kMeshCacheMagic &&
+                header.version == kMeshCacheVersion &&
+                header.vertexStride == sizeof(Vertex) &&
+                header.chunkCount == MESH_CACHE_CHUNK_COUNT &&
+                header.importFlags == importFlags };
+
+    for (int i{}; i < MESH_CACHE_CHUNK_COUNT && valid; i++){
+        valid = header.chunks[i].offset % kMeshCacheAlignment == 0 &&
+                header.chunks[i].offset + header.chunks[i].size <= (uint64_t)cacheStat.st_size;
+    }
+
+    uint64_t packedVertexCount{ (importFlags & MESH_IMPORT_QUANTIZE) ? header.vertexCount : 0u };
+    uint64_t positionCount{ (importFlags & MESH_IMPORT_POSITIONS) ? header.vertexCount * 3ull : 0u };
+    valid = valid && header.chunks[MESH_CACHE_CHUNK_VERTICES].size == header.vertexCount * sizeof(Vertex) &&
+                     header.chunks[MESH_CACHE_CHUNK_INDICES].size == header.indexCount * sizeof(uint32_t) &&
+                     header.chunks[MESH_CACHE_CHUNK_PACKED_VERTICES].size == packedVertexCount * sizeof(PackedVertex) &&
+                     header.chunks[MESH_CACHE_CHUNK_MESHLETS].size == header.meshletCount * sizeof(Meshlet) &&
+                     header.chunks[MESH_CACHE_CHUNK_LODS].size == header.lodCount * sizeof(MeshLod) &&
+                     header.chunks[MESH_CACHE_CHUNK_POSITIONS].size == positionCount * sizeof(float);
+
+    // Size and mtime are the fast path; a touched but unchanged source is accepted by its content hash
+    struct stat sourceStat{};
+    if (valid && stat(objFile, &sourceStat) == 0){
+        valid = header.sourceSize == (uint64_t)sourceStat.st_size;
+
+        if (valid && header.sourceMtime != sourceStat.st_mtime){
+            valid = header.sourceHash == hashFileContents(objFile);
+        }
+    }
+
+    if (!valid){
+        munmap(mapping, cacheStat.st_size);
+        return false;
+    }
+
+    const uint8_t* bytes{ (const uint8_t*)mapping };
+    mesh.vertices = (const Vertex*)(bytes + header.chunks[MESH_CACHE_CHUNK_VERTICES].offset);
+    mesh.indices = (const uint32_t*)(bytes + header.chunks[MESH_CACHE_CHUNK_INDICES].offset);
+    mesh.vertexCount = header.vertexCount;
+    mesh.indexCount = header.indexCount;
+    mesh.fromCache = true;
+
+    if (importFlags & MESH_IMPORT_QUANTIZE){
+        mesh.packedVertices = (const PackedVertex*)(bytes + header.chunks[MESH_CACHE_CHUNK_PACKED_VERTICES].offset);
+        memcpy(mesh.positionOffset, header.positionOffset, sizeof(mesh.positionOffset));
+        memcpy(mesh.positionScale, header.positionScale, sizeof(mesh.positionScale));
+    }
+
+    mesh.meshlets = (const Meshlet*)(bytes + header.chunks[MESH_CACHE_CHUNK_MESHLETS].offset);
+    mesh.meshletCount = header.meshletCount;
+
+    mesh.lods = (const MeshLod*)(bytes + header.chunks[MESH_CACHE_CHUNK_LODS].offset);
+    mesh.lodCount = header.lodCount;
+
+    if (importFlags & MESH_IMPORT_POSITIONS){
+        mesh.positions = (const float*)(bytes + header.chunks[MESH_CACHE_CHUNK_POSITIONS].offset);
+    }
+
+    mesh.mapping = mapping;
+    mesh.mappingSize = cacheStat.st_size;
+
+    return true;
+}
+
+// <objFile>.<import flags>.v<version>.rbmesh: every import configuration keeps its own cache, so apps that load the
+// same OBJ with different flags don't keep invalidating each other's
+std::string meshCacheFile(const char* objFile, uint32_t importFlags){
+    char suffix[32]{};
+    snprintf(suffix, sizeof(suffix), ".%02x.v%u.rbmesh", importFlags, kMeshCacheVersion);
+
+    return std::string(objFile) + suffix;
+}
+
+// Loads the mesh cache if it is up to date, otherwise imports the OBJ and writes the cache for the next run. An
+// unreadable OBJ gives an empty mesh.
+MappedMesh loadMesh(const char* objFile, uint32_t importFlags, uint32_t importJobs = 1){
+    MappedMesh mesh{};
+
+    std::string cacheFile{ meshCacheFile(objFile, importFlags) };
+    if (mapMeshCache(cacheFile.c_str(), objFile, importFlags, mesh)){
+        return mesh;
+    }
+
+    mesh.importedMesh = loadObjMesh(objFile, importFlags, importJobs);
+    if (mesh.importedMesh.indices.empty()){
+        return mesh;
+    }
+
+    if (writeMeshCache(cacheFile.c_str(), objFile, importFlags, mesh.importedMesh) &&
+        mapMeshCache(cacheFile.c_str(), objFile, importFlags, mesh)){
+        mesh.importedMesh = Mesh{};
+        mesh.fromCache = false;
+        return mesh;
+    }
+
+    fprintf(stderr, "WARNING: failed to write mesh cache %s\n", cacheFile.c_str());
+
+    mesh.vertices = mesh.importedMesh.vertices.data();
+    mesh.indices = mesh.importedMesh.indices.data();
+    mesh.vertexCount = mesh.importedMesh.vertices.size();
+    mesh.indexCount = mesh.importedMesh.indices.size();
+
+    if (importFlags & MESH_IMPORT_QUANTIZE){
+        mesh.packedVertices = mesh.importedMesh.packedVertices.data();
+        memcpy(mesh.positionOffset, mesh.importedMesh.positionOffset, sizeof(mesh.positionOffset));
+        memcpy(mesh.positionScale, mesh.importedMesh.positionScale, sizeof(mesh.positionScale));
+    }
+
+    mesh.meshlets = mesh.importedMesh.meshlets.data();
+    mesh.meshletCount = mesh.importedMesh.meshlets.size();
+
+    mesh.lods = mesh.importedMesh.lods.data();
+    mesh.lodCount = mesh.importedMesh.lods.size();
+
+    if (importFlags & MESH_IMPORT_POSITIONS){
+        mesh.positions = mesh.importedMesh.positions.data();
+    }
+
+    return mesh;
+}
+
+void unloadMesh(MappedMesh& mesh){
+    if (mesh.mapping){
+        munmap(mesh.mapping, mesh.mappingSize);
+    }
+
+    mesh = MappedMesh{};
 }
\ No newline at end of file
@@ -0,0 +1,205 @@
+#include <vector>
+
+#include "vulkan/vk_helpers.h"
+
+const uint32_t kMeshletCullGroupSize{ 64 };
+
+// Compute stage subgroup operations the SUBGROUP_COMPACTION variant of shaders/meshlet_cull.comp needs
+const VkSubgroupFeatureFlags kMeshletCullSubgroupOperations{ VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT |
+                                                             VK_SUBGROUP_FEATURE_ARITHMETIC_BIT };
+
+// Mirrors the push constants of shaders/meshlet_cull.comp
+struct MeshletCullConstants{
+    float time;
+    uint32_t meshletCount;
+};
+
+// The resources of one frame in flight
+struct MeshletCullFrame{
+    VkDescriptorSet descrSet;
+    Buffer drawCommands;
+    Buffer drawCount;       // draw count and visible triangles, host visible and read back once the slot's fence has signaled
+};
+
+struct MeshletCuller{
+    uint32_t meshletCount;
+    Buffer meshletBuffer;
+
+    VkDescriptorPool descrPool;
+    VkDescriptorSetLayout descrLayout;
+    VkPipelineLayout pipelineLayout;
+    ComputePipeline pipeline;
+
+    std::vector<MeshletCullFrame> frames;
+};
+
+const char* meshletCullShaderFile(const DeviceCapabilities& caps){
+    bool subgroupCompaction{ (caps.subgroupComputeOperations & kMeshletCullSubgroupOperations) == kMeshletCullSubgroupOperations };
+
+    return subgroupCompaction ? "shaders/meshlet_cull_subgroup.cs.spv" : "shaders/meshlet_cull.cs.spv";
+}
+
+// The meshlets are uploaded through the staging ring. The frames get their draw buffers from createMeshletCullBuffers.
+MeshletCuller createMeshletCuller(VulkanState vkState, VkPipelineCache pipelineCache, StagingUploader& uploader,
+                                  const MappedMesh& mesh, uint32_t framesInFlight){
+    MeshletCuller culler{};
+    culler.meshletCount = mesh.meshletCount;
+
+    culler.meshletBuffer = createUploadBuffer(vkState, uploader, mesh.meshletCount * sizeof(Meshlet),
+                                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    uploadBuffer(vkState.device, uploader, culler.meshletBuffer, 0, mesh.meshlets, mesh.meshletCount * sizeof(Meshlet));
+    waitForUploads(vkState.device, uploader);
+
+    VkDescriptorPoolSize descrPoolSize{};
+    descrPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descrPoolSize.descriptorCount = framesInFlight * 3;
+
+    VkDescriptorPoolCreateInfo descrPoolCreateInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+    descrPoolCreateInfo.maxSets = framesInFlight;
+    descrPoolCreateInfo.poolSizeCount = 1;
+    descrPoolCreateInfo.pPoolSizes = &descrPoolSize;
+
+    VK_CHECK(vkCreateDescriptorPool(vkState.device, &descrPoolCreateInfo, nullptr, &culler.descrPool));
+
+    // Meshlets, draw commands, draw count
+    const VkDescriptorType descrTypes[3]{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER };
+
+    culler.descrLayout = createComputeDescriptorSetLayout(vkState.device, descrTypes, 3);
+    culler.pipelineLayout = createComputePipelineLayout(vkState.device, culler.descrLayout, sizeof(MeshletCullConstants));
+    culler.pipeline = createComputePipeline(vkState.device, pipelineCache, meshletCullShaderFile(vkState.caps), culler.pipelineLayout);
+
+    culler.frames.resize(framesInFlight);
+    for (MeshletCullFrame& frame : culler.frames){
+        frame.descrSet = allocateDescriptorSet(vkState.device, culler.descrPool, culler.descrLayout);
+
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = culler.meshletBuffer.buffer;
+        bufferInfo.range = VK_WHOLE_SIZE;
+
+        VkWriteDescriptorSet descrWrite{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+        descrWrite.dstSet = frame.descrSet;
+        descrWrite.dstBinding = 0;
+        descrWrite.descriptorCount = 1;
+        descrWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descrWrite.pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(vkState.device, 1, &descrWrite, 0, nullptr);
+    }
+
+    return culler;
+}
+
+// Replaces the slot's draw commands and count and points its descriptor set at them; the slot must not be in flight.
+// The count comes from countPool or countMemory and the commands from commandMemory when they are set; linear
+// allocators are reset by the caller.
+void createMeshletCullBuffers(VulkanState vkState, MeshletCuller& culler, uint32_t slotID, MemoryPool* countPool = nullptr,
+                              LinearAllocator* commandMemory = nullptr, LinearAllocator* countMemory = nullptr){
+    MeshletCullFrame& frame{ culler.frames[slotID] };
+
+    destroyBuffer(vkState.device, frame.drawCommands);
+    destroyBuffer(vkState.device, frame.drawCount);
+
+    frame.drawCommands = createBuffer(vkState, culler.meshletCount * sizeof(VkDrawIndirectCommand),
+                                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                      VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, nullptr, commandMemory);
+
+    frame.drawCount = createBuffer(vkState, 2 * sizeof(uint32_t),
+                                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                   VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                   countPool, countMemory);
+
+    VkDescriptorBufferInfo bufferInfos[2]{};
+    bufferInfos[0].buffer = frame.drawCommands.buffer;
+    bufferInfos[0].range = VK_WHOLE_SIZE;
+
+    bufferInfos[1].buffer = frame.drawCount.buffer;
+    bufferInfos[1].range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet descrWrites[2]{};
+    for (uint32_t i{}; i < 2; i++){
+        descrWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descrWrites[i].dstSet = frame.descrSet;
+        descrWrites[i].dstBinding = i + 1;
+        descrWrites[i].descriptorCount = 1;
+        descrWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descrWrites[i].pBufferInfo = &bufferInfos[i];
+    }
+
+    vkUpdateDescriptorSets(vkState.device, 2, descrWrites, 0, nullptr);
+}
+
+void destroyMeshletCuller(VkDevice device, MeshletCuller& culler){
+    for (MeshletCullFrame& frame : culler.frames){
+        destroyBuffer(device, frame.drawCommands);
+        destroyBuffer(device, frame.drawCount);
+    }
+
+    destroyPipeline(device, culler.pipeline);
+    vkDestroyPipelineLayout(device, culler.pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, culler.descrLayout, nullptr);
+    vkDestroyDescriptorPool(device, culler.descrPool, nullptr);
+
+    destroyBuffer(device, culler.meshletBuffer);
+
+    culler = MeshletCuller{};
+}
+
+// Compacts the meshlets visible at time into the slot's draw commands. Without a GPU-side count every meshlet slot is
+// drawn, so clearCommands must be set to empty the ones past the count.
+void recordMeshletCull(VkCommandBuffer cmdBuffer, const MeshletCuller& culler, uint32_t slotID, float time, bool clearCommands){
+    const MeshletCullFrame& frame{ culler.frames[slotID] };
+
+    vkCmdFillBuffer(cmdBuffer, frame.drawCount.buffer, 0, VK_WHOLE_SIZE, 0);
+    if (clearCommands){
+        vkCmdFillBuffer(cmdBuffer, frame.drawCommands.buffer, 0, VK_WHOLE_SIZE, 0);
+    }
+
+    VkMemoryBarrier clearToCullBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+    clearToCullBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clearToCullBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(cmdBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &clearToCullBarrier, 0, nullptr, 0, nullptr);
+
+    MeshletCullConstants cullConstants{ time, culler.meshletCount };
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culler.pipeline.pipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culler.pipelineLayout, 0, 1, &frame.descrSet, 0, nullptr);
+    vkCmdPushConstants(cmdBuffer, culler.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullConstants), &cullConstants);
+    vkCmdDispatch(cmdBuffer, (culler.meshletCount + kMeshletCullGroupSize - 1) / kMeshletCullGroupSize, 1, 1);
+
+    // Covers both the commands and the count
+    VkMemoryBarrier cullToDrawBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+    cullToDrawBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    cullToDrawBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+    vkCmdPipelineBarrier(cmdBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                         0, 1, &cullToDrawBarrier, 0, nullptr, 0, nullptr);
+}
+
+// Draws the commands recorded by recordMeshletCull; the draw state is already bound
+void drawMeshletCulled(VkCommandBuffer cmdBuffer, const MeshletCuller& culler, uint32_t slotID, bool useDrawIndirectCount,
+                       const DeviceCapabilities& caps){
+    const MeshletCullFrame& frame{ culler.frames[slotID] };
+    const uint32_t stride{ sizeof(VkDrawIndirectCommand) };
+
+    if (useDrawIndirectCount){
+        vkCmdDrawIndirectCountKHR(cmdBuffer, frame.drawCommands.buffer, 0, frame.drawCount.buffer, 0, culler.meshletCount, stride);
+    } else {
+        cmdDrawIndirect(cmdBuffer, caps, frame.drawCommands.buffer, culler.meshletCount, stride);
+    }
+}
+
+// Triangles that passed the cull in the slot's last frame; its fence must have signaled
+uint32_t meshletCullTriangles(const MeshletCuller& culler, uint32_t slotID){
+    return ((const uint32_t*)culler.frames[slotID].drawCount.data)[1];
+}
\ No newline at end of file
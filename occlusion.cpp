@@ -0,0 +1,416 @@
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "vulkan/vk_helpers.h"
+
+const uint32_t kOcclusionCullGroupSize{ 64 };
+const uint32_t kDepthPyramidGroupSize{ 8 };
+
+// Mirrors SceneObject in shaders/occlusion_cull.comp (std430): one scene instance drawn at LOD 0
+struct SceneObject{
+    uint32_t instanceID;
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    float radius;           // in mesh units, scaled by the instance
+};
+
+// Mirrors the push constants of shaders/occlusion_cull.comp
+struct OcclusionCullConstants{
+    uint32_t firstObject;
+    uint32_t objectCount;
+    uint32_t latePass;
+    uint32_t indexed;
+    uint32_t pyramidSize[2];
+    uint32_t pyramidLevels;
+};
+
+// Mirrors the push constants of shaders/depth_pyramid.comp
+struct DepthPyramidConstants{
+    uint32_t sourceSize[2];
+    uint32_t destinationSize[2];
+};
+
+// Mirrors DrawCountBuffer in shaders/occlusion_cull.comp
+struct OcclusionCullCounts{
+    uint32_t drawCount;
+    uint32_t drawnTriangles;
+    uint32_t frustumCulled;     // late pass only
+    uint32_t occluded;          // late pass only
+};
+
+enum OcclusionPass : uint32_t{
+    OCCLUSION_PASS_EARLY,       // draws the objects that were visible last frame
+    OCCLUSION_PASS_LATE,        // tests every object against the pyramid of the early pass and draws the newly visible ones
+    OCCLUSION_PASS_COUNT
+};
+
+// The resources of one frame in flight
+struct OcclusionFrame{
+    Image pyramid;
+    std::vector<VkImageView> pyramidLevels;
+    std::vector<VkDescriptorSet> pyramidDescrSets;      // level i reads level i - 1, level 0 reads the depth buffer
+
+    VkDescriptorSet cullDescrSets[OCCLUSION_PASS_COUNT];
+    Buffer drawCommands[OCCLUSION_PASS_COUNT];
+    Buffer drawCounts[OCCLUSION_PASS_COUNT];            // host visible, read back once the slot's fence has signaled
+};
+
+struct OcclusionCuller{
+    uint32_t objectCount;
+    Buffer objectBuffer;
+    Buffer visibilityBuffer;    // a flag per object, written by the late pass and read by the next frame's early pass
+
+    VkExtent2D depthExtent;
+    VkExtent2D pyramidExtent;
+    uint32_t pyramidLevelCount;
+    VkSampler sampler;
+
+    VkDescriptorPool descrPool;
+    VkDescriptorSetLayout pyramidDescrLayout;
+    VkPipelineLayout pyramidPipelineLayout;
+    ComputePipeline pyramidPipeline;
+
+    VkDescriptorSetLayout cullDescrLayout;
+    VkPipelineLayout cullPipelineLayout;
+    ComputePipeline cullPipeline;
+
+    std::vector<OcclusionFrame> frames;
+};
+
+// Every instance of the scene's draws, with the bounds of its mesh
+void appendSceneObjects(std::vector<SceneObject>& objects, const Scene& scene, const std::vector<SceneMesh>& meshes){
+    for (const SceneDraw& draw : scene.draws){
+        const SceneMesh& mesh{ meshes[draw.meshID] };
+
+        for (uint32_t i{}; i < draw.instanceCount; i++){
+            objects.push_back({ draw.firstInstance + i, mesh.lods[0].indexOffset, mesh.lods[0].indexCount, mesh.radius });
+        }
+    }
+}
+
+uint32_t previousPowerOfTwo(uint32_t value){
+    uint32_t result{ 1 };
+    while (result * 2 <= value){
+        result *= 2;
+    }
+
+    return result;
+}
+
+// depthTargets are sampled for the pyramid, so they need VK_IMAGE_USAGE_SAMPLED_BIT. The objects are uploaded through
+// the staging ring and every object starts out invisible, so the first frame draws everything in the late pass.
+OcclusionCuller createOcclusionCuller(VulkanState vkState, VkPipelineCache pipelineCache, StagingUploader& uploader,
+                                      const std::vector<SceneObject>& objects, Buffer instanceBuffer,
+                                      const std::vector<Image>& depthTargets, VkExtent2D extent){
+    const uint32_t framesInFlight{ (uint32_t)depthTargets.size() };
+
+    OcclusionCuller culler{};
+    culler.objectCount = objects.size();
+
+    culler.objectBuffer = createUploadBuffer(vkState, uploader, objects.size() * sizeof(SceneObject),
+                                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    culler.visibilityBuffer = createUploadBuffer(vkState, uploader, objects.size() * sizeof(uint32_t),
+                                                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    std::vector<uint32_t> visibility(objects.size());
+    uploadBuffer(vkState.device, uploader, culler.objectBuffer, 0, objects.data(), objects.size() * sizeof(SceneObject));
+    uploadBuffer(vkState.device, uploader, culler.visibilityBuffer, 0, visibility.data(), visibility.size() * sizeof(uint32_t));
+    waitForUploads(vkState.device, uploader);
+
+    // A power of two below the depth buffer, so every level halves the previous one exactly
+    culler.depthExtent = extent;
+    culler.pyramidExtent = { previousPowerOfTwo(extent.width), previousPowerOfTwo(extent.height) };
+    culler.pyramidLevelCount = (uint32_t)log2((double)std::max(culler.pyramidExtent.width, culler.pyramidExtent.height)) + 1;
+
+    VkSamplerCreateInfo samplerInfo{ VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+    VK_CHECK(vkCreateSampler(vkState.device, &samplerInfo, nullptr, &culler.sampler));
+
+    const uint32_t setCount{ framesInFlight * (culler.pyramidLevelCount + OCCLUSION_PASS_COUNT) };
+
+    VkDescriptorPoolSize descrPoolSizes[3]{};
+    descrPoolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descrPoolSizes[0].descriptorCount = setCount;
+
+    descrPoolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    descrPoolSizes[1].descriptorCount = framesInFlight * culler.pyramidLevelCount;
+
+    descrPoolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descrPoolSizes[2].descriptorCount = framesInFlight * OCCLUSION_PASS_COUNT * 5;
+
+    VkDescriptorPoolCreateInfo descrPoolCreateInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+    descrPoolCreateInfo.maxSets = setCount;
+    descrPoolCreateInfo.poolSizeCount = 3;
+    descrPoolCreateInfo.pPoolSizes = descrPoolSizes;
+
+    VK_CHECK(vkCreateDescriptorPool(vkState.device, &descrPoolCreateInfo, nullptr, &culler.descrPool));
+
+    const VkDescriptorType pyramidBindings[]{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE };
+    culler.pyramidDescrLayout = createComputeDescriptorSetLayout(vkState.device, pyramidBindings, 2);
+    culler.pyramidPipelineLayout = createComputePipelineLayout(vkState.device, culler.pyramidDescrLayout, sizeof(DepthPyramidConstants));
+    culler.pyramidPipeline = createComputePipeline(vkState.device, pipelineCache, "shaders/depth_pyramid.cs.spv", culler.pyramidPipelineLayout);
+
+    const VkDescriptorType cullBindings[]{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                           VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                           VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER };
+    culler.cullDescrLayout = createComputeDescriptorSetLayout(vkState.device, cullBindings, 6);
+    culler.cullPipelineLayout = createComputePipelineLayout(vkState.device, culler.cullDescrLayout, sizeof(OcclusionCullConstants));
+    culler.cullPipeline = createComputePipeline(vkState.device, pipelineCache, "shaders/occlusion_cull.cs.spv", culler.cullPipelineLayout);
+
+    culler.frames.resize(framesInFlight);
+    for (uint32_t slotID{}; slotID < framesInFlight; slotID++){
+        OcclusionFrame& frame{ culler.frames[slotID] };
+
+        frame.pyramid = createImage(vkState, culler.pyramidExtent, VK_FORMAT_R32_SFLOAT,
+                                    VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                    VK_IMAGE_ASPECT_COLOR_BIT, culler.pyramidLevelCount);
+
+        // The pyramid stays in the general layout, where it is both written as a storage image and sampled
+        for (uint32_t level{}; level < culler.pyramidLevelCount; level++){
+            frame.pyramidLevels.push_back(createImageView(vkState.device, frame.pyramid.image, VK_FORMAT_R32_SFLOAT,
+                                                          VK_IMAGE_ASPECT_COLOR_BIT, level, 1));
+            frame.pyramidDescrSets.push_back(allocateDescriptorSet(vkState.device, culler.descrPool, culler.pyramidDescrLayout));
+
+            VkDescriptorImageInfo imageInfos[2]{};
+            imageInfos[0].sampler = culler.sampler;
+            imageInfos[0].imageView = level == 0 ? depthTargets[slotID].imageView : frame.pyramidLevels[level - 1];
+            imageInfos[0].imageLayout = level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+            imageInfos[1].imageView = frame.pyramidLevels[level];
+            imageInfos[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            VkWriteDescriptorSet descrWrites[2]{};
+            for (uint32_t j{}; j < 2; j++){
+                descrWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descrWrites[j].dstSet = frame.pyramidDescrSets[level];
+                descrWrites[j].dstBinding = j;
+                descrWrites[j].descriptorCount = 1;
+                descrWrites[j].descriptorType = pyramidBindings[j];
+                descrWrites[j].pImageInfo = &imageInfos[j];
+            }
+
+            vkUpdateDescriptorSets(vkState.device, 2, descrWrites, 0, nullptr);
+        }
+
+        for (uint32_t pass{}; pass < OCCLUSION_PASS_COUNT; pass++){
+            frame.drawCommands[pass] = createBuffer(vkState, objects.size() * sizeof(VkDrawIndexedIndirectCommand),
+                                                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                                    VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            frame.drawCounts[pass] = createBuffer(vkState, sizeof(OcclusionCullCounts),
+                                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                                  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            frame.cullDescrSets[pass] = allocateDescriptorSet(vkState.device, culler.descrPool, culler.cullDescrLayout);
+
+            VkDescriptorBufferInfo bufferInfos[5]{};
+            bufferInfos[0].buffer = culler.objectBuffer.buffer;
+            bufferInfos[1].buffer = instanceBuffer.buffer;
+            bufferInfos[2].buffer = culler.visibilityBuffer.buffer;
+            bufferInfos[3].buffer = frame.drawCommands[pass].buffer;
+            bufferInfos[4].buffer = frame.drawCounts[pass].buffer;
+            for (VkDescriptorBufferInfo& bufferInfo : bufferInfos){
+                bufferInfo.range = VK_WHOLE_SIZE;
+            }
+
+            // Only the late pass samples the pyramid, but the binding must be valid in both
+            VkDescriptorImageInfo pyramidInfo{};
+            pyramidInfo.sampler = culler.sampler;
+            pyramidInfo.imageView = frame.pyramid.imageView;
+            pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            VkWriteDescriptorSet descrWrites[6]{};
+            for (uint32_t j{}; j < 6; j++){
+                descrWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descrWrites[j].dstSet = frame.cullDescrSets[pass];
+                descrWrites[j].dstBinding = j;
+                descrWrites[j].descriptorCount = 1;
+                descrWrites[j].descriptorType = cullBindings[j];
+                if (j < 5){
+                    descrWrites[j].pBufferInfo = &bufferInfos[j];
+                } else {
+                    descrWrites[j].pImageInfo = &pyramidInfo;
+                }
+            }
+
+            vkUpdateDescriptorSets(vkState.device, 6, descrWrites, 0, nullptr);
+        }
+    }
+
+    return culler;
+}
+
+void destroyOcclusionCuller(VkDevice device, OcclusionCuller& culler){
+    for (OcclusionFrame& frame : culler.frames){
+        for (uint32_t pass{}; pass < OCCLUSION_PASS_COUNT; pass++){
+            destroyBuffer(device, frame.drawCommands[pass]);
+            destroyBuffer(device, frame.drawCounts[pass]);
+        }
+
+        for (VkImageView levelView : frame.pyramidLevels){
+            vkDestroyImageView(device, levelView, nullptr);
+        }
+
+        destroyImage(device, frame.pyramid);
+    }
+
+    destroyPipeline(device, culler.cullPipeline);
+    vkDestroyPipelineLayout(device, culler.cullPipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, culler.cullDescrLayout, nullptr);
+
+    destroyPipeline(device, culler.pyramidPipeline);
+    vkDestroyPipelineLayout(device, culler.pyramidPipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, culler.pyramidDescrLayout, nullptr);
+
+    vkDestroyDescriptorPool(device, culler.descrPool, nullptr);
+    vkDestroySampler(device, culler.sampler, nullptr);
+
+    destroyBuffer(device, culler.visibilityBuffer);
+    destroyBuffer(device, culler.objectBuffer);
+
+    culler = OcclusionCuller{};
+}
+
+// Culls objects [firstObject, firstObject + objectCount) into the pass's draw commands. Without a GPU-side count every
+// command slot is drawn, so clearCommands must be set to zero the ones past the count.
+void recordOcclusionCull(VkCommandBuffer cmdBuffer, const OcclusionCuller& culler, uint32_t slotID, OcclusionPass pass,
+                         uint32_t firstObject, uint32_t objectCount, bool indexed, bool clearCommands){
+    const OcclusionFrame& frame{ culler.frames[slotID] };
+
+    vkCmdFillBuffer(cmdBuffer, frame.drawCounts[pass].buffer, 0, VK_WHOLE_SIZE, 0);
+    if (clearCommands){
+        vkCmdFillBuffer(cmdBuffer, frame.drawCommands[pass].buffer, 0, VK_WHOLE_SIZE, 0);
+    }
+
+    // Also orders the early pass after the previous frame's late pass, which wrote the visibility it reads
+    VkMemoryBarrier clearToCullBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+    clearToCullBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    clearToCullBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(cmdBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &clearToCullBarrier, 0, nullptr, 0, nullptr);
+
+    OcclusionCullConstants cullConstants{ firstObject, objectCount, pass == OCCLUSION_PASS_LATE, indexed,
+                                          { culler.pyramidExtent.width, culler.pyramidExtent.height }, culler.pyramidLevelCount };
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culler.cullPipeline.pipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culler.cullPipelineLayout, 0, 1, &frame.cullDescrSets[pass], 0, nullptr);
+    vkCmdPushConstants(cmdBuffer, culler.cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullConstants), &cullConstants);
+    vkCmdDispatch(cmdBuffer, (objectCount + kOcclusionCullGroupSize - 1) / kOcclusionCullGroupSize, 1, 1);
+
+    // Covers both the commands and the count
+    VkMemoryBarrier cullToDrawBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+    cullToDrawBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    cullToDrawBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+    vkCmdPipelineBarrier(cmdBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                         0, 1, &cullToDrawBarrier, 0, nullptr, 0, nullptr);
+}
+
+// Builds the slot's pyramid from depthTarget, which the early pass left as a depth attachment and which is an
+// attachment again afterwards for the late pass
+void recordDepthPyramid(VkCommandBuffer cmdBuffer, const OcclusionCuller& culler, uint32_t slotID, const Image& depthTarget){
+    const OcclusionFrame& frame{ culler.frames[slotID] };
+
+    VkImageMemoryBarrier toPyramidBarriers[2]{};
+    toPyramidBarriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    toPyramidBarriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    toPyramidBarriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    toPyramidBarriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    toPyramidBarriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    toPyramidBarriers[0].image = depthTarget.image;
+    toPyramidBarriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+    // The previous contents are not needed, every level is rewritten
+    toPyramidBarriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    toPyramidBarriers[1].srcAccessMask = 0;
+    toPyramidBarriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    toPyramidBarriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    toPyramidBarriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    toPyramidBarriers[1].image = frame.pyramid.image;
+    toPyramidBarriers[1].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+
+    for (VkImageMemoryBarrier& barrier : toPyramidBarriers){
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+        barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    }
+
+    vkCmdPipelineBarrier(cmdBuffer,
+                         VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 0, nullptr, 0, nullptr, 2, toPyramidBarriers);
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culler.pyramidPipeline.pipeline);
+
+    VkExtent2D sourceExtent{ culler.depthExtent };
+    for (uint32_t level{}; level < culler.pyramidLevelCount; level++){
+        VkExtent2D levelExtent{ std::max(culler.pyramidExtent.width >> level, 1u), std::max(culler.pyramidExtent.height >> level, 1u) };
+        DepthPyramidConstants pyramidConstants{ { sourceExtent.width, sourceExtent.height }, { levelExtent.width, levelExtent.height } };
+
+        vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culler.pyramidPipelineLayout, 0, 1, &frame.pyramidDescrSets[level], 0, nullptr);
+        vkCmdPushConstants(cmdBuffer, culler.pyramidPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pyramidConstants), &pyramidConstants);
+        vkCmdDispatch(cmdBuffer, (levelExtent.width + kDepthPyramidGroupSize - 1) / kDepthPyramidGroupSize,
+                      (levelExtent.height + kDepthPyramidGroupSize - 1) / kDepthPyramidGroupSize, 1);
+
+        // Each level reads the one before it, and the late cull pass reads them all
+        VkMemoryBarrier levelBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+        levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        vkCmdPipelineBarrier(cmdBuffer,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+
+        sourceExtent = levelExtent;
+    }
+
+    VkImageMemoryBarrier toAttachmentBarrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+    toAttachmentBarrier.srcAccessMask = 0;
+    toAttachmentBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    toAttachmentBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    toAttachmentBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    toAttachmentBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toAttachmentBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toAttachmentBarrier.image = depthTarget.image;
+    toAttachmentBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    toAttachmentBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    toAttachmentBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+    vkCmdPipelineBarrier(cmdBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &toAttachmentBarrier);
+}
+
+// Draws the commands of a pass recorded by recordOcclusionCull; the draw state is already bound
+void drawOcclusionCulled(VkCommandBuffer cmdBuffer, const OcclusionCuller& culler, uint32_t slotID, OcclusionPass pass,
+                         uint32_t objectCount, bool indexed, bool useDrawIndirectCount, const DeviceCapabilities& caps){
+    const OcclusionFrame& frame{ culler.frames[slotID] };
+    const uint32_t stride{ sizeof(VkDrawIndexedIndirectCommand) };
+
+    if (indexed && useDrawIndirectCount){
+        vkCmdDrawIndexedIndirectCountKHR(cmdBuffer, frame.drawCommands[pass].buffer, 0, frame.drawCounts[pass].buffer, 0, objectCount, stride);
+    } else if (useDrawIndirectCount){
+        vkCmdDrawIndirectCountKHR(cmdBuffer, frame.drawCommands[pass].buffer, 0, frame.drawCounts[pass].buffer, 0, objectCount, stride);
+    } else {
+        cmdDrawIndirect(cmdBuffer, caps, frame.drawCommands[pass].buffer, objectCount, stride, indexed);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "vulkan/vk_helpers.h"
+
+// CPU zones compile out of release builds; the functions below stay callable and do nothing
+#ifdef RB_RELEASE
+
+#define CPU_ZONE(name)
+
+void configureCPUProfiler(const char* outputFile, double intervalSeconds, const char* frameZone){}
+void recordCPUProfilerSample(const char* name, double ms){}
+void updateCPUProfiler(){}
+void setCPUTraceCapture(bool capture){}
+void appendCPUTraceEvents(std::vector<TraceEvent>& events){}
+void shutdownCPUProfiler(){}
+
+#else
+
+const uint32_t kCPUZoneRingSize{ 1 << 12 };
+const uint32_t kHistogramBuckets{ 5000 };
+const double kHistogramBucketMs{ 0.01 };
+const double kHitchFactor{ 2.0 };
+const size_t kMaxCPUTraceEvents{ 1 << 20 };
+
+struct CPUZoneRecord{
+    const char* name;
+    uint64_t beginNs;       // 0 for plain samples that have no place on the timeline
+    uint64_t durationNs;
+};
+
+// Written only by the owning thread and drained only by updateCPUProfiler, so head and tail are the only shared state
+struct CPUZoneRing{
+    uint32_t threadID;
+    CPUZoneRecord records[kCPUZoneRingSize];
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+    std::atomic<uint64_t> dropped;
+};
+
+// 10 us buckets up to 50 ms; the last bucket collects everything above that
+struct CPUZoneHistogram{
+    const char* name;
+    std::vector<uint32_t> buckets;
+    uint32_t count;
+    double maxMs;
+};
+
+struct CPUProfiler{
+    std::mutex ringsMutex;
+    std::vector<CPUZoneRing*> rings;
+
+    // Histograms of the current reporting window, reset after each report
+    std::vector<CPUZoneHistogram> histograms;
+    uint64_t windowBeginNs;
+    uint32_t windowHitches;
+
+    const char* frameZone;
+    double hitchThresholdMs;
+    uint32_t totalHitches;
+
+    FILE* output;
+    double intervalSeconds;
+
+    bool captureTrace;
+    std::vector<TraceEvent> traceEvents;
+};
+
+static CPUProfiler cpuProfiler{};
+static thread_local CPUZoneRing* threadZoneRing{};
+
+uint64_t cpuProfilerTimeNs(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CPUZoneRing* getThreadZoneRing(){
+    if (!threadZoneRing){
+        threadZoneRing = new CPUZoneRing{};
+
+        // Only taken once per thread, the hot path never locks
+        std::lock_guard<std::mutex> lock{ cpuProfiler.ringsMutex };
+        threadZoneRing->threadID = kRenderThreadTraceID + cpuProfiler.rings.size();
+        cpuProfiler.rings.push_back(threadZoneRing);
+    }
+
+    return threadZoneRing;
+}
+
+void pushCPUZoneRecord(const char* name, uint64_t beginNs, uint64_t durationNs){
+    CPUZoneRing* ring{ getThreadZoneRing() };
+
+    uint64_t head{ ring->head.load(std::memory_order_relaxed) };
+    if (head - ring->tail.load(std::memory_order_acquire) >= kCPUZoneRingSize){
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    ring->records[head & (kCPUZoneRingSize - 1)] = { name, beginNs, durationNs };
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+struct CPUZoneScope{
+    const char* name;
+    uint64_t beginNs;
+
+    CPUZoneScope(const char* name) : name(name), beginNs(cpuProfilerTimeNs()){}
+
+    ~CPUZoneScope(){
+        pushCPUZoneRecord(name, beginNs, cpuProfilerTimeNs() - beginNs);
+    }
+};
+
+#define CPU_ZONE_CONCAT_IMPL(a, b) a##b
+#define CPU_ZONE_CONCAT(a, b) CPU_ZONE_CONCAT_IMPL(a, b)
+#define CPU_ZONE(name) CPUZoneScope CPU_ZONE_CONCAT(cpuZone, __LINE__){ name }
+
+// outputFile is a path, "-" for stdout or nullptr to only keep the histograms for the final report
+void configureCPUProfiler(const char* outputFile, double intervalSeconds, const char* frameZone){
+    if (outputFile){
+        cpuProfiler.output = strcmp(outputFile, "-") == 0 ? stdout : fopen(outputFile, "w");
+
+        if (!cpuProfiler.output){
+            fprintf(stderr, "Could not open CPU stats file %s\n", outputFile);
+        }
+    }
+
+    cpuProfiler.intervalSeconds = intervalSeconds;
+    cpuProfiler.frameZone = frameZone;
+    cpuProfiler.windowBeginNs = cpuProfilerTimeNs();
+
+    // The calling thread registers first so it gets the render thread's trace ID
+    getThreadZoneRing();
+}
+
+// Values that are not CPU zones (e.g. the GPU frame time) can share the histograms and reports
+void recordCPUProfilerSample(const char* name, double ms){
+    pushCPUZoneRecord(name, 0, (uint64_t)(ms * 1e6));
+}
+
+void setCPUTraceCapture(bool capture){
+    cpuProfiler.captureTrace = capture;
+}
+
+void appendCPUTraceEvents(std::vector<TraceEvent>& events){
+    events.insert(events.end(), cpuProfiler.traceEvents.begin(), cpuProfiler.traceEvents.end());
+}
+
+double histogramPercentile(const CPUZoneHistogram& histogram, double p){
+    uint32_t rank{ std::max((uint32_t)(p * histogram.count + 0.999999), 1u) };
+
+    uint32_t cumulative{};
+    for (uint32_t i{}; i < kHistogramBuckets; i++){
+        cumulative += histogram.buckets[i];
+        if (cumulative >= rank){
+            return std::min((i + 0.5) * kHistogramBucketMs, histogram.maxMs);
+        }
+    }
+
+    return histogram.maxMs;
+}
+
+void addHistogramSample(const char* name, double ms){
+    // Zone names are string literals, so they are matched by pointer
+    auto histogram{ std::find_if(cpuProfiler.histograms.begin(), cpuProfiler.histograms.end(),
+                                 [name](const CPUZoneHistogram& histogram){ return histogram.name == name; }) };
+    if (histogram == cpuProfiler.histograms.end()){
+        cpuProfiler.histograms.push_back({ name, std::vector<uint32_t>(kHistogramBuckets + 1), 0, 0.0 });
+        histogram = cpuProfiler.histograms.end() - 1;
+    }
+
+    histogram->buckets[std::min((uint32_t)(ms / kHistogramBucketMs), kHistogramBuckets)]++;
+    histogram->count++;
+    histogram->maxMs = std::max(histogram->maxMs, ms);
+}
+
+void reportCPUProfilerWindow(uint64_t nowNs){
+    double windowSeconds{ (nowNs - cpuProfiler.windowBeginNs) * 1e-9 };
+
+    if (cpuProfiler.output && !cpuProfiler.histograms.empty()){
+        uint64_t dropped{};
+        for (CPUZoneRing* ring : cpuProfiler.rings){
+            dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+        }
+
+        fprintf(cpuProfiler.output, "[cpu] %.1f s window, %u hitches (> %.2f ms), %llu zones dropped\n",
+                windowSeconds, cpuProfiler.windowHitches, cpuProfiler.hitchThresholdMs, (unsigned long long)dropped);
+
+        for (const CPUZoneHistogram& histogram : cpuProfiler.histograms){
+            fprintf(cpuProfiler.output, "[cpu]   %-16s n %6u | p50 %7.3f | p95 %7.3f | p99 %7.3f | max %7.3f ms\n",
+                    histogram.name, histogram.count,
+                    histogramPercentile(histogram, 0.5), histogramPercentile(histogram, 0.95),
+                    histogramPercentile(histogram, 0.99), histogram.maxMs);
+        }
+
+        fflush(cpuProfiler.output);
+    }
+
+    // A hitch is a frame that takes more than twice the median of the previous window
+    for (const CPUZoneHistogram& histogram : cpuProfiler.histograms){
+        if (histogram.name == cpuProfiler.frameZone && histogram.count > 0){
+            cpuProfiler.hitchThresholdMs = histogramPercentile(histogram, 0.5) * kHitchFactor;
+        }
+    }
+
+    cpuProfiler.histograms.clear();
+    cpuProfiler.windowHitches = 0;
+    cpuProfiler.windowBeginNs = nowNs;
+}
+
+// Drains every thread's ring into the window histograms; call once per frame from the main thread
+void updateCPUProfiler(){
+    {
+        std::lock_guard<std::mutex> lock{ cpuProfiler.ringsMutex };
+
+        for (CPUZoneRing* ring : cpuProfiler.rings){
+            uint64_t head{ ring->head.load(std::memory_order_acquire) };
+            uint64_t tail{ ring->tail.load(std::memory_order_relaxed) };
+
+            for (; tail < head; tail++){
+                const CPUZoneRecord& record{ ring->records[tail & (kCPUZoneRingSize - 1)] };
+                double ms{ record.durationNs * 1e-6 };
+
+                addHistogramSample(record.name, ms);
+
+                if (record.name == cpuProfiler.frameZone && cpuProfiler.hitchThresholdMs > 0.0 && ms > cpuProfiler.hitchThresholdMs){
+                    cpuProfiler.windowHitches++;
+                    cpuProfiler.totalHitches++;
+
+                    if (cpuProfiler.output){
+                        fprintf(cpuProfiler.output, "[cpu] hitch: %s took %.3f ms (threshold %.3f ms)\n",
+                                record.name, ms, cpuProfiler.hitchThresholdMs);
+                    }
+                }
+
+                if (cpuProfiler.captureTrace && record.beginNs != 0 && cpuProfiler.traceEvents.size() < kMaxCPUTraceEvents){
+                    cpuProfiler.traceEvents.push_back({ record.name, ring->threadID, record.beginNs * 1e-3, record.durationNs * 1e-3 });
+                }
+            }
+
+            ring->tail.store(tail, std::memory_order_release);
+        }
+    }
+
+    uint64_t nowNs{ cpuProfilerTimeNs() };
+    if (cpuProfiler.intervalSeconds > 0.0 && (nowNs - cpuProfiler.windowBeginNs) * 1e-9 >= cpuProfiler.intervalSeconds){
+        reportCPUProfilerWindow(nowNs);
+    }
+}
+
+// Reports the partial last window and releases the rings; no zones may be recorded afterwards
+void shutdownCPUProfiler(){
+    updateCPUProfiler();
+    reportCPUProfilerWindow(cpuProfilerTimeNs());
+
+    if (cpuProfiler.output){
+        fprintf(cpuProfiler.output, "[cpu] %u hitches in total\n", cpuProfiler.totalHitches);
+
+        if (cpuProfiler.output != stdout){
+            fclose(cpuProfiler.output);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock{ cpuProfiler.ringsMutex };
+    for (CPUZoneRing* ring : cpuProfiler.rings){
+        delete ring;
+    }
+
+    cpuProfiler.rings.clear();
+    cpuProfiler.output = nullptr;
+    threadZoneRing = nullptr;
+}
+
+#endif // RB_RELEASE
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "vulkan/vk_helpers.h"
+
+// Mirrors Instance in shaders/mesh.vert; applied after the rotation, so every instance spins in place
+struct Instance{
+    float offset[3];
+    float scale;
+};
+
+// Instance 0 of every instance buffer, used by the draws outside of scene mode
+const Instance kIdentityInstance{ { 0.0f, 0.0f, 0.0f }, 1.0f };
+
+// A mesh in the shared geometry buffers; its indices are already rebased to its first vertex. Level 0 is the full
+// mesh, meshes imported without a LOD chain have only that level.
+struct SceneMesh{
+    uint32_t lodCount;
+    MeshLod lods[kMaxMeshLods];     // index ranges in the shared index buffer
+    float radius;                   // of the bounding sphere around the mesh origin, which the rotation leaves in place
+    DrawConstants drawConstants;    // pushed before the mesh's draws
+};
+
+SceneMesh createSceneMesh(const MappedMesh& mesh, uint32_t firstIndex){
+    SceneMesh sceneMesh{};
+
+    for (uint32_t i{}; i < 3; i++){
+        sceneMesh.drawConstants.PositionOffset[i] = mesh.positionOffset[i];
+        sceneMesh.drawConstants.PositionScale[i] = mesh.positionScale[i];
+    }
+
+    for (uint32_t i{}; i < mesh.vertexCount; i++){
+        const float* position{ mesh.vertices[i].position };
+        sceneMesh.radius = std::max(sceneMesh.radius, sqrtf(position[0] * position[0] + position[1] * position[1] + position[2] * position[2]));
+    }
+
+    if (mesh.lodCount == 0){
+        sceneMesh.lodCount = 1;
+        sceneMesh.lods[0] = { firstIndex, mesh.indexCount, 0.0f };
+    }
+
+    for (uint32_t i{}; i < mesh.lodCount; i++){
+        sceneMesh.lods[sceneMesh.lodCount++] = { firstIndex + mesh.lods[i].indexOffset, mesh.lods[i].indexCount, mesh.lods[i].error };
+    }
+
+    return sceneMesh;
+}
+
+// One instanced draw of a mesh level for instances [firstInstance, firstInstance + instanceCount)
+struct SceneDraw{
+    uint32_t meshID;
+    uint32_t lod;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+};
+
+struct Scene{
+    uint32_t instanceCount;
+    uint64_t triangleCount;
+    std::vector<SceneDraw> draws;
+};
+
+// Tiles the view with instanceCount scaled copies of the whole view. Meshes take contiguous runs of instances
+// so that each one is a single instanced draw; the instances are appended to the shared instance array.
+// With several layers the instances are split into layerCount grids stacked along z and ordered back to front,
+// which is the worst case for depth testing: every layer covers the previous one and passes the test.
+Scene buildScene(std::vector<Instance>& instances, uint32_t instanceCount, const std::vector<SceneMesh>& meshes,
+                 uint32_t layerCount = 1){
+    Scene scene{};
+    scene.instanceCount = instanceCount;
+
+    layerCount = std::max(std::min(layerCount, instanceCount), 1u);
+    uint32_t layerSize{ (instanceCount + layerCount - 1) / layerCount };
+
+    uint32_t gridSize{ (uint32_t)ceil(sqrt((double)layerSize)) };
+    float cellSize{ 2.0f / gridSize };
+    float scale{ 1.0f / gridSize };
+
+    uint32_t firstInstance{ (uint32_t)instances.size() };
+    for (uint32_t i{}; i < instanceCount; i++){
+        uint32_t layer{ i / layerSize };
+        uint32_t cell{ i % layerSize };
+
+        // The view spans x in [-1, 1] and y in [-0.5, 1.5], see isMeshletVisible in mesh.cpp. Layers span z in [-1, 1],
+        // which leaves room for the meshes themselves within the [-2, 2] depth range of shaders/mesh.vert.
+        float cellX{ -1.0f + ((cell % gridSize) + 0.5f) * cellSize };
+        float cellY{ -0.5f + ((cell / gridSize) + 0.5f) * cellSize };
+        float layerZ{ layerCount > 1 ? -1.0f + 2.0f * layer / (layerCount - 1) : 0.0f };
+
+        instances.push_back({ { cellX, cellY - 0.5f * scale, layerZ }, scale });
+    }
+
+    uint32_t meshCount{ (uint32_t)meshes.size() };
+    for (uint32_t meshID{}; meshID < meshCount; meshID++){
+        uint32_t begin{ (uint32_t)((uint64_t)instanceCount * meshID / meshCount) };
+        uint32_t end{ (uint32_t)((uint64_t)instanceCount * (meshID + 1) / meshCount) };
+
+        if (end > begin){
+            scene.draws.push_back({ meshID, 0, firstInstance + begin, end - begin });
+            scene.triangleCount += (uint64_t)(meshes[meshID].lods[0].indexCount / 3) * (end - begin);
+        }
+    }
+
+    return scene;
+}
+
+const float kLodErrorThresholdPixels{ 1.0f };
+const float kLodHysteresis{ 0.25f };
+
+// Picks the coarsest level whose error projects to at most kLodErrorThresholdPixels. The view is orthographic, so an
+// instance's scale times pixelsPerUnit is all that maps mesh units to pixels. instanceLods keeps every instance's level
+// between frames: a level is refined as soon as its error exceeds the threshold, but coarsened only once the coarser
+// error is kLodHysteresis below it, so instances near a boundary don't flip every frame. Returns a copy of the scene
+// whose draws are split into runs of consecutive instances at the same level.
+Scene selectSceneLods(const Scene& scene, const std::vector<Instance>& instances, const std::vector<SceneMesh>& meshes,
+                      float pixelsPerUnit, std::vector<uint8_t>& instanceLods){
+    Scene lodScene{};
+    lodScene.instanceCount = scene.instanceCount;
+
+    instanceLods.resize(instances.size());
+
+    for (const SceneDraw& draw : scene.draws){
+        const SceneMesh& mesh{ meshes[draw.meshID] };
+
+        for (uint32_t instanceID{ draw.firstInstance }; instanceID < draw.firstInstance + draw.instanceCount; instanceID++){
+            float errorScale{ instances[instanceID].scale * pixelsPerUnit };
+            uint32_t lod{ std::min((uint32_t)instanceLods[instanceID], mesh.lodCount - 1) };
+
+            while (lod > 0 && mesh.lods[lod].error * errorScale > kLodErrorThresholdPixels){
+                lod--;
+            }
+            while (lod + 1 < mesh.lodCount && mesh.lods[lod + 1].error * errorScale <= kLodErrorThresholdPixels * (1.0f - kLodHysteresis)){
+                lod++;
+            }
+
+            instanceLods[instanceID] = lod;
+
+            if (!lodScene.draws.empty() && lodScene.draws.back().meshID == draw.meshID && lodScene.draws.back().lod == lod &&
+                lodScene.draws.back().firstInstance + lodScene.draws.back().instanceCount == instanceID){
+                lodScene.draws.back().instanceCount++;
+            } else {
+                lodScene.draws.push_back({ draw.meshID, lod, instanceID, 1 });
+            }
+
+            lodScene.triangleCount += mesh.lods[lod].indexCount / 3;
+        }
+    }
+
+    return lodScene;
+}
+
+// Without instancing every instance gets its own draw, which shows the cost of CPU submission
+uint32_t countSceneDraws(const Scene& scene, bool instancing){
+    return instancing ? (uint32_t)scene.draws.size() : scene.instanceCount;
+}
+
+// Records draws [firstDraw, endDraw) of the scene's draw list, so the list can be split across threads. Indexed draws
+// need the shared index buffer bound; the indices are already rebased, so the vertex offset is always 0. With a
+// pipeline layout, each mesh's DrawConstants are pushed to the vertex stage whenever the drawn mesh changes.
+void drawScene(VkCommandBuffer cmdBuffer, const Scene& scene, const std::vector<SceneMesh>& meshes, bool instancing, bool indexed,
+               VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t firstDraw = 0, uint32_t endDraw = UINT32_MAX){
+    uint32_t drawID{};
+    uint32_t pushedMeshID{ UINT32_MAX };
+
+    for (const SceneDraw& draw : scene.draws){
+        const MeshLod& lod{ meshes[draw.meshID].lods[draw.lod] };
+        uint32_t drawCount{ instancing ? 1 : draw.instanceCount };
+
+        for (uint32_t i{ std::max(firstDraw, drawID) }; i < std::min(endDraw, drawID + drawCount); i++){
+            if (pipelineLayout && pushedMeshID != draw.meshID){
+                vkCmdPushConstants(cmdBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawConstants),
+                                   &meshes[draw.meshID].drawConstants);
+                pushedMeshID = draw.meshID;
+            }
+
+            uint32_t instanceCount{ instancing ? draw.instanceCount : 1 };
+            uint32_t firstInstance{ instancing ? draw.firstInstance : draw.firstInstance + (i - drawID) };
+
+            if (indexed){
+                vkCmdDrawIndexed(cmdBuffer, lod.indexCount, instanceCount, lod.indexOffset, 0, firstInstance);
+            } else {
+                vkCmdDraw(cmdBuffer, lod.indexCount, instanceCount, lod.indexOffset, firstInstance);
+            }
+        }
+
+        drawID += drawCount;
+    }
+}
+
+// Everything a secondary command buffer needs to draw the scene inside the current render pass
+struct SceneRecordState{
+    VkDevice device;
+    VkCommandBufferInheritanceInfo inheritanceInfo;
+    VkPipeline pipeline;
+    VkPipelineLayout pipelineLayout;
+    VkDescriptorSet descrSet;
+    uint32_t uniformOffset;     // dynamic offset of the frame's uniforms
+    VkBuffer indexBuffer;       // bound for indexed draws when set
+    VkBuffer vertexBuffer;      // bound to binding 0 for fixed-function vertex input when set
+};
+
+// Splits the draw list into chunkCount secondary command buffers recorded on the job system, using the pool of
+// whichever thread runs each chunk, and executes them in order. The render pass must have been begun with
+// VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+void drawSceneParallel(VkCommandBuffer cmdBuffer, const SceneRecordState& recordState, SecondaryCommandPool* threadPools,
+                       const Scene& scene, const std::vector<SceneMesh>& meshes, bool instancing, uint32_t chunkCount){
+    uint32_t drawCount{ countSceneDraws(scene, instancing) };
+    chunkCount = std::max(std::min(chunkCount, drawCount), 1u);
+
+    std::vector<VkCommandBuffer> chunkCmdBuffers(chunkCount);
+    JobCounter counter{};
+
+    for (uint32_t chunkID{}; chunkID < chunkCount; chunkID++){
+        submitJob(counter, [&, chunkID](uint32_t threadID){
+            CPU_ZONE("RecordChunk");
+
+            VkCommandBuffer chunkCmdBuffer{ acquireSecondaryCommandBuffer(recordState.device, threadPools[threadID]) };
+
+            VkCommandBufferBeginInfo cmdBeginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+            cmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            cmdBeginInfo.pInheritanceInfo = &recordState.inheritanceInfo;
+
+            VK_CHECK(vkBeginCommandBuffer(chunkCmdBuffer, &cmdBeginInfo));
+
+            vkCmdBindDescriptorSets(chunkCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, recordState.pipelineLayout, 0, 1, &recordState.descrSet,
+                                    1, &recordState.uniformOffset);
+            vkCmdBindPipeline(chunkCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, recordState.pipeline);
+
+            if (recordState.indexBuffer){
+                vkCmdBindIndexBuffer(chunkCmdBuffer, recordState.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+            }
+            if (recordState.vertexBuffer){
+                VkDeviceSize vertexBufferOffset{};
+                vkCmdBindVertexBuffers(chunkCmdBuffer, 0, 1, &recordState.vertexBuffer, &vertexBufferOffset);
+            }
+
+            drawScene(chunkCmdBuffer, scene, meshes, instancing, recordState.indexBuffer != VK_NULL_HANDLE, recordState.pipelineLayout,
+                      (uint32_t)((uint64_t)drawCount * chunkID / chunkCount),
+                      (uint32_t)((uint64_t)drawCount * (chunkID + 1) / chunkCount));
+
+            VK_CHECK(vkEndCommandBuffer(chunkCmdBuffer));
+
+            chunkCmdBuffers[chunkID] = chunkCmdBuffer;
+        });
+    }
+
+    waitForJobs(counter);
+
+    vkCmdExecuteCommands(cmdBuffer, chunkCount, chunkCmdBuffers.data());
+}
\ No newline at end of file
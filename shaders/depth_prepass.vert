@@ -0,0 +1,37 @@
+#version 450
+
+// Matches Instance in scene.cpp: xyz offset, w uniform scale
+struct Instance{
+    vec4 offsetScale;
+};
+
+// The position stream split off at import (MESH_IMPORT_POSITIONS), see setPositionAttributes in mesh.cpp
+layout(location = 0) in vec3 inPosition;
+
+// The transform is the same as in mesh.vert, so the main pass can test the prepass depth with EQUAL
+invariant gl_Position;
+
+// Per-frame data, bound with a dynamic offset into the uniform ring
+layout(set = 0, binding = 2) uniform UniformBuffer{
+    float Time;
+    uint VertexFormat;
+    uint VertexInput;
+};
+
+layout(set = 0, binding = 3) readonly buffer InstanceBuffer{
+    Instance Instances[];
+};
+
+void main(){
+    mat3 rotMat = mat3(cos(Time),  0.0f,  sin(Time),
+                       0.0f,       1.0f,  0.0f,
+                       -sin(Time), 0.0f,  cos(Time));
+
+    vec4 offsetScale = Instances[gl_InstanceIndex].offsetScale;
+
+    vec3 pos = inPosition * rotMat;
+    pos = pos * offsetScale.w + offsetScale.xyz;
+    pos.z = 0.5f - pos.z * 0.25f;
+    pos.y = 0.5f - pos.y;
+    gl_Position = vec4(pos, 1.0f);
+}
\ No newline at end of file
@@ -6,33 +6,108 @@ struct Vertex{
     float uv[2];
 };
 
+// Matches PackedVertex in mesh.cpp: unorm16 position, octahedral snorm16 normal, half UV
+struct PackedVertex{
+    uint posXY;
+    uint posZW;
+    uint normal;
+    uint uv;
+};
+
+// Matches Instance in scene.cpp: xyz offset, w uniform scale
+struct Instance{
+    vec4 offsetScale;
+};
+
+const uint VERTEX_FORMAT_FLOAT = 0;
+const uint VERTEX_FORMAT_PACKED = 1;
+
+// Matches VertexInputMode in mesh.cpp; VERTEX_INPUT_ATTRIBUTES uses mesh_attributes.vert
+const uint VERTEX_INPUT_PULL = 0;
+const uint VERTEX_INPUT_INDEXED = 1;
+
+// Switches set per pipeline through ShaderPermutation (meshShaderPermutation in mesh.cpp); SWITCH_DYNAMIC leaves the
+// branch on the uniform, any other value lets the driver drop the branches it doesn't take
+const uint SWITCH_DYNAMIC = 0xffffffff;
+layout(constant_id = 0) const uint SpecVertexFormat = 0xffffffff;
+layout(constant_id = 1) const uint SpecVertexInput = 0xffffffff;
+
 layout(location = 0) out vec4 color;
 
+// Must match depth_prepass.vert bit for bit, or EQUAL depth tests after a prepass fail
+invariant gl_Position;
+
 layout(set = 0, binding = 0) readonly buffer VerticesBuffer{
     Vertex Vertices[];
 };
 
+layout(set = 0, binding = 0) readonly buffer PackedVerticesBuffer{
+    PackedVertex PackedVertices[];
+};
+
 layout(set = 0, binding = 1) readonly buffer IndexBuffer{
     uint Indices[];
 };
 
+// Per-frame data, bound with a dynamic offset into the uniform ring
 layout(set = 0, binding = 2) uniform UniformBuffer{
     float Time;
+    uint VertexFormat;
+    uint VertexInput;
 };
 
+// Matches DrawConstants in mesh.cpp: the dequantization range of the drawn mesh's packed positions
+layout(push_constant) uniform DrawConstants{
+    vec4 PositionOffset;
+    vec4 PositionScale;
+};
+
+layout(set = 0, binding = 3) readonly buffer InstanceBuffer{
+    Instance Instances[];
+};
+
+vec3 decodeOctahedral(vec2 e){
+    vec3 n = vec3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
 void main(){
     mat3 rotMat = mat3(cos(Time),  0.0f,  sin(Time),
                        0.0f,       1.0f,  0.0f,
                        -sin(Time), 0.0f,  cos(Time));
 
-    Vertex vert = Vertices[Indices[gl_VertexIndex]];
+    uint vertexFormat = SpecVertexFormat != SWITCH_DYNAMIC ? SpecVertexFormat : VertexFormat;
+    uint vertexInput = SpecVertexInput != SWITCH_DYNAMIC ? SpecVertexInput : VertexInput;
+
+    // Indexed draws already resolve the index, which lets the post-transform cache reuse shared vertices
+    uint vertexID = vertexInput == VERTEX_INPUT_INDEXED ? gl_VertexIndex : Indices[gl_VertexIndex];
+
+    vec3 pos;
+    vec3 normal;
+    if (vertexFormat == VERTEX_FORMAT_PACKED){
+        PackedVertex vert = PackedVertices[vertexID];
+
+        pos = vec3(unpackUnorm2x16(vert.posXY), unpackUnorm2x16(vert.posZW).x);
+        pos = PositionOffset.xyz + pos * PositionScale.xyz;
+        normal = decodeOctahedral(unpackSnorm2x16(vert.normal));
+    } else {
+        Vertex vert = Vertices[vertexID];
+
+        pos = vec3(vert.pos[0], vert.pos[1], vert.pos[2]);
+        normal = vec3(vert.normal[0], vert.normal[1], vert.normal[2]);
+    }
+
+    vec4 offsetScale = Instances[gl_InstanceIndex].offsetScale;
 
-    vec3 pos = vec3(vert.pos[0], vert.pos[1], vert.pos[2]);
     pos = pos * rotMat;
-    pos.z = 0.5f;
+    pos = pos * offsetScale.w + offsetScale.xyz;
+    // Orthographic depth: z in [-2, 2] maps to [1, 0], so larger z is closer to the viewer
+    pos.z = 0.5f - pos.z * 0.25f;
     pos.y = 0.5f - pos.y;
     gl_Position = vec4(pos, 1.0f);
 
-    vec3 normal = vec3(vert.normal[0], vert.normal[1], vert.normal[2]);
     color = vec4((normal * 0.5f) + 0.5f,  1.0f);
 }
\ No newline at end of file
@@ -0,0 +1,71 @@
+#version 450
+
+// Matches Instance in scene.cpp: xyz offset, w uniform scale
+struct Instance{
+    vec4 offsetScale;
+};
+
+const uint VERTEX_FORMAT_FLOAT = 0;
+const uint VERTEX_FORMAT_PACKED = 1;
+
+// Fixed-function inputs set up by setVertexAttributes in mesh.cpp. Packed positions arrive as unorm and packed
+// normals as the two octahedral snorm components.
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec4 inNormal;
+layout(location = 2) in vec2 inUV;
+
+layout(location = 0) out vec4 color;
+
+// Must match depth_prepass.vert bit for bit, or EQUAL depth tests after a prepass fail
+invariant gl_Position;
+
+// Per-frame data, bound with a dynamic offset into the uniform ring
+layout(set = 0, binding = 2) uniform UniformBuffer{
+    float Time;
+    uint VertexFormat;
+    uint VertexInput;
+};
+
+// Matches DrawConstants in mesh.cpp: the dequantization range of the drawn mesh's packed positions
+layout(push_constant) uniform DrawConstants{
+    vec4 PositionOffset;
+    vec4 PositionScale;
+};
+
+layout(set = 0, binding = 3) readonly buffer InstanceBuffer{
+    Instance Instances[];
+};
+
+vec3 decodeOctahedral(vec2 e){
+    vec3 n = vec3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
+void main(){
+    mat3 rotMat = mat3(cos(Time),  0.0f,  sin(Time),
+                       0.0f,       1.0f,  0.0f,
+                       -sin(Time), 0.0f,  cos(Time));
+
+    vec3 pos;
+    vec3 normal;
+    if (VertexFormat == VERTEX_FORMAT_PACKED){
+        pos = PositionOffset.xyz + inPosition.xyz * PositionScale.xyz;
+        normal = decodeOctahedral(inNormal.xy);
+    } else {
+        pos = inPosition.xyz;
+        normal = inNormal.xyz;
+    }
+
+    vec4 offsetScale = Instances[gl_InstanceIndex].offsetScale;
+
+    pos = pos * rotMat;
+    pos = pos * offsetScale.w + offsetScale.xyz;
+    pos.z = 0.5f - pos.z * 0.25f;
+    pos.y = 0.5f - pos.y;
+    gl_Position = vec4(pos, 1.0f);
+
+    color = vec4((normal * 0.5f) + 0.5f,  1.0f);
+}
\ No newline at end of file
@@ -0,0 +1,127 @@
+#version 450
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+struct Vertex{
+    float pos[3];
+    float normal[3];
+    float uv[2];
+};
+
+// Matches PackedVertex in mesh.cpp: unorm16 position, octahedral snorm16 normal, half UV
+struct PackedVertex{
+    uint posXY;
+    uint posZW;
+    uint normal;
+    uint uv;
+};
+
+// Matches Instance in scene.cpp: xyz offset, w uniform scale
+struct Instance{
+    vec4 offsetScale;
+};
+
+const uint VERTEX_FORMAT_FLOAT = 0;
+const uint VERTEX_FORMAT_PACKED = 1;
+
+// Matches VertexInputMode in mesh.cpp; VERTEX_INPUT_ATTRIBUTES uses mesh_attributes.vert
+const uint VERTEX_INPUT_PULL = 0;
+const uint VERTEX_INPUT_INDEXED = 1;
+
+// Switches set per pipeline through ShaderPermutation (meshShaderPermutation in mesh.cpp); SWITCH_DYNAMIC leaves the
+// branch on the uniform, any other value lets the driver drop the branches it doesn't take
+const uint SWITCH_DYNAMIC = 0xffffffff;
+layout(constant_id = 0) const uint SpecVertexFormat = 0xffffffff;
+layout(constant_id = 1) const uint SpecVertexInput = 0xffffffff;
+
+layout(location = 0) out vec4 color;
+
+// Every buffer is an entry of the descriptor heap's storage buffer array (binding 0, see vk_descriptor_set.cpp);
+// the blocks alias it with the layouts they need and the push constants select the entries
+layout(set = 0, binding = 0) readonly buffer VerticesBuffer{
+    Vertex Vertices[];
+} VertexBuffers[];
+
+layout(set = 0, binding = 0) readonly buffer PackedVerticesBuffer{
+    PackedVertex PackedVertices[];
+} PackedVertexBuffers[];
+
+layout(set = 0, binding = 0) readonly buffer IndexBuffer{
+    uint Indices[];
+} IndexBuffers[];
+
+// Matches UniformData in mesh.cpp, padded to kBindlessUniformStride
+struct UniformData{
+    float Time;
+    uint VertexFormat;
+    uint VertexInput;
+    uint Padding;
+};
+
+// The uniform ring: each frame writes its entry and pushes its index
+layout(set = 0, binding = 0) readonly buffer UniformBuffer{
+    UniformData Uniforms[];
+} UniformBuffers[];
+
+layout(set = 0, binding = 0) readonly buffer InstanceBuffer{
+    Instance Instances[];
+} InstanceBuffers[];
+
+// Matches BindlessConstants in mesh.cpp
+layout(push_constant) uniform BindlessConstants{
+    uint VertexBufferID;
+    uint IndexBufferID;
+    uint UniformBufferID;
+    uint InstanceBufferID;
+    vec4 PositionOffset;
+    vec4 PositionScale;
+    uint UniformIndex;
+};
+
+vec3 decodeOctahedral(vec2 e){
+    vec3 n = vec3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
+void main(){
+    UniformData uniforms = UniformBuffers[UniformBufferID].Uniforms[UniformIndex];
+    float Time = uniforms.Time;
+    uint VertexFormat = SpecVertexFormat != SWITCH_DYNAMIC ? SpecVertexFormat : uniforms.VertexFormat;
+    uint VertexInput = SpecVertexInput != SWITCH_DYNAMIC ? SpecVertexInput : uniforms.VertexInput;
+
+    mat3 rotMat = mat3(cos(Time),  0.0f,  sin(Time),
+                       0.0f,       1.0f,  0.0f,
+                       -sin(Time), 0.0f,  cos(Time));
+
+    // Indexed draws already resolve the index, which lets the post-transform cache reuse shared vertices
+    uint vertexID = VertexInput == VERTEX_INPUT_INDEXED ? gl_VertexIndex : IndexBuffers[IndexBufferID].Indices[gl_VertexIndex];
+
+    vec3 pos;
+    vec3 normal;
+    if (VertexFormat == VERTEX_FORMAT_PACKED){
+        PackedVertex vert = PackedVertexBuffers[VertexBufferID].PackedVertices[vertexID];
+
+        pos = vec3(unpackUnorm2x16(vert.posXY), unpackUnorm2x16(vert.posZW).x);
+        pos = PositionOffset.xyz + pos * PositionScale.xyz;
+        normal = decodeOctahedral(unpackSnorm2x16(vert.normal));
+    } else {
+        Vertex vert = VertexBuffers[VertexBufferID].Vertices[vertexID];
+
+        pos = vec3(vert.pos[0], vert.pos[1], vert.pos[2]);
+        normal = vec3(vert.normal[0], vert.normal[1], vert.normal[2]);
+    }
+
+    vec4 offsetScale = InstanceBuffers[InstanceBufferID].Instances[gl_InstanceIndex].offsetScale;
+
+    pos = pos * rotMat;
+    pos = pos * offsetScale.w + offsetScale.xyz;
+    // Orthographic depth: z in [-2, 2] maps to [1, 0], so larger z is closer to the viewer
+    pos.z = 0.5f - pos.z * 0.25f;
+    pos.y = 0.5f - pos.y;
+    gl_Position = vec4(pos, 1.0f);
+
+    color = vec4((normal * 0.5f) + 0.5f,  1.0f);
+}
\ No newline at end of file
@@ -0,0 +1,256 @@
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include <deque>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <dirent.h>
+
+#include "vulkan/vk_helpers.h"
+
+// Default bytes of mesh data staged per frame; the rest waits for the next frames
+const VkDeviceSize kStreamingFrameBudget{ 4 * 1024 * 1024 };
+
+enum MeshResidency : uint32_t{
+    MESH_RESIDENCY_LOADING,     // queued for or being imported on the streaming thread
+    MESH_RESIDENCY_UPLOADING,   // imported, its copies are recorded a budget at a time
+    MESH_RESIDENCY_RESIDENT,    // the copies have completed, the buffers can be drawn
+    MESH_RESIDENCY_FAILED,      // the file couldn't be read
+};
+
+struct StreamedMesh{
+    std::string file;
+    MeshResidency residency;    // only touched by the main thread
+
+    // Written by the streaming thread before the mesh is handed back, released once resident
+    MappedMesh mesh;
+    float radius;               // of the bounding sphere around the mesh origin
+
+    Buffer vertices;
+    Buffer indices;
+    uint32_t indexCount;
+    VkDeviceSize uploadedBytes; // vertex bytes first, then index bytes
+    uint64_t uploadSerial;      // StagingUploader::submittedCount that covers the last copy
+
+    std::chrono::steady_clock::time_point requestTime;
+    double residentMs;          // from the request to the completed upload
+};
+
+// Imports run on a dedicated thread rather than the job system, so a long OBJ import can never be stolen by a
+// frame waiting for its recording jobs. Uploads happen on the main thread, under a per-frame byte budget.
+struct MeshStreamer{
+    uint32_t importFlags;
+    VkDeviceSize frameBudget;
+
+    std::deque<StreamedMesh> meshes;    // a deque, so the streaming thread's pointers survive new requests
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::deque<StreamedMesh*> loadQueue;
+    std::deque<StreamedMesh*> loadedQueue;
+    bool running;
+
+    // Main thread only
+    std::deque<StreamedMesh*> uploadQueue;
+    std::vector<StreamedMesh*> completingMeshes;   // every byte is submitted, waiting for the copies
+    uint32_t pendingCount;                          // requested meshes neither resident nor failed
+    VkDeviceSize streamedBytes;
+    VkDeviceSize peakFrameBytes;
+};
+
+void meshStreamerLoop(MeshStreamer* streamer){
+    while (true){
+        StreamedMesh* streamedMesh{};
+        {
+            std::unique_lock<std::mutex> lock{ streamer->mutex };
+            streamer->wakeCondition.wait(lock, [&](){ return !streamer->loadQueue.empty() || !streamer->running; });
+
+            if (!streamer->running){
+                return;
+            }
+
+            streamedMesh = streamer->loadQueue.front();
+            streamer->loadQueue.pop_front();
+        }
+
+        // An unreadable file gives an empty mesh, which updateMeshStreamer marks as failed. This thread isn't a job
+        // thread, so the import is serial.
+        streamedMesh->mesh = loadMesh(streamedMesh->file.c_str(), streamer->importFlags);
+
+        for (uint32_t i{}; i < streamedMesh->mesh.vertexCount; i++){
+            const float* position{ streamedMesh->mesh.vertices[i].position };
+            streamedMesh->radius = std::max(streamedMesh->radius, sqrtf(position[0] * position[0] + position[1] * position[1] +
+                                                                        position[2] * position[2]));
+        }
+
+        std::lock_guard<std::mutex> lock{ streamer->mutex };
+        streamer->loadedQueue.push_back(streamedMesh);
+    }
+}
+
+void startMeshStreamer(MeshStreamer& streamer, uint32_t importFlags, VkDeviceSize frameBudget = kStreamingFrameBudget){
+    streamer.importFlags = importFlags;
+    streamer.frameBudget = frameBudget;
+    streamer.running = true;
+    streamer.thread = std::thread{ meshStreamerLoop, &streamer };
+}
+
+// Returns the mesh's index in streamer.meshes, which it keeps for the streamer's lifetime
+uint32_t requestMesh(MeshStreamer& streamer, const char* file){
+    StreamedMesh& streamedMesh{ streamer.meshes.emplace_back() };
+    streamedMesh.file = file;
+    streamedMesh.residency = MESH_RESIDENCY_LOADING;
+    streamedMesh.requestTime = std::chrono::steady_clock::now();
+
+    streamer.pendingCount++;
+
+    {
+        std::lock_guard<std::mutex> lock{ streamer.mutex };
+        streamer.loadQueue.push_back(&streamedMesh);
+    }
+    streamer.wakeCondition.notify_one();
+
+    return streamer.meshes.size() - 1;
+}
+
+// Every .obj in the directory, sorted by name; loadMesh picks up their .rbmesh caches
+std::vector<std::string> listMeshFiles(const char* directory){
+    std::vector<std::string> files{};
+
+    DIR* dir{ opendir(directory) };
+    if (!dir){
+        return files;
+    }
+
+    while (dirent* entry{ readdir(dir) }){
+        size_t length{ strlen(entry->d_name) };
+        if (length > 4 && strcmp(entry->d_name + length - 4, ".obj") == 0){
+            files.push_back(std::string(directory) + "/" + entry->d_name);
+        }
+    }
+
+    closedir(dir);
+
+    std::sort(files.begin(), files.end());
+
+    return files;
+}
+
+// Called once per frame on the main thread: takes over imported meshes, records at most frameBudget bytes of copies
+// (a large mesh spans several frames) and marks meshes resident once their copies have completed. Never waits for
+// the GPU, unless the staging ring itself is full.
+void updateMeshStreamer(VulkanState vkState, StagingUploader& uploader, MeshStreamer& streamer){
+    {
+        std::lock_guard<std::mutex> lock{ streamer.mutex };
+
+        for (StreamedMesh* streamedMesh : streamer.loadedQueue){
+            if (streamedMesh->mesh.indexCount == 0){
+                streamedMesh->residency = MESH_RESIDENCY_FAILED;
+                streamer.pendingCount--;
+                fprintf(stderr, "Failed to stream %s\n", streamedMesh->file.c_str());
+                continue;
+            }
+
+            streamedMesh->vertices = createUploadBuffer(vkState, uploader, streamedMesh->mesh.vertexCount * sizeof(Vertex),
+                                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            streamedMesh->indices = createUploadBuffer(vkState, uploader, streamedMesh->mesh.indexCount * sizeof(uint32_t),
+                                                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            streamedMesh->indexCount = streamedMesh->mesh.indexCount;
+            streamedMesh->residency = MESH_RESIDENCY_UPLOADING;
+
+            streamer.uploadQueue.push_back(streamedMesh);
+        }
+
+        streamer.loadedQueue.clear();
+    }
+
+    VkDeviceSize frameBytes{};
+    std::vector<StreamedMesh*> submittedMeshes{};
+
+    while (!streamer.uploadQueue.empty() && frameBytes < streamer.frameBudget){
+        StreamedMesh& streamedMesh{ *streamer.uploadQueue.front() };
+
+        const VkDeviceSize vertexBytes{ streamedMesh.mesh.vertexCount * sizeof(Vertex) };
+        const VkDeviceSize indexBytes{ streamedMesh.mesh.indexCount * sizeof(uint32_t) };
+
+        VkDeviceSize end{ std::min(vertexBytes + indexBytes, streamedMesh.uploadedBytes + streamer.frameBudget - frameBytes) };
+
+        if (streamedMesh.uploadedBytes < vertexBytes){
+            VkDeviceSize vertexEnd{ std::min(end, vertexBytes) };
+            uploadBuffer(vkState.device, uploader, streamedMesh.vertices, streamedMesh.uploadedBytes,
+                         (const uint8_t*)streamedMesh.mesh.vertices + streamedMesh.uploadedBytes, vertexEnd - streamedMesh.uploadedBytes);
+        }
+
+        if (end > vertexBytes){
+            VkDeviceSize indexBegin{ std::max(streamedMesh.uploadedBytes, vertexBytes) - vertexBytes };
+            uploadBuffer(vkState.device, uploader, streamedMesh.indices, indexBegin,
+                         (const uint8_t*)streamedMesh.mesh.indices + indexBegin, end - vertexBytes - indexBegin);
+        }
+
+        frameBytes += end - streamedMesh.uploadedBytes;
+        streamedMesh.uploadedBytes = end;
+
+        if (end == vertexBytes + indexBytes){
+            submittedMeshes.push_back(&streamedMesh);
+            streamer.uploadQueue.pop_front();
+        }
+    }
+
+    submitUploads(vkState.device, uploader);
+
+    for (StreamedMesh* streamedMesh : submittedMeshes){
+        streamedMesh->uploadSerial = uploader.submittedCount;
+        streamer.completingMeshes.push_back(streamedMesh);
+    }
+
+    streamer.streamedBytes += frameBytes;
+    streamer.peakFrameBytes = std::max(streamer.peakFrameBytes, frameBytes);
+
+    uploadsPending(vkState.device, uploader);
+
+    for (size_t i{}; i < streamer.completingMeshes.size();){
+        StreamedMesh& streamedMesh{ *streamer.completingMeshes[i] };
+
+        if (uploader.retiredCount < streamedMesh.uploadSerial){
+            i++;
+            continue;
+        }
+
+        streamedMesh.residency = MESH_RESIDENCY_RESIDENT;
+        streamedMesh.residentMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - streamedMesh.requestTime).count();
+        unloadMesh(streamedMesh.mesh);
+        streamer.pendingCount--;
+
+        streamer.completingMeshes.erase(streamer.completingMeshes.begin() + i);
+    }
+}
+
+// The device must be idle, or at least done with the meshes' buffers
+void stopMeshStreamer(VkDevice device, MeshStreamer& streamer){
+    {
+        std::lock_guard<std::mutex> lock{ streamer.mutex };
+        streamer.running = false;
+    }
+    streamer.wakeCondition.notify_all();
+    streamer.thread.join();
+
+    // Meshes still queued or imported were never handed to the main thread
+    for (StreamedMesh& streamedMesh : streamer.meshes){
+        unloadMesh(streamedMesh.mesh);
+        destroyBuffer(device, streamedMesh.vertices);
+        destroyBuffer(device, streamedMesh.indices);
+    }
+
+    streamer.meshes.clear();
+    streamer.loadQueue.clear();
+    streamer.loadedQueue.clear();
+    streamer.uploadQueue.clear();
+    streamer.completingMeshes.clear();
+}
\ No newline at end of file
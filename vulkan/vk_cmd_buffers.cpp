@@ -16,4 +16,55 @@ VkCommandPool allocateCommandBuffers(VulkanState vkState, VkCommandBuffer* cmdBu
     VK_CHECK(vkAllocateCommandBuffers(vkState.device, &cmdBuffersAllocInfo, cmdBuffers));
 
     return cmdPool;
+}
+
+SecondaryCommandPool createSecondaryCommandPool(VulkanState vkState){
+    VkCommandPoolCreateInfo cmdPoolCreateInfo{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+    cmdPoolCreateInfo.queueFamilyIndex = vkState.renderQueueFamilyID;
+    cmdPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    SecondaryCommandPool pool{};
+    VK_CHECK(vkCreateCommandPool(vkState.device, &cmdPoolCreateInfo, nullptr, &pool.cmdPool));
+
+    return pool;
+}
+
+void destroySecondaryCommandPool(VkDevice device, SecondaryCommandPool& pool){
+    vkDestroyCommandPool(device, pool.cmdPool, nullptr);
+    pool = SecondaryCommandPool{};
+}
+
+// Only the owning thread may call this, command pools are externally synchronized
+VkCommandBuffer acquireSecondaryCommandBuffer(VkDevice device, SecondaryCommandPool& pool){
+    if (pool.usedCount == pool.cmdBuffers.size()){
+        VkCommandBufferAllocateInfo cmdBuffersAllocInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+        cmdBuffersAllocInfo.commandBufferCount = 1;
+        cmdBuffersAllocInfo.commandPool = pool.cmdPool;
+        cmdBuffersAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+
+        VkCommandBuffer cmdBuffer{};
+        VK_CHECK(vkAllocateCommandBuffers(device, &cmdBuffersAllocInfo, &cmdBuffer));
+        pool.cmdBuffers.push_back(cmdBuffer);
+    }
+
+    return pool.cmdBuffers[pool.usedCount++];
+}
+
+void resetSecondaryCommandPool(VkDevice device, SecondaryCommandPool& pool){
+    VK_CHECK(vkResetCommandPool(device, pool.cmdPool, 0));
+    pool.usedCount = 0;
+}
+
+// Issues drawCount tightly strided indirect commands; without multiDrawIndirect each one is its own call
+void cmdDrawIndirect(VkCommandBuffer cmdBuffer, const DeviceCapabilities& caps, VkBuffer buffer, uint32_t drawCount,
+                     uint32_t stride, bool indexed = false){
+    const uint32_t callDrawCount{ caps.multiDrawIndirect ? drawCount : 1u };
+
+    for (uint32_t first{}; first < drawCount; first += callDrawCount){
+        if (indexed){
+            vkCmdDrawIndexedIndirect(cmdBuffer, buffer, (VkDeviceSize)first * stride, callDrawCount, stride);
+        } else {
+            vkCmdDrawIndirect(cmdBuffer, buffer, (VkDeviceSize)first * stride, callDrawCount, stride);
+        }
+    }
 }
\ No newline at end of file
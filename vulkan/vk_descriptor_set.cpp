@@ -1 +1,196 @@
-#include "vk_helpers.h"
\ No newline at end of file
+#include "vk_helpers.h"
+#include <algorithm>
+
+// Default capacities; the pool reserves all of them up front
+const uint32_t kDescriptorHeapStorageBuffers{ 16384 };
+const uint32_t kDescriptorHeapSampledImages{ 4096 };
+
+// Requested capacities are clamped to what the device can bind after update in one set and one stage.
+// retireFrames is the number of frames a released index stays untouched, normally the frames in flight.
+DescriptorHeap createDescriptorHeap(VulkanState vkState, uint32_t storageBufferCapacity, uint32_t sampledImageCapacity,
+                                    uint32_t retireFrames){
+    assert(vkState.caps.descriptorIndexing);
+
+    VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProps{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT };
+    VkPhysicalDeviceProperties2 physDevProps{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+    physDevProps.pNext = &indexingProps;
+    vkGetPhysicalDeviceProperties2(vkState.physicalDevice, &physDevProps);
+
+    DescriptorHeap heap{};
+    heap.capacity[DESCRIPTOR_HEAP_STORAGE_BUFFER] = std::min({ storageBufferCapacity,
+                                                               indexingProps.maxDescriptorSetUpdateAfterBindStorageBuffers,
+                                                               indexingProps.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+    heap.capacity[DESCRIPTOR_HEAP_SAMPLED_IMAGE] = std::min({ sampledImageCapacity,
+                                                              indexingProps.maxDescriptorSetUpdateAfterBindSampledImages,
+                                                              indexingProps.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                                              indexingProps.maxDescriptorSetUpdateAfterBindSamplers,
+                                                              indexingProps.maxPerStageDescriptorUpdateAfterBindSamplers });
+    heap.retireFrames = retireFrames;
+
+    const VkDescriptorType descrTypes[DESCRIPTOR_HEAP_KIND_COUNT]{
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+    };
+
+    VkDescriptorPoolSize descrPoolSizes[DESCRIPTOR_HEAP_KIND_COUNT]{};
+    VkDescriptorSetLayoutBinding bindings[DESCRIPTOR_HEAP_KIND_COUNT]{};
+    VkDescriptorBindingFlagsEXT bindingFlags[DESCRIPTOR_HEAP_KIND_COUNT]{};
+    for (uint32_t i{}; i < DESCRIPTOR_HEAP_KIND_COUNT; i++){
+        descrPoolSizes[i].type = descrTypes[i];
+        descrPoolSizes[i].descriptorCount = std::max(heap.capacity[i], 1u);
+
+        bindings[i].binding = i;
+        bindings[i].descriptorType = descrTypes[i];
+        bindings[i].descriptorCount = std::max(heap.capacity[i], 1u);
+        bindings[i].stageFlags = VK_SHADER_STAGE_ALL;
+
+        // Unregistered slots are never read, and slots may be written while frames using other slots are in flight
+        bindingFlags[i] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+                          VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+                          VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+    }
+
+    VkDescriptorPoolCreateInfo descrPoolCreateInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+    descrPoolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+    descrPoolCreateInfo.maxSets = 1;
+    descrPoolCreateInfo.poolSizeCount = DESCRIPTOR_HEAP_KIND_COUNT;
+    descrPoolCreateInfo.pPoolSizes = descrPoolSizes;
+
+    VK_CHECK(vkCreateDescriptorPool(vkState.device, &descrPoolCreateInfo, nullptr, &heap.descrPool));
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT };
+    bindingFlagsInfo.bindingCount = DESCRIPTOR_HEAP_KIND_COUNT;
+    bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo descrSetLayoutInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+    descrSetLayoutInfo.pNext = &bindingFlagsInfo;
+    descrSetLayoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+    descrSetLayoutInfo.bindingCount = DESCRIPTOR_HEAP_KIND_COUNT;
+    descrSetLayoutInfo.pBindings = bindings;
+
+    VK_CHECK(vkCreateDescriptorSetLayout(vkState.device, &descrSetLayoutInfo, nullptr, &heap.descrLayout));
+
+    VkDescriptorSetAllocateInfo descrSetAllocInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+    descrSetAllocInfo.descriptorPool = heap.descrPool;
+    descrSetAllocInfo.descriptorSetCount = 1;
+    descrSetAllocInfo.pSetLayouts = &heap.descrLayout;
+
+    VK_CHECK(vkAllocateDescriptorSets(vkState.device, &descrSetAllocInfo, &heap.descrSet));
+
+    return heap;
+}
+
+void destroyDescriptorHeap(VkDevice device, DescriptorHeap& heap){
+    vkDestroyDescriptorPool(device, heap.descrPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, heap.descrLayout, nullptr);
+
+    heap = DescriptorHeap{};
+}
+
+uint32_t allocateDescriptorIndex(DescriptorHeap& heap, DescriptorHeapKind kind){
+    if (!heap.freeIndices[kind].empty()){
+        uint32_t index{ heap.freeIndices[kind].back() };
+        heap.freeIndices[kind].pop_back();
+
+        return index;
+    }
+
+    assert(heap.usedCount[kind] < heap.capacity[kind]);
+    return heap.usedCount[kind]++;
+}
+
+// Returns the index shaders use to reach buffer[offset, offset + range) in the storage buffer array
+uint32_t registerStorageBuffer(VkDevice device, DescriptorHeap& heap, const Buffer& buffer,
+                               VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE){
+    uint32_t index{ allocateDescriptorIndex(heap, DESCRIPTOR_HEAP_STORAGE_BUFFER) };
+
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = buffer.buffer;
+    bufferInfo.offset = offset;
+    bufferInfo.range = range;
+
+    VkWriteDescriptorSet descrWrite{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+    descrWrite.dstSet = heap.descrSet;
+    descrWrite.dstBinding = DESCRIPTOR_HEAP_STORAGE_BUFFER;
+    descrWrite.dstArrayElement = index;
+    descrWrite.descriptorCount = 1;
+    descrWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descrWrite.pBufferInfo = &bufferInfo;
+
+    vkUpdateDescriptorSets(device, 1, &descrWrite, 0, nullptr);
+
+    return index;
+}
+
+// Returns the index shaders use to sample imageView, which must be in imageLayout whenever it is sampled
+uint32_t registerSampledImage(VkDevice device, DescriptorHeap& heap, VkSampler sampler, VkImageView imageView,
+                              VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL){
+    uint32_t index{ allocateDescriptorIndex(heap, DESCRIPTOR_HEAP_SAMPLED_IMAGE) };
+
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.sampler = sampler;
+    imageInfo.imageView = imageView;
+    imageInfo.imageLayout = imageLayout;
+
+    VkWriteDescriptorSet descrWrite{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+    descrWrite.dstSet = heap.descrSet;
+    descrWrite.dstBinding = DESCRIPTOR_HEAP_SAMPLED_IMAGE;
+    descrWrite.dstArrayElement = index;
+    descrWrite.descriptorCount = 1;
+    descrWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descrWrite.pImageInfo = &imageInfo;
+
+    vkUpdateDescriptorSets(device, 1, &descrWrite, 0, nullptr);
+
+    return index;
+}
+
+// Frames recorded before this one may still read the index, so it only becomes free retireFrames frames later
+void releaseDescriptor(DescriptorHeap& heap, DescriptorHeapKind kind, uint32_t index){
+    assert(index < heap.usedCount[kind]);
+
+    heap.retired.push_back({ kind, index, heap.frameID + heap.retireFrames });
+}
+
+// Called once per frame after waiting for its fence and before recording; frees the indices whose last readers have completed
+void beginDescriptorHeapFrame(DescriptorHeap& heap, uint64_t frameID){
+    heap.frameID = frameID;
+
+    while (!heap.retired.empty() && heap.retired.front().reuseFrameID <= frameID){
+        const RetiredDescriptor& retired{ heap.retired.front() };
+        heap.freeIndices[retired.kind].push_back(retired.index);
+
+        heap.retired.pop_front();
+    }
+}
+
+VkDescriptorSetLayout createComputeDescriptorSetLayout(VkDevice device, const VkDescriptorType* types, uint32_t bindingCount){
+    std::vector<VkDescriptorSetLayoutBinding> bindings(bindingCount);
+    for (uint32_t i{}; i < bindingCount; i++){
+        bindings[i].binding = i;
+        bindings[i].descriptorType = types[i];
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo descrSetLayoutInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+    descrSetLayoutInfo.bindingCount = bindingCount;
+    descrSetLayoutInfo.pBindings = bindings.data();
+
+    VkDescriptorSetLayout descrSetLayout{};
+    VK_CHECK(vkCreateDescriptorSetLayout(device, &descrSetLayoutInfo, nullptr, &descrSetLayout));
+
+    return descrSetLayout;
+}
+
+VkDescriptorSet allocateDescriptorSet(VkDevice device, VkDescriptorPool descrPool, VkDescriptorSetLayout descrSetLayout){
+    VkDescriptorSetAllocateInfo descrSetAllocInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+    descrSetAllocInfo.descriptorPool = descrPool;
+    descrSetAllocInfo.descriptorSetCount = 1;
+    descrSetAllocInfo.pSetLayouts = &descrSetLayout;
+
+    VkDescriptorSet descrSet{};
+    VK_CHECK(vkAllocateDescriptorSets(device, &descrSetAllocInfo, &descrSet));
+
+    return descrSet;
+}
\ No newline at end of file
@@ -4,6 +4,9 @@
 #include <volk/volk.h>
 #include <assert.h>
 #include <vector>
+#include <deque>
+#include <set>
+#include <map>
 
 #define VK_CHECK(vkCall) \
     do { \
@@ -49,6 +52,27 @@ void destroyDebugReportCallback(VkInstance instance, VkDebugReportCallbackEXT de
 #endif
 }
 
+struct MemoryAllocator;
+
+// Optional features of the selected device, each enabled on the device when supported unless marked as reported
+// only. Fast paths check these and fall back when they are missing.
+struct DeviceCapabilities{
+    char deviceName[VK_MAX_PHYSICAL_DEVICE_NAME_SIZE];
+    VkPhysicalDeviceType deviceType;
+    uint32_t apiVersion;
+    bool calibratedTimestamps;
+    bool drawIndirectCount;
+    bool drawIndirectFirstInstance;
+    bool multiDrawIndirect;
+    bool pipelineStatistics;
+    bool descriptorIndexing;
+    bool storageBuffer8Bit;     // Reported only
+    bool storageBuffer16Bit;    // Reported only
+    bool timelineSemaphores;    // Reported only
+    uint32_t subgroupSize;
+    VkSubgroupFeatureFlags subgroupComputeOperations;  // 0 when compute shaders can't use subgroup operations
+};
+
 struct VulkanState{
     VkInstance instance;
     VkPhysicalDevice physicalDevice;
@@ -56,6 +80,10 @@ struct VulkanState{
     VkDebugReportCallbackEXT debugCallback;
     VkQueue renderQueue;
     uint32_t renderQueueFamilyID;
+    VkQueue transferQueue;
+    uint32_t transferQueueFamilyID; // -1 when there is no separate transfer family
+    DeviceCapabilities caps;
+    MemoryAllocator* allocator;
 };
 
 struct VulkanSwapchain{
@@ -63,20 +91,308 @@ struct VulkanSwapchain{
     VkSurfaceKHR surface;
     VkSurfaceFormatKHR surfaceFormat;
     VkExtent2D extent;
+    VkPresentModeKHR presentMode;
     std::vector<VkImage> images;
     std::vector<VkImageView> imageViews;
 };
 
+const uint32_t kMaxVertexAttributes{ 4 };
+const uint32_t kMaxShaderSwitches{ 4 };
+
+// Leaves a switch to the shader's runtime branch on the uniform that carries the same value
+const uint32_t kShaderSwitchDynamic{ 0xffffffff };
+
+// Values of a shader's specialization constants, switches[i] going to constant_id i. Switches past switchCount, or
+// set to kShaderSwitchDynamic, keep the shader's defaults; a zero-initialized permutation specializes nothing.
+struct ShaderPermutation{
+    uint32_t switchCount;
+    uint32_t switches[kMaxShaderSwitches];
+};
+
+struct GraphicsPipelineDesc{
+    const char* vertexShaderFile;
+    const char* fragmentShaderFile;
+    VkRenderPass renderPass;
+    VkPipelineLayout pipelineLayout;
+    VkViewport viewport;
+    bool dynamicViewport;       // viewport and scissor are set per command buffer, so the pipeline survives resizes
+    VkCullModeFlags cullMode;
+    VkFrontFace frontFace;
+    VkBool32 blendEnable;
+
+    VkBool32 depthTest;
+    VkBool32 depthWrite;
+    VkCompareOp depthCompareOp;
+    bool depthOnly;             // no fragment shader and no color writes, for depth prepasses
+
+    // Fixed-function vertex input from one binding; without attributes the shader pulls its vertices from buffers
+    VkVertexInputBindingDescription vertexBinding;
+    uint32_t vertexAttributeCount;
+    VkVertexInputAttributeDescription vertexAttributes[kMaxVertexAttributes];
+
+    ShaderPermutation vertexPermutation;   // specialization constants of the vertex shader
+};
+
 struct GraphicsPipeline{
     VkPipeline pipeline;
     VkShaderModule vertexShader;
     VkShaderModule fragmentShader;
 };
 
+// Pipelines of one description, one per vertex shader permutation, keyed by shaderPermutationKey
+struct PermutedPipelines{
+    GraphicsPipelineDesc desc;
+    std::map<uint64_t, GraphicsPipeline> pipelines;
+};
+
+struct ComputePipeline{
+    VkPipeline pipeline;
+    VkShaderModule computeShader;
+};
+
+// Secondary command buffers of one thread for one frame in flight; the pool is reset as a whole once the frame's fence
+// has signaled, and buffers are reused in allocation order
+struct SecondaryCommandPool{
+    VkCommandPool cmdPool;
+    std::vector<VkCommandBuffer> cmdBuffers;
+    uint32_t usedCount;
+};
+
+enum MemoryStrategy : uint32_t{
+    MEMORY_STRATEGY_GENERAL,    // buddy allocator inside shared blocks, or a dedicated block for large requests
+    MEMORY_STRATEGY_LINEAR,     // bump allocation, released all at once
+    MEMORY_STRATEGY_POOL        // fixed-size slots
+};
+
+struct MemoryPool;
+
+struct MemoryAllocation{
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    void* data;
+
+    MemoryAllocator* allocator;
+    MemoryPool* pool;
+    MemoryStrategy strategy;
+    uint32_t blockID;
+};
+
+struct MemoryBlockAllocation{
+    uint32_t order;
+    VkDeviceSize size;
+    void* userData;
+};
+
+struct MemoryBlock{
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    void* data;
+    uint32_t memoryTypeIndex;
+    MemoryStrategy strategy;
+    bool imageBlock;
+    bool dedicated;
+
+    // Buddy state for general blocks: free offsets per order and live allocations by offset
+    std::vector<std::set<VkDeviceSize>> freeLists;
+    std::map<VkDeviceSize, MemoryBlockAllocation> allocations;
+    VkDeviceSize allocatedBytes;
+};
+
+struct MemoryTypeStats{
+    VkDeviceSize reservedBytes;
+    VkDeviceSize usedBytes;
+    uint32_t allocationCount;
+    uint32_t blockCount;
+};
+
+struct MemoryHeapStats{
+    VkDeviceSize reservedBytes;
+    VkDeviceSize usedBytes;
+    uint32_t allocationCount;
+    uint32_t blockCount;
+    float fragmentation;    // 1 - largest free range / total free space in general blocks
+};
+
+struct MemoryAllocator{
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties memProperties;
+    VkDeviceSize blockSize;
+
+    // Freed blocks leave a slot with a null memory handle so block IDs stay stable
+    std::vector<MemoryBlock> blocks;
+    MemoryTypeStats typeStats[VK_MAX_MEMORY_TYPES];
+};
+
+struct MemoryPool{
+    MemoryAllocator* allocator;
+    VkMemoryPropertyFlags memoryFlags;
+    VkDeviceSize slotSize;
+    uint32_t slotsPerBlock;
+    uint32_t memoryTypeIndex;
+
+    std::vector<uint32_t> blockIDs;
+    std::vector<std::pair<uint32_t, VkDeviceSize>> freeSlots;
+};
+
+struct LinearAllocator{
+    MemoryAllocator* allocator;
+    VkMemoryPropertyFlags memoryFlags;
+    uint32_t memoryTypeIndex;       // -1 until the first allocation picks it, along with the block
+    uint32_t blockID;
+    VkDeviceSize offset;
+    VkDeviceSize capacity;
+    VkDeviceSize allocatedBytes;    // offset without the alignment padding, as counted in the type stats
+    uint32_t allocationCount;
+};
+
 struct Buffer{
     VkBuffer buffer;
-    VkDeviceMemory memory;
+    MemoryAllocation allocation;
     void* data;
+
+    // Creation parameters, to create the buffer again when its memory moves
+    VkDeviceSize size;
+    VkBufferUsageFlags usage;
+    uint32_t sharedQueueFamilyID;
+};
+
+// One persistently mapped uniform buffer split into a region per frame in flight. Each frame bump-allocates its
+// uniform data from its region and binds it with a dynamic offset, so the descriptor set never changes.
+struct UniformRing{
+    Buffer buffer;
+    VkDeviceSize alignment;     // minUniformBufferOffsetAlignment
+    VkDeviceSize frameCapacity;
+    uint32_t frameCount;
+
+    VkDeviceSize frameBegin;
+    VkDeviceSize head;
+    VkDeviceSize peakFrameBytes;
+};
+
+struct StagingBatch{
+    VkCommandBuffer cmdBuffer;
+    VkFence fence;
+    VkDeviceSize endOffset;
+};
+
+struct StagingUploader{
+    Buffer stagingBuffer;
+    VkDeviceSize capacity;
+    VkDeviceSize head;
+    VkDeviceSize tail;
+
+    VkQueue queue;
+    uint32_t queueFamilyID;
+    VkCommandPool cmdPool;
+
+    std::vector<StagingBatch> batches;
+    std::vector<uint32_t> freeBatches;
+    std::deque<uint32_t> pendingBatches;
+    uint32_t recordingBatch;
+    bool recording;
+
+    // Batches retire in submission order, so a copy has completed once retiredCount reaches the submittedCount
+    // that followed its submitUploads
+    uint64_t submittedCount;
+    uint64_t retiredCount;
+};
+
+// Callback state of moveBufferMemory: copies run on the uploader's queue
+struct BufferMover{
+    VulkanState vkState;
+    StagingUploader* uploader;
+    uint32_t moveCount;
+};
+
+struct Image{
+    VkImage image;
+    VkImageView imageView;
+    MemoryAllocation allocation;
+};
+
+enum DescriptorHeapKind : uint32_t{
+    DESCRIPTOR_HEAP_STORAGE_BUFFER,     // binding 0
+    DESCRIPTOR_HEAP_SAMPLED_IMAGE,      // binding 1, combined with a sampler
+    DESCRIPTOR_HEAP_KIND_COUNT
+};
+
+struct RetiredDescriptor{
+    DescriptorHeapKind kind;
+    uint32_t index;
+    uint64_t reuseFrameID;
+};
+
+// One update-after-bind set of descriptor arrays that is bound once per frame; resources register into it and are
+// addressed by their stable index. Released indices are reused only after the frames that may still read them are done.
+struct DescriptorHeap{
+    VkDescriptorSetLayout descrLayout;
+    VkDescriptorPool descrPool;
+    VkDescriptorSet descrSet;
+
+    uint32_t capacity[DESCRIPTOR_HEAP_KIND_COUNT];
+    uint32_t usedCount[DESCRIPTOR_HEAP_KIND_COUNT];     // indices handed out so far, free or not
+    std::vector<uint32_t> freeIndices[DESCRIPTOR_HEAP_KIND_COUNT];
+
+    std::deque<RetiredDescriptor> retired;
+    uint32_t retireFrames;
+    uint64_t frameID;
+};
+
+// Complete ("ph": "X") event of a Chrome trace; times are microseconds on the steady_clock timeline
+struct TraceEvent{
+    const char* name;
+    uint32_t threadID;
+    double beginUs;
+    double durationUs;
+};
+
+struct GPUZone{
+    const char* name;
+    uint32_t depth;
+    uint32_t beginQuery;
+    uint32_t endQuery;
+};
+
+struct GPUZoneResult{
+    const char* name;
+    uint32_t depth;
+    double beginUs;
+    double durationMs;
+};
+
+struct GPUProfilerFrame{
+    VkQueryPool queryPool;
+    uint32_t queryCount;
+    std::vector<GPUZone> zones;
+    uint64_t frameID;
+    bool submitted;
+};
+
+struct GPUProfiler{
+    VkDevice device;
+    VkPhysicalDevice physicalDevice;
+    uint32_t maxQueries;
+    double timestampPeriod;
+    uint64_t timestampMask;     // only timestampValidBits of a timestamp are meaningful
+
+    // Ring of query pools, one per frame in flight, read back when the slot is reused
+    std::vector<GPUProfilerFrame> frames;
+    uint32_t frameIndex;
+    uint64_t frameCounter;
+    std::vector<uint32_t> zoneStack;
+
+    // A GPU tick and the CPU time (us) it corresponds to
+    bool calibratedTimestamps;
+    uint64_t calibrationTicks;
+    double calibrationUs;
+
+    std::vector<GPUZoneResult> results;
+    uint64_t resolvedFrameID;
+    double resolvedFrameTimeMs;
+
+    bool captureTrace;
+    std::vector<TraceEvent> traceEvents;
 };
 
 #endif // VK_HELPERS_H
\ No newline at end of file
@@ -1,25 +1,177 @@
 #include "vk_helpers.h"
+#ifndef RB_HEADLESS
 #include <GLFW/glfw3.h>
+#endif
 #include <vector>
+#include <utility>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+
+const char* physicalDeviceTypeName(VkPhysicalDeviceType deviceType){
+    switch (deviceType){
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return "discrete";
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated";
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return "virtual";
+        case VK_PHYSICAL_DEVICE_TYPE_CPU: return "cpu";
+        default: return "other";
+    }
+}
+
+bool hasExtension(const std::vector<VkExtensionProperties>& extensions, const char* name){
+    for (const VkExtensionProperties& extension : extensions){
+        if (strcmp(extension.extensionName, name) == 0){
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::vector<VkExtensionProperties> enumerateDeviceExtensions(VkPhysicalDevice physicalDevice){
+    uint32_t extensionCount{};
+    VK_CHECK(vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr));
+
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    VK_CHECK(vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data()));
+
+    return extensions;
+}
+
+// First family that does graphics and transfer, or -1
+uint32_t findRenderQueueFamily(VkPhysicalDevice physicalDevice){
+    uint32_t queueFamilyCount{};
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    for (uint32_t i{}; i < queueFamilyCount; i++){
+        if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT && queueFamilies[i].queueFlags & VK_QUEUE_TRANSFER_BIT){
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// Discrete over integrated over virtual over CPU; 0 for devices the renderer can't run on
+uint32_t scorePhysicalDevice(VkInstance instance, VkPhysicalDevice physicalDevice){
+    VkPhysicalDeviceProperties props{};
+    vkGetPhysicalDeviceProperties(physicalDevice, &props);
+
+    if (props.apiVersion < VK_API_VERSION_1_1 || !props.limits.timestampComputeAndGraphics){
+        return 0;
+    }
+
+    uint32_t renderQueueFamilyID{ findRenderQueueFamily(physicalDevice) };
+    if (renderQueueFamilyID == -1){
+        return 0;
+    }
+
+#ifndef RB_HEADLESS
+    if (!hasExtension(enumerateDeviceExtensions(physicalDevice), VK_KHR_SWAPCHAIN_EXTENSION_NAME) ||
+        !glfwGetPhysicalDevicePresentationSupport(instance, physicalDevice, renderQueueFamilyID)){
+        return 0;
+    }
+#endif
+
+    switch (props.deviceType){
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return 4;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 3;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return 2;
+        default: return 1;
+    }
+}
+
+// The selector is a device index or a case insensitive part of the device name; the RB_DEVICE environment variable
+// is used when there is none. An index that isn't a usable device is an error. Without a usable name match the highest
+// scoring device wins, the first listed on ties.
+VkPhysicalDevice selectPhysicalDevice(VkInstance instance, const char* selector){
+    uint32_t physDevCount{};
+    VK_CHECK(vkEnumeratePhysicalDevices(instance, &physDevCount, nullptr));
+    assert(physDevCount > 0);
+
+    std::vector<VkPhysicalDevice> physicalDevices(physDevCount);
+    VK_CHECK(vkEnumeratePhysicalDevices(instance, &physDevCount, physicalDevices.data()));
+
+    if (!selector){
+        selector = getenv("RB_DEVICE");
+    }
+
+    // A pure integer only ever selects by index, or "1" would also match any device with a 1 in its name
+    if (selector && *selector){
+        char* indexEnd{};
+        unsigned long index{ strtoul(selector, &indexEnd, 10) };
+
+        if (*indexEnd == '\0'){
+            if (index >= physDevCount || scorePhysicalDevice(instance, physicalDevices[index]) == 0){
+                fprintf(stderr, "Device %s is not a usable device, %u devices are listed\n", selector, physDevCount);
+                exit(1);
+            }
+
+            return physicalDevices[index];
+        }
+    }
+
+    VkPhysicalDevice bestDevice{ VK_NULL_HANDLE };
+    uint32_t bestScore{};
+
+    for (uint32_t i{}; i < physDevCount; i++){
+        uint32_t score{ scorePhysicalDevice(instance, physicalDevices[i]) };
+
+        if (selector && *selector && score > 0){
+            VkPhysicalDeviceProperties props{};
+            vkGetPhysicalDeviceProperties(physicalDevices[i], &props);
+
+            bool matches{};
+            for (const char* name{ props.deviceName }; !matches && *name; name++){
+                matches = strncasecmp(name, selector, strlen(selector)) == 0;
+            }
+
+            if (matches){
+                return physicalDevices[i];
+            }
+        }
+
+        if (score > bestScore){
+            bestDevice = physicalDevices[i];
+            bestScore = score;
+        }
+    }
 
-VulkanState initializeVulkanState(){
+    if (selector && *selector){
+        fprintf(stderr, "No usable device matches \"%s\", selecting by type\n", selector);
+    }
+
+    assert(bestDevice != VK_NULL_HANDLE);
+
+    return bestDevice;
+}
+
+VulkanState initializeVulkanState(const char* deviceSelector = nullptr){
     VK_CHECK(volkInitialize());
 
     VulkanState vkState{};
     vkState.renderQueueFamilyID = -1;
+    vkState.transferQueueFamilyID = -1;
 
     VkApplicationInfo appInfo{ VK_STRUCTURE_TYPE_APPLICATION_INFO };
     appInfo.apiVersion = VK_API_VERSION_1_1;
 
     std::vector<const char*> instanceExtensionNames{};
+#ifndef RB_HEADLESS
     uint32_t reqExtCount{};
     const char** requiredExtensions = glfwGetRequiredInstanceExtensions(&reqExtCount);
 
     for (int i{}; i < reqExtCount; i++){
         instanceExtensionNames.push_back(requiredExtensions[i]);
     }
+#endif
 
+#ifdef __APPLE__
     instanceExtensionNames.push_back("VK_KHR_portability_enumeration");
+#endif
 #ifdef RB_DEBUG
     instanceExtensionNames.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 #endif
@@ -31,7 +183,9 @@ VulkanState initializeVulkanState(){
     };
 
     VkInstanceCreateInfo instanceInfo{ VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO };
+#ifdef __APPLE__
     instanceInfo.flags |= VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
+#endif
     instanceInfo.pApplicationInfo = &appInfo;
     instanceInfo.enabledLayerCount = sizeof(layerNames) / sizeof(layerNames[0]);
     instanceInfo.ppEnabledLayerNames = layerNames;
@@ -44,15 +198,8 @@ VulkanState initializeVulkanState(){
 
     vkState.debugCallback = registerDebugReport(vkState.instance);
 
-    // TODO: select proper physical device
-    uint32_t physDevCount{};
-    VK_CHECK(vkEnumeratePhysicalDevices(vkState.instance, &physDevCount, nullptr));
-    assert(physDevCount > 0);
-
-    std::vector<VkPhysicalDevice> physicalDevices(physDevCount);
-    VK_CHECK(vkEnumeratePhysicalDevices(vkState.instance, &physDevCount, physicalDevices.data()));
-
-    vkState.physicalDevice = physicalDevices[0];
+    vkState.physicalDevice = selectPhysicalDevice(vkState.instance, deviceSelector);
+    vkState.renderQueueFamilyID = findRenderQueueFamily(vkState.physicalDevice);
 
     uint32_t queueFamilyPropsCount{};
     vkGetPhysicalDeviceQueueFamilyProperties2(vkState.physicalDevice, &queueFamilyPropsCount, nullptr);
@@ -65,33 +212,167 @@ VulkanState initializeVulkanState(){
 
     vkGetPhysicalDeviceQueueFamilyProperties2(vkState.physicalDevice, &queueFamilyPropsCount, queueFamilyProps.data());
 
+    // Prefer a dedicated transfer family (DMA engine), then any non-graphics family that can transfer
     for (int i{}; i < queueFamilyPropsCount; i++){
-        if (queueFamilyProps[i].queueFamilyProperties.queueFlags & VK_QUEUE_GRAPHICS_BIT &&
-            queueFamilyProps[i].queueFamilyProperties.queueFlags & VK_QUEUE_TRANSFER_BIT){
-            vkState.renderQueueFamilyID = i;
-            break;
+        VkQueueFlags queueFlags{ queueFamilyProps[i].queueFamilyProperties.queueFlags };
+
+        if ((queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFlags & VK_QUEUE_GRAPHICS_BIT)){
+            bool dedicated{ !(queueFlags & VK_QUEUE_COMPUTE_BIT) };
+
+            if (vkState.transferQueueFamilyID == -1 || dedicated){
+                vkState.transferQueueFamilyID = i;
+            }
+
+            if (dedicated){
+                break;
+            }
         }
     }
 
-    assert(vkState.renderQueueFamilyID != -1);
-
     float queuePriorities[]{ 1.0f };
 
-    VkDeviceQueueCreateInfo queueCreateInfo{ VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO };
-    queueCreateInfo.queueCount = 1;
-    queueCreateInfo.queueFamilyIndex = vkState.renderQueueFamilyID;
-    queueCreateInfo.pQueuePriorities = queuePriorities;
+    VkDeviceQueueCreateInfo queueCreateInfos[2]{};
+    queueCreateInfos[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueCreateInfos[0].queueCount = 1;
+    queueCreateInfos[0].queueFamilyIndex = vkState.renderQueueFamilyID;
+    queueCreateInfos[0].pQueuePriorities = queuePriorities;
+
+    queueCreateInfos[1].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueCreateInfos[1].queueCount = 1;
+    queueCreateInfos[1].queueFamilyIndex = vkState.transferQueueFamilyID;
+    queueCreateInfos[1].pQueuePriorities = queuePriorities;
+
+    DeviceCapabilities& caps{ vkState.caps };
+
+    VkPhysicalDeviceSubgroupProperties subgroupProps{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES };
+    VkPhysicalDeviceProperties2 physDevProps{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+    physDevProps.pNext = &subgroupProps;
+    vkGetPhysicalDeviceProperties2(vkState.physicalDevice, &physDevProps);
+
+    strcpy(caps.deviceName, physDevProps.properties.deviceName);
+    caps.deviceType = physDevProps.properties.deviceType;
+    caps.apiVersion = physDevProps.properties.apiVersion;
+    caps.subgroupSize = subgroupProps.subgroupSize;
+    caps.subgroupComputeOperations = subgroupProps.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT ? subgroupProps.supportedOperations : 0;
+
+    std::vector<VkExtensionProperties> deviceExtensions{ enumerateDeviceExtensions(vkState.physicalDevice) };
+
+    std::vector<const char*> deviceExtensionNames{};
+#ifndef RB_HEADLESS
+    deviceExtensionNames.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+#endif
+
+    // Implementations that aren't fully conformant (MoltenVK) expose this, and it must then be enabled
+    if (hasExtension(deviceExtensions, "VK_KHR_portability_subset")){
+        deviceExtensionNames.push_back("VK_KHR_portability_subset");
+    }
+
+    // Optional: lets the GPU profiler put timestamps on the CPU timeline without a round trip
+    caps.calibratedTimestamps = hasExtension(deviceExtensions, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+
+    // Optional: GPU culling falls back to a fixed-count vkCmdDrawIndirect over cleared commands
+    caps.drawIndirectCount = hasExtension(deviceExtensions, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+
+    // Optional: large update-after-bind descriptor arrays for the bindless descriptor heap
+    const bool descriptorIndexingExtension{ hasExtension(deviceExtensions, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) };
+    const bool storage8BitExtension{ hasExtension(deviceExtensions, VK_KHR_8BIT_STORAGE_EXTENSION_NAME) };
+    const bool timelineSemaphoreExtension{ hasExtension(deviceExtensions, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) };
+
+    // Each chain only holds the structures of extensions the device has, 16-bit storage being core in 1.1
+    void* supportedFeatureChain{};
+    auto chainSupported = [&](auto& features){
+        features.pNext = supportedFeatureChain;
+        supportedFeatureChain = &features;
+    };
+
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT supportedIndexingFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT };
+    VkPhysicalDevice8BitStorageFeaturesKHR supported8BitFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_8BIT_STORAGE_FEATURES_KHR };
+    VkPhysicalDevice16BitStorageFeatures supported16BitFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES };
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR supportedTimelineFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR };
+
+    chainSupported(supported16BitFeatures);
+    if (descriptorIndexingExtension){
+        chainSupported(supportedIndexingFeatures);
+    }
+    if (storage8BitExtension){
+        chainSupported(supported8BitFeatures);
+    }
+    if (timelineSemaphoreExtension){
+        chainSupported(supportedTimelineFeatures);
+    }
+
+    VkPhysicalDeviceFeatures2 supportedFeatures2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+    supportedFeatures2.pNext = supportedFeatureChain;
+
+    vkGetPhysicalDeviceFeatures2(vkState.physicalDevice, &supportedFeatures2);
+    const VkPhysicalDeviceFeatures& supportedFeatures{ supportedFeatures2.features };
+
+    // Optional: vertex shader invocation counts for the vertex input comparison
+    VkPhysicalDeviceFeatures enabledFeatures{};
+    enabledFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+    caps.pipelineStatistics = supportedFeatures.pipelineStatisticsQuery;
 
-    const char* deviceExtensionNames[]{
-        "VK_KHR_portability_subset",
-        "VK_KHR_swapchain"
+    // Indirect draws of more than one command, as the culling paths issue without a GPU-side count
+    enabledFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    caps.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+
+    // Optional: GPU-generated draws of single instances, for occlusion culling
+    enabledFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+    caps.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+
+    void* enabledFeatureChain{};
+    auto chainEnabled = [&](auto& features){
+        features.pNext = enabledFeatureChain;
+        enabledFeatureChain = &features;
     };
 
+    // The heap is indexed with push constants, which are dynamically uniform, so non-uniform indexing isn't needed
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT enabledIndexingFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT };
+    caps.descriptorIndexing = descriptorIndexingExtension &&
+                              supportedIndexingFeatures.runtimeDescriptorArray &&
+                              supportedIndexingFeatures.descriptorBindingPartiallyBound &&
+                              supportedIndexingFeatures.descriptorBindingUpdateUnusedWhilePending &&
+                              supportedIndexingFeatures.descriptorBindingStorageBufferUpdateAfterBind &&
+                              supportedIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+                              supportedFeatures.shaderStorageBufferArrayDynamicIndexing &&
+                              supportedFeatures.shaderSampledImageArrayDynamicIndexing;
+
+    if (caps.descriptorIndexing){
+        enabledIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+        enabledIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+        enabledIndexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        enabledIndexingFeatures.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        enabledIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        enabledFeatures.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+        enabledFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+        chainEnabled(enabledIndexingFeatures);
+    }
+
+    // Reported only: no shader reads 8 or 16-bit storage and frames are paced with fences, so these stay disabled
+    // until a path uses them
+    caps.storageBuffer8Bit = storage8BitExtension && supported8BitFeatures.storageBuffer8BitAccess;
+    caps.storageBuffer16Bit = supported16BitFeatures.storageBuffer16BitAccess;
+    caps.timelineSemaphores = timelineSemaphoreExtension && supportedTimelineFeatures.timelineSemaphore;
+
+    const std::pair<bool, const char*> optionalExtensions[]{
+        { caps.calibratedTimestamps, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME },
+        { caps.drawIndirectCount, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME },
+        { caps.descriptorIndexing, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME },
+    };
+
+    for (const std::pair<bool, const char*>& extension : optionalExtensions){
+        if (extension.first){
+            deviceExtensionNames.push_back(extension.second);
+        }
+    }
+
     VkDeviceCreateInfo devInfo{ VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
-    devInfo.queueCreateInfoCount = 1;
-    devInfo.pQueueCreateInfos = &queueCreateInfo;
-    devInfo.enabledExtensionCount = sizeof(deviceExtensionNames) / sizeof(deviceExtensionNames[0]);
-    devInfo.ppEnabledExtensionNames = deviceExtensionNames;
+    devInfo.pNext = enabledFeatureChain;
+    devInfo.queueCreateInfoCount = vkState.transferQueueFamilyID != -1 ? 2 : 1;
+    devInfo.pQueueCreateInfos = queueCreateInfos;
+    devInfo.enabledExtensionCount = deviceExtensionNames.size();
+    devInfo.ppEnabledExtensionNames = deviceExtensionNames.data();
+    devInfo.pEnabledFeatures = &enabledFeatures;
 
     VK_CHECK(vkCreateDevice(vkState.physicalDevice, &devInfo, nullptr, &vkState.device));
 
@@ -101,6 +382,11 @@ VulkanState initializeVulkanState(){
 
     vkGetDeviceQueue2(vkState.device, &queueInfo, &vkState.renderQueue);
 
+    if (vkState.transferQueueFamilyID != -1){
+        queueInfo.queueFamilyIndex = vkState.transferQueueFamilyID;
+        vkGetDeviceQueue2(vkState.device, &queueInfo, &vkState.transferQueue);
+    }
+
     return vkState;
 }
 
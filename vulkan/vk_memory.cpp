@@ -1,4 +1,6 @@
 #include "vk_helpers.h"
+#include <string.h>
+#include <algorithm>
 
 uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t memoryTypeMask, VkMemoryPropertyFlags memoryFlags){
     VkPhysicalDeviceMemoryProperties memProperties;
@@ -6,7 +8,7 @@ uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t memoryTypeMask
 
     for (int i{}; i < memProperties.memoryTypeCount; i++){
         if ((memoryTypeMask & (1 << i)) &&
-            (memProperties.memoryTypes[i].propertyFlags & memoryFlags)){
+            (memProperties.memoryTypes[i].propertyFlags & memoryFlags) == memoryFlags){
             return i;
         }
     }
@@ -15,9 +17,461 @@ uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t memoryTypeMask
     return -1;
 }
 
-Buffer createBuffer(VulkanState vkState, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryFlags){
-    Buffer buffer{};
+const VkDeviceSize kDefaultMemoryBlockSize{ 64 * 1024 * 1024 };
+const uint32_t kMinBuddyOrder{ 8 }; // 256 bytes
+
+uint32_t log2Ceil(VkDeviceSize value){
+    uint32_t order{};
+    while ((VkDeviceSize(1) << order) < value){
+        order++;
+    }
+
+    return order;
+}
+
+MemoryAllocator createMemoryAllocator(VulkanState vkState, VkDeviceSize blockSize = kDefaultMemoryBlockSize){
+    assert((blockSize & (blockSize - 1)) == 0);
+
+    MemoryAllocator allocator{};
+    allocator.device = vkState.device;
+    allocator.blockSize = blockSize;
+    vkGetPhysicalDeviceMemoryProperties(vkState.physicalDevice, &allocator.memProperties);
+
+    return allocator;
+}
+
+uint32_t createMemoryBlock(MemoryAllocator& allocator, uint32_t memoryTypeIndex, VkDeviceSize size,
+                           MemoryStrategy strategy, bool imageBlock, bool dedicated){
+    MemoryBlock block{};
+    block.size = size;
+    block.memoryTypeIndex = memoryTypeIndex;
+    block.strategy = strategy;
+    block.imageBlock = imageBlock;
+    block.dedicated = dedicated;
+
+    VkMemoryAllocateInfo allocInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+    allocInfo.allocationSize = size;
+
+    VK_CHECK(vkAllocateMemory(allocator.device, &allocInfo, nullptr, &block.memory));
+
+    // Blocks are mapped once for their whole lifetime, sub-allocations just offset into the mapping
+    if (allocator.memProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT){
+        VK_CHECK(vkMapMemory(allocator.device, block.memory, 0, size, 0, &block.data));
+    }
+
+    if (strategy == MEMORY_STRATEGY_GENERAL && !dedicated){
+        uint32_t maxOrder{ log2Ceil(size) };
+        block.freeLists.resize(maxOrder - kMinBuddyOrder + 1);
+        block.freeLists[maxOrder - kMinBuddyOrder].insert(0);
+    }
+
+    allocator.typeStats[memoryTypeIndex].reservedBytes += size;
+    allocator.typeStats[memoryTypeIndex].blockCount++;
+
+    for (uint32_t i{}; i < allocator.blocks.size(); i++){
+        if (allocator.blocks[i].memory == VK_NULL_HANDLE){
+            allocator.blocks[i] = std::move(block);
+            return i;
+        }
+    }
+
+    allocator.blocks.push_back(std::move(block));
+    return allocator.blocks.size() - 1;
+}
+
+void releaseMemoryBlock(MemoryAllocator& allocator, uint32_t blockID){
+    MemoryBlock& block{ allocator.blocks[blockID] };
+
+    allocator.typeStats[block.memoryTypeIndex].reservedBytes -= block.size;
+    allocator.typeStats[block.memoryTypeIndex].blockCount--;
+
+    vkFreeMemory(allocator.device, block.memory, nullptr);
+    block = MemoryBlock{};
+}
+
+bool allocateBuddy(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset, uint32_t& order){
+    order = std::max(std::max(log2Ceil(size), log2Ceil(alignment)), kMinBuddyOrder);
+
+    uint32_t freeOrder{ order };
+    while (freeOrder - kMinBuddyOrder < block.freeLists.size() && block.freeLists[freeOrder - kMinBuddyOrder].empty()){
+        freeOrder++;
+    }
+
+    if (freeOrder - kMinBuddyOrder >= block.freeLists.size()){
+        return false;
+    }
+
+    std::set<VkDeviceSize>& freeList{ block.freeLists[freeOrder - kMinBuddyOrder] };
+    offset = *freeList.begin();
+    freeList.erase(freeList.begin());
+
+    // Split down to the requested order, returning the upper halves to the free lists
+    while (freeOrder > order){
+        freeOrder--;
+        block.freeLists[freeOrder - kMinBuddyOrder].insert(offset + (VkDeviceSize(1) << freeOrder));
+    }
+
+    block.allocatedBytes += VkDeviceSize(1) << order;
+
+    return true;
+}
+
+void freeBuddy(MemoryBlock& block, VkDeviceSize offset, uint32_t order){
+    block.allocatedBytes -= VkDeviceSize(1) << order;
+
+    // Merge with the buddy as long as it is free
+    while (order - kMinBuddyOrder + 1 < block.freeLists.size()){
+        VkDeviceSize buddyOffset{ offset ^ (VkDeviceSize(1) << order) };
+        std::set<VkDeviceSize>& freeList{ block.freeLists[order - kMinBuddyOrder] };
+
+        auto buddy{ freeList.find(buddyOffset) };
+        if (buddy == freeList.end()){
+            break;
+        }
+
+        freeList.erase(buddy);
+        offset = std::min(offset, buddyOffset);
+        order++;
+    }
+
+    block.freeLists[order - kMinBuddyOrder].insert(offset);
+}
+
+MemoryAllocation makeAllocation(MemoryAllocator& allocator, uint32_t blockID, VkDeviceSize offset, VkDeviceSize size, MemoryStrategy strategy){
+    MemoryBlock& block{ allocator.blocks[blockID] };
+
+    MemoryAllocation allocation{};
+    allocation.memory = block.memory;
+    allocation.offset = offset;
+    allocation.size = size;
+    allocation.data = block.data ? (uint8_t*)block.data + offset : nullptr;
+    allocation.allocator = &allocator;
+    allocation.strategy = strategy;
+    allocation.blockID = blockID;
+
+    allocator.typeStats[block.memoryTypeIndex].usedBytes += size;
+    allocator.typeStats[block.memoryTypeIndex].allocationCount++;
 
+    return allocation;
+}
+
+// General purpose allocation: buddy sub-allocation from shared blocks, dedicated blocks for large requests
+MemoryAllocation allocateMemory(MemoryAllocator& allocator, VkPhysicalDevice physicalDevice, VkMemoryRequirements reqs,
+                                VkMemoryPropertyFlags memoryFlags, bool image, void* userData = nullptr){
+    uint32_t memoryTypeIndex{ findMemoryType(physicalDevice, reqs.memoryTypeBits, memoryFlags) };
+
+    // Small heaps (e.g. the 256MB device-local host-visible heap) get smaller blocks
+    VkDeviceSize heapSize{ allocator.memProperties.memoryHeaps[allocator.memProperties.memoryTypes[memoryTypeIndex].heapIndex].size };
+    VkDeviceSize blockSize{ allocator.blockSize };
+    while (blockSize > (VkDeviceSize(1) << 20) && blockSize > heapSize / 8){
+        blockSize /= 2;
+    }
+
+    if (reqs.size > blockSize / 2){
+        uint32_t blockID{ createMemoryBlock(allocator, memoryTypeIndex, reqs.size, MEMORY_STRATEGY_GENERAL, image, true) };
+        allocator.blocks[blockID].allocations[0] = MemoryBlockAllocation{ 0, reqs.size, userData };
+        return makeAllocation(allocator, blockID, 0, reqs.size, MEMORY_STRATEGY_GENERAL);
+    }
+
+    VkDeviceSize offset{};
+    uint32_t order{};
+    for (uint32_t i{}; i < allocator.blocks.size(); i++){
+        MemoryBlock& block{ allocator.blocks[i] };
+
+        // Buffers and images never share a block, so bufferImageGranularity doesn't need to be honored
+        if (block.memory != VK_NULL_HANDLE && block.strategy == MEMORY_STRATEGY_GENERAL && !block.dedicated &&
+            block.memoryTypeIndex == memoryTypeIndex && block.imageBlock == image &&
+            allocateBuddy(block, reqs.size, reqs.alignment, offset, order)){
+            block.allocations[offset] = MemoryBlockAllocation{ order, reqs.size, userData };
+            return makeAllocation(allocator, i, offset, reqs.size, MEMORY_STRATEGY_GENERAL);
+        }
+    }
+
+    uint32_t blockID{ createMemoryBlock(allocator, memoryTypeIndex, blockSize, MEMORY_STRATEGY_GENERAL, image, false) };
+    bool allocated{ allocateBuddy(allocator.blocks[blockID], reqs.size, reqs.alignment, offset, order) };
+    assert(allocated);
+
+    allocator.blocks[blockID].allocations[offset] = MemoryBlockAllocation{ order, reqs.size, userData };
+    return makeAllocation(allocator, blockID, offset, reqs.size, MEMORY_STRATEGY_GENERAL);
+}
+
+void setAllocationUserData(const MemoryAllocation& allocation, void* userData){
+    assert(allocation.strategy == MEMORY_STRATEGY_GENERAL);
+    allocation.allocator->blocks[allocation.blockID].allocations[allocation.offset].userData = userData;
+}
+
+MemoryPool createMemoryPool(MemoryAllocator& allocator, VkMemoryPropertyFlags memoryFlags, VkDeviceSize slotSize, uint32_t slotsPerBlock){
+    MemoryPool pool{};
+    pool.allocator = &allocator;
+    pool.memoryFlags = memoryFlags;
+    pool.slotSize = (slotSize + 255) & ~VkDeviceSize(255);
+    pool.slotsPerBlock = slotsPerBlock;
+    pool.memoryTypeIndex = -1;
+
+    return pool;
+}
+
+MemoryAllocation allocateFromPool(MemoryPool& pool, VkPhysicalDevice physicalDevice, VkMemoryRequirements reqs){
+    assert(reqs.size <= pool.slotSize && pool.slotSize % reqs.alignment == 0);
+
+    if (pool.memoryTypeIndex == -1){
+        pool.memoryTypeIndex = findMemoryType(physicalDevice, reqs.memoryTypeBits, pool.memoryFlags);
+    }
+    assert(reqs.memoryTypeBits & (1 << pool.memoryTypeIndex));
+
+    if (pool.freeSlots.empty()){
+        uint32_t blockID{ createMemoryBlock(*pool.allocator, pool.memoryTypeIndex, pool.slotSize * pool.slotsPerBlock,
+                                            MEMORY_STRATEGY_POOL, false, false) };
+        pool.blockIDs.push_back(blockID);
+
+        for (uint32_t i{ pool.slotsPerBlock }; i > 0; i--){
+            pool.freeSlots.push_back({ blockID, (i - 1) * pool.slotSize });
+        }
+    }
+
+    std::pair<uint32_t, VkDeviceSize> slot{ pool.freeSlots.back() };
+    pool.freeSlots.pop_back();
+
+    MemoryAllocation allocation{ makeAllocation(*pool.allocator, slot.first, slot.second, reqs.size, MEMORY_STRATEGY_POOL) };
+    allocation.pool = &pool;
+
+    return allocation;
+}
+
+void destroyMemoryPool(MemoryPool& pool){
+    assert(pool.freeSlots.size() == pool.blockIDs.size() * pool.slotsPerBlock);
+
+    for (uint32_t blockID : pool.blockIDs){
+        releaseMemoryBlock(*pool.allocator, blockID);
+    }
+
+    pool = MemoryPool{};
+}
+
+LinearAllocator createLinearAllocator(MemoryAllocator& allocator, VkMemoryPropertyFlags memoryFlags, VkDeviceSize capacity){
+    LinearAllocator linearAllocator{};
+    linearAllocator.allocator = &allocator;
+    linearAllocator.memoryFlags = memoryFlags;
+    linearAllocator.capacity = capacity;
+    linearAllocator.memoryTypeIndex = -1;
+
+    return linearAllocator;
+}
+
+MemoryAllocation allocateLinear(LinearAllocator& linearAllocator, VkPhysicalDevice physicalDevice, VkMemoryRequirements reqs){
+    if (linearAllocator.memoryTypeIndex == -1){
+        linearAllocator.memoryTypeIndex = findMemoryType(physicalDevice, reqs.memoryTypeBits, linearAllocator.memoryFlags);
+        linearAllocator.blockID = createMemoryBlock(*linearAllocator.allocator, linearAllocator.memoryTypeIndex, linearAllocator.capacity,
+                                                    MEMORY_STRATEGY_LINEAR, false, false);
+    }
+    assert(reqs.memoryTypeBits & (1 << linearAllocator.memoryTypeIndex));
+
+    VkDeviceSize offset{ (linearAllocator.offset + reqs.alignment - 1) / reqs.alignment * reqs.alignment };
+    assert(offset + reqs.size <= linearAllocator.capacity && "Linear allocator is out of memory");
+
+    linearAllocator.offset = offset + reqs.size;
+    linearAllocator.allocatedBytes += reqs.size;
+    linearAllocator.allocationCount++;
+
+    return makeAllocation(*linearAllocator.allocator, linearAllocator.blockID, offset, reqs.size, MEMORY_STRATEGY_LINEAR);
+}
+
+// Releases every allocation at once; resources bound to them must no longer be in use
+void resetLinearAllocator(LinearAllocator& linearAllocator){
+    if (linearAllocator.memoryTypeIndex == -1){
+        return;
+    }
+
+    MemoryTypeStats& typeStats{ linearAllocator.allocator->typeStats[linearAllocator.memoryTypeIndex] };
+    typeStats.allocationCount -= linearAllocator.allocationCount;
+    typeStats.usedBytes -= linearAllocator.allocatedBytes;
+
+    linearAllocator.offset = 0;
+    linearAllocator.allocatedBytes = 0;
+    linearAllocator.allocationCount = 0;
+}
+
+void destroyLinearAllocator(LinearAllocator& linearAllocator){
+    resetLinearAllocator(linearAllocator);
+    if (linearAllocator.memoryTypeIndex != -1){
+        releaseMemoryBlock(*linearAllocator.allocator, linearAllocator.blockID);
+    }
+
+    linearAllocator = LinearAllocator{};
+}
+
+void freeMemory(MemoryAllocation& allocation){
+    if (!allocation.allocator){
+        return;
+    }
+
+    MemoryAllocator& allocator{ *allocation.allocator };
+    MemoryBlock& block{ allocator.blocks[allocation.blockID] };
+
+    // Linear allocations are only released by resetLinearAllocator
+    if (allocation.strategy != MEMORY_STRATEGY_LINEAR){
+        allocator.typeStats[block.memoryTypeIndex].usedBytes -= allocation.size;
+        allocator.typeStats[block.memoryTypeIndex].allocationCount--;
+    }
+
+    if (allocation.strategy == MEMORY_STRATEGY_POOL){
+        allocation.pool->freeSlots.push_back({ allocation.blockID, allocation.offset });
+    } else if (allocation.strategy == MEMORY_STRATEGY_GENERAL){
+        if (block.dedicated){
+            releaseMemoryBlock(allocator, allocation.blockID);
+        } else {
+            auto blockAllocation{ block.allocations.find(allocation.offset) };
+            assert(blockAllocation != block.allocations.end());
+
+            freeBuddy(block, allocation.offset, blockAllocation->second.order);
+            block.allocations.erase(blockAllocation);
+
+            // Keep one empty block per memory type around to avoid allocation churn
+            if (block.allocations.empty()){
+                for (uint32_t i{}; i < allocator.blocks.size(); i++){
+                    const MemoryBlock& other{ allocator.blocks[i] };
+                    if (i != allocation.blockID && other.memory != VK_NULL_HANDLE && other.allocations.empty() &&
+                        other.strategy == MEMORY_STRATEGY_GENERAL && !other.dedicated &&
+                        other.memoryTypeIndex == block.memoryTypeIndex && other.imageBlock == block.imageBlock){
+                        releaseMemoryBlock(allocator, allocation.blockID);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    allocation = MemoryAllocation{};
+}
+
+void destroyMemoryAllocator(MemoryAllocator& allocator){
+    for (uint32_t i{}; i < allocator.blocks.size(); i++){
+        if (allocator.blocks[i].memory != VK_NULL_HANDLE){
+            assert(allocator.blocks[i].allocations.empty() && "Memory leaked from the allocator");
+            releaseMemoryBlock(allocator, i);
+        }
+    }
+
+    allocator = MemoryAllocator{};
+}
+
+std::vector<MemoryHeapStats> getMemoryHeapStats(const MemoryAllocator& allocator){
+    std::vector<MemoryHeapStats> heapStats(allocator.memProperties.memoryHeapCount);
+
+    for (uint32_t i{}; i < allocator.memProperties.memoryTypeCount; i++){
+        MemoryHeapStats& stats{ heapStats[allocator.memProperties.memoryTypes[i].heapIndex] };
+        stats.reservedBytes += allocator.typeStats[i].reservedBytes;
+        stats.usedBytes += allocator.typeStats[i].usedBytes;
+        stats.allocationCount += allocator.typeStats[i].allocationCount;
+        stats.blockCount += allocator.typeStats[i].blockCount;
+    }
+
+    std::vector<VkDeviceSize> totalFree(heapStats.size()), largestFree(heapStats.size());
+    for (const MemoryBlock& block : allocator.blocks){
+        if (block.memory == VK_NULL_HANDLE || block.strategy != MEMORY_STRATEGY_GENERAL || block.dedicated){
+            continue;
+        }
+
+        uint32_t heapIndex{ allocator.memProperties.memoryTypes[block.memoryTypeIndex].heapIndex };
+        totalFree[heapIndex] += block.size - block.allocatedBytes;
+
+        for (uint32_t order{ (uint32_t)block.freeLists.size() }; order > 0; order--){
+            if (!block.freeLists[order - 1].empty()){
+                largestFree[heapIndex] = std::max(largestFree[heapIndex], VkDeviceSize(1) << (order - 1 + kMinBuddyOrder));
+                break;
+            }
+        }
+    }
+
+    for (uint32_t i{}; i < heapStats.size(); i++){
+        heapStats[i].fragmentation = totalFree[i] ? 1.0f - float(largestFree[i]) / float(totalFree[i]) : 0.0f;
+    }
+
+    return heapStats;
+}
+
+// Called for every move; the callee copies the contents, rebinds its resource to dst and returns true,
+// or returns false to keep the allocation where it is
+typedef bool (*MemoryMoveCallback)(const MemoryAllocation& src, const MemoryAllocation& dst, void* allocationUserData, void* callbackUserData);
+
+// Incrementally empties the least used general block of each memory type into the other blocks of that type, and
+// releases it once it is empty. Only allocations with user data are moved, since only those can be found by the
+// callback. The callback must have finished copying by the time it returns, since the source range is freed after it.
+VkDeviceSize defragmentMemory(MemoryAllocator& allocator, MemoryMoveCallback moveCallback, void* callbackUserData, VkDeviceSize maxBytesToMove){
+    VkDeviceSize movedBytes{};
+
+    for (uint32_t memoryTypeIndex{}; memoryTypeIndex < allocator.memProperties.memoryTypeCount; memoryTypeIndex++){
+        for (int image{}; image < 2; image++){
+            std::vector<uint32_t> blockIDs{};
+            for (uint32_t i{}; i < allocator.blocks.size(); i++){
+                const MemoryBlock& block{ allocator.blocks[i] };
+                if (block.memory != VK_NULL_HANDLE && block.strategy == MEMORY_STRATEGY_GENERAL && !block.dedicated &&
+                    block.memoryTypeIndex == memoryTypeIndex && block.imageBlock == (image != 0)){
+                    blockIDs.push_back(i);
+                }
+            }
+
+            if (blockIDs.size() < 2){
+                continue;
+            }
+
+            std::sort(blockIDs.begin(), blockIDs.end(), [&allocator](uint32_t a, uint32_t b){
+                return allocator.blocks[a].allocatedBytes < allocator.blocks[b].allocatedBytes;
+            });
+
+            uint32_t srcBlockID{ blockIDs[0] };
+            std::map<VkDeviceSize, MemoryBlockAllocation> srcAllocations{ allocator.blocks[srcBlockID].allocations };
+
+            for (const auto& [srcOffset, srcBlockAllocation] : srcAllocations){
+                if (!srcBlockAllocation.userData || movedBytes + srcBlockAllocation.size > maxBytesToMove){
+                    continue;
+                }
+
+                VkDeviceSize alignment{ VkDeviceSize(1) << srcBlockAllocation.order };
+
+                for (uint32_t j{ 1 }; j < blockIDs.size(); j++){
+                    uint32_t dstBlockID{ blockIDs[j] };
+                    MemoryBlock& dstBlock{ allocator.blocks[dstBlockID] };
+
+                    VkDeviceSize dstOffset{};
+                    uint32_t dstOrder{};
+                    if (!allocateBuddy(dstBlock, srcBlockAllocation.size, alignment, dstOffset, dstOrder)){
+                        continue;
+                    }
+
+                    dstBlock.allocations[dstOffset] = srcBlockAllocation;
+                    dstBlock.allocations[dstOffset].order = dstOrder;
+
+                    MemoryAllocation src{ allocator.blocks[srcBlockID].memory, srcOffset, srcBlockAllocation.size,
+                                          allocator.blocks[srcBlockID].data ? (uint8_t*)allocator.blocks[srcBlockID].data + srcOffset : nullptr,
+                                          &allocator, nullptr, MEMORY_STRATEGY_GENERAL, srcBlockID };
+                    MemoryAllocation dst{ makeAllocation(allocator, dstBlockID, dstOffset, srcBlockAllocation.size, MEMORY_STRATEGY_GENERAL) };
+
+                    if (moveCallback(src, dst, srcBlockAllocation.userData, callbackUserData)){
+                        movedBytes += srcBlockAllocation.size;
+                        freeMemory(src);
+                    } else {
+                        freeMemory(dst);
+                    }
+
+                    break;
+                }
+            }
+
+            MemoryBlock& srcBlock{ allocator.blocks[srcBlockID] };
+            if (srcBlock.memory != VK_NULL_HANDLE && srcBlock.allocations.empty()){
+                releaseMemoryBlock(allocator, srcBlockID);
+            }
+        }
+    }
+
+    return movedBytes;
+}
+
+// Exclusive to the render queue, unless sharedQueueFamilyID names another family that also accesses the buffer.
+// Concurrent sharing can cost compression or bandwidth on some drivers, so only buffers that need it get it.
+VkBuffer createBufferHandle(VulkanState vkState, VkDeviceSize size, VkBufferUsageFlags usage, uint32_t sharedQueueFamilyID){
     VkBufferCreateInfo bufferInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
     bufferInfo.size = size;
     bufferInfo.usage = usage;
@@ -25,25 +479,164 @@ Buffer createBuffer(VulkanState vkState, VkDeviceSize size, VkBufferUsageFlags u
     bufferInfo.queueFamilyIndexCount = 1;
     bufferInfo.pQueueFamilyIndices = &vkState.renderQueueFamilyID;
 
-    VK_CHECK(vkCreateBuffer(vkState.device, &bufferInfo, nullptr, &buffer.buffer));
+    uint32_t queueFamilyIDs[]{ vkState.renderQueueFamilyID, sharedQueueFamilyID };
+    if (sharedQueueFamilyID != -1 && sharedQueueFamilyID != vkState.renderQueueFamilyID){
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = 2;
+        bufferInfo.pQueueFamilyIndices = queueFamilyIDs;
+    }
+
+    VkBuffer buffer{};
+    VK_CHECK(vkCreateBuffer(vkState.device, &bufferInfo, nullptr, &buffer));
+
+    return buffer;
+}
+
+Buffer createBuffer(VulkanState vkState, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryFlags,
+                    MemoryPool* pool = nullptr, LinearAllocator* linearAllocator = nullptr, uint32_t sharedQueueFamilyID = -1){
+    Buffer buffer{};
+    buffer.buffer = createBufferHandle(vkState, size, usage, sharedQueueFamilyID);
+    buffer.size = size;
+    buffer.usage = usage;
+    buffer.sharedQueueFamilyID = sharedQueueFamilyID;
 
     VkMemoryRequirements bufferReqs{};
     vkGetBufferMemoryRequirements(vkState.device, buffer.buffer, &bufferReqs);
 
-    VkMemoryAllocateInfo allocInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-    allocInfo.memoryTypeIndex = findMemoryType(vkState.physicalDevice,
-                                                bufferReqs.memoryTypeBits,
-                                                memoryFlags);
-    allocInfo.allocationSize = bufferReqs.size;
+    assert(vkState.allocator);
+
+    if (pool){
+        buffer.allocation = allocateFromPool(*pool, vkState.physicalDevice, bufferReqs);
+    } else if (linearAllocator){
+        buffer.allocation = allocateLinear(*linearAllocator, vkState.physicalDevice, bufferReqs);
+    } else {
+        buffer.allocation = allocateMemory(*vkState.allocator, vkState.physicalDevice, bufferReqs, memoryFlags, false);
+    }
+
+    VK_CHECK(vkBindBufferMemory(vkState.device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset));
 
-    VK_CHECK(vkAllocateMemory(vkState.device, &allocInfo, nullptr, &buffer.memory));
-    VK_CHECK(vkBindBufferMemory(vkState.device, buffer.buffer, buffer.memory, 0));
-    VK_CHECK(vkMapMemory(vkState.device, buffer.memory, 0, bufferReqs.size, 0, &buffer.data));
+    buffer.data = buffer.allocation.data;
 
     return buffer;
 }
 
+// For move callbacks: creates the buffer again on the new allocation and returns the old handle, still bound to the
+// source range, for the caller to copy from and destroy
+VkBuffer rebindBuffer(VulkanState vkState, Buffer& buffer, const MemoryAllocation& allocation){
+    VkBuffer oldBuffer{ buffer.buffer };
+
+    buffer.buffer = createBufferHandle(vkState, buffer.size, buffer.usage, buffer.sharedQueueFamilyID);
+    buffer.allocation = allocation;
+    buffer.data = allocation.data;
+
+    VK_CHECK(vkBindBufferMemory(vkState.device, buffer.buffer, allocation.memory, allocation.offset));
+
+    return oldBuffer;
+}
+
 void destroyBuffer(VkDevice device, Buffer buffer){
-    vkFreeMemory(device, buffer.memory, nullptr);
     vkDestroyBuffer(device, buffer.buffer, nullptr);
+    freeMemory(buffer.allocation);
+}
+
+// Bound as a dynamic uniform buffer by default; STORAGE_BUFFER usage lets it be read through the descriptor heap instead
+UniformRing createUniformRing(VulkanState vkState, VkDeviceSize frameCapacity, uint32_t frameCount,
+                              VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT){
+    VkPhysicalDeviceProperties physDevProps{};
+    vkGetPhysicalDeviceProperties(vkState.physicalDevice, &physDevProps);
+
+    UniformRing ring{};
+    ring.alignment = std::max(physDevProps.limits.minUniformBufferOffsetAlignment, VkDeviceSize(16));
+    ring.frameCapacity = (frameCapacity + ring.alignment - 1) / ring.alignment * ring.alignment;
+    ring.frameCount = frameCount;
+
+    ring.buffer = createBuffer(vkState, ring.frameCapacity * frameCount, usage,
+                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    return ring;
+}
+
+void destroyUniformRing(VkDevice device, UniformRing& ring){
+    destroyBuffer(device, ring.buffer);
+
+    ring = UniformRing{};
+}
+
+// The frame's fence must have signaled, since its region is overwritten from the start
+void beginUniformRingFrame(UniformRing& ring, uint32_t frameIndex){
+    assert(frameIndex < ring.frameCount);
+
+    ring.frameBegin = frameIndex * ring.frameCapacity;
+    ring.head = ring.frameBegin;
+}
+
+// Copies size bytes into the current frame's region and returns their dynamic offset
+uint32_t writeUniforms(UniformRing& ring, const void* data, VkDeviceSize size){
+    VkDeviceSize offset{ ring.head };
+    assert(offset + size <= ring.frameBegin + ring.frameCapacity);
+
+    memcpy((uint8_t*)ring.buffer.data + offset, data, size);
+
+    ring.head = (offset + size + ring.alignment - 1) / ring.alignment * ring.alignment;
+    ring.peakFrameBytes = std::max(ring.peakFrameBytes, ring.head - ring.frameBegin);
+
+    return (uint32_t)offset;
+}
+
+VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspect,
+                            uint32_t baseMipLevel, uint32_t mipLevelCount){
+    VkImageViewCreateInfo imageViewCreateInfo{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+    imageViewCreateInfo.image = image;
+    imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    imageViewCreateInfo.format = format;
+    imageViewCreateInfo.components = {VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A};
+    imageViewCreateInfo.subresourceRange.layerCount = 1;
+    imageViewCreateInfo.subresourceRange.baseMipLevel = baseMipLevel;
+    imageViewCreateInfo.subresourceRange.levelCount = mipLevelCount;
+    imageViewCreateInfo.subresourceRange.aspectMask = aspect;
+
+    VkImageView imageView{};
+    VK_CHECK(vkCreateImageView(device, &imageViewCreateInfo, nullptr, &imageView));
+
+    return imageView;
+}
+
+// The image view covers every mip level
+Image createImage(VulkanState vkState, VkExtent2D extent, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect,
+                  uint32_t mipLevels = 1){
+    Image image{};
+
+    VkImageCreateInfo imageInfo{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = format;
+    imageInfo.extent = { extent.width, extent.height, 1 };
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = usage;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.queueFamilyIndexCount = 1;
+    imageInfo.pQueueFamilyIndices = &vkState.renderQueueFamilyID;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VK_CHECK(vkCreateImage(vkState.device, &imageInfo, nullptr, &image.image));
+
+    VkMemoryRequirements imageReqs{};
+    vkGetImageMemoryRequirements(vkState.device, image.image, &imageReqs);
+
+    image.allocation = allocateMemory(*vkState.allocator, vkState.physicalDevice, imageReqs,
+                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true);
+
+    VK_CHECK(vkBindImageMemory(vkState.device, image.image, image.allocation.memory, image.allocation.offset));
+
+    image.imageView = createImageView(vkState.device, image.image, format, aspect, 0, mipLevels);
+
+    return image;
+}
+
+void destroyImage(VkDevice device, Image image){
+    vkDestroyImageView(device, image.imageView, nullptr);
+    vkDestroyImage(device, image.image, nullptr);
+    freeMemory(image.allocation);
 }
\ No newline at end of file
@@ -1,5 +1,10 @@
 #include "vk_helpers.h"
 #include <stdio.h>
+#include <string.h>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 
 VkShaderModule createShaderModule(VkDevice device, const char* filename){
     assert(filename);
@@ -31,10 +36,14 @@ VkShaderModule createShaderModule(VkDevice device, const char* filename){
     return shaderModule;
 }
 
-GraphicsPipeline createGraphicsPipeline(VkDevice device, VkRenderPass renderPass, VkViewport viewport, VkPipelineLayout pipelineLayout){
+GraphicsPipeline createGraphicsPipeline(VkDevice device, VkPipelineCache pipelineCache, const GraphicsPipelineDesc& desc){
+    VkViewport viewport{ desc.viewport };
+
     GraphicsPipeline pipeline{};
-    pipeline.vertexShader = createShaderModule(device, "shaders/mesh.vs.spv");
-    pipeline.fragmentShader = createShaderModule(device, "shaders/mesh.fs.spv");
+    pipeline.vertexShader = createShaderModule(device, desc.vertexShaderFile);
+    if (!desc.depthOnly){
+        pipeline.fragmentShader = createShaderModule(device, desc.fragmentShaderFile);
+    }
 
     VkPipelineShaderStageCreateInfo shaderStages[2]{};
     shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -42,12 +51,34 @@ GraphicsPipeline createGraphicsPipeline(VkDevice device, VkRenderPass renderPass
     shaderStages[0].module = pipeline.vertexShader;
     shaderStages[0].pName = "main";
 
+    VkSpecializationMapEntry specializationEntries[kMaxShaderSwitches]{};
+    for (uint32_t i{}; i < desc.vertexPermutation.switchCount; i++){
+        specializationEntries[i] = { i, i * (uint32_t)sizeof(uint32_t), sizeof(uint32_t) };
+    }
+
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = desc.vertexPermutation.switchCount;
+    specializationInfo.pMapEntries = specializationEntries;
+    specializationInfo.dataSize = desc.vertexPermutation.switchCount * sizeof(uint32_t);
+    specializationInfo.pData = desc.vertexPermutation.switches;
+
+    if (desc.vertexPermutation.switchCount > 0){
+        shaderStages[0].pSpecializationInfo = &specializationInfo;
+    }
+
     shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
     shaderStages[1].module = pipeline.fragmentShader;
     shaderStages[1].pName = "main";
 
     VkPipelineVertexInputStateCreateInfo vertexState{ VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+    if (desc.vertexAttributeCount > 0){
+        vertexState.vertexBindingDescriptionCount = 1;
+        vertexState.pVertexBindingDescriptions = &desc.vertexBinding;
+        vertexState.vertexAttributeDescriptionCount = desc.vertexAttributeCount;
+        vertexState.pVertexAttributeDescriptions = desc.vertexAttributes;
+    }
+
     VkPipelineInputAssemblyStateCreateInfo inputAssemblerState{ VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
     inputAssemblerState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 
@@ -59,40 +90,254 @@ GraphicsPipeline createGraphicsPipeline(VkDevice device, VkRenderPass renderPass
     viewportState.scissorCount = 1;
     viewportState.pScissors = &scissorRect;
 
+    VkDynamicState dynamicStates[]{ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+    VkPipelineDynamicStateCreateInfo dynamicState{ VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+    dynamicState.dynamicStateCount = 2;
+    dynamicState.pDynamicStates = dynamicStates;
+
+    if (desc.dynamicViewport){
+        viewportState.pViewports = nullptr;
+        viewportState.pScissors = nullptr;
+    }
+
     VkPipelineRasterizationStateCreateInfo rasterState{ VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
     rasterState.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterState.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterState.cullMode = desc.cullMode;
+    rasterState.frontFace = desc.frontFace;
     rasterState.lineWidth = 1.0f;
 
     VkPipelineColorBlendAttachmentState blendAttachment{};
-    blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-                                     VK_COLOR_COMPONENT_B_BIT |VK_COLOR_COMPONENT_A_BIT;
+    blendAttachment.blendEnable = desc.blendEnable;
+    blendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    blendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    blendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    blendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    blendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    blendAttachment.colorWriteMask = desc.depthOnly ? 0 : VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                                                          VK_COLOR_COMPONENT_B_BIT |VK_COLOR_COMPONENT_A_BIT;
 
     VkPipelineColorBlendStateCreateInfo blendState{ VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
     blendState.attachmentCount = 1;
     blendState.pAttachments = &blendAttachment;
 
-    // TODO: use VkPipelineCache
+    VkPipelineDepthStencilStateCreateInfo depthState{ VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+    depthState.depthTestEnable = desc.depthTest;
+    depthState.depthWriteEnable = desc.depthWrite;
+    depthState.depthCompareOp = desc.depthCompareOp;
+
     VkGraphicsPipelineCreateInfo createPipelineInfo{ VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
-    createPipelineInfo.stageCount = 2;
+    createPipelineInfo.stageCount = desc.depthOnly ? 1 : 2;
     createPipelineInfo.pStages = shaderStages;
     createPipelineInfo.pVertexInputState = &vertexState;
     createPipelineInfo.pInputAssemblyState = &inputAssemblerState;
     createPipelineInfo.pViewportState = &viewportState;
     createPipelineInfo.pRasterizationState = &rasterState;
+    createPipelineInfo.pDepthStencilState = &depthState;
     createPipelineInfo.pColorBlendState = &blendState;
-    createPipelineInfo.layout = pipelineLayout;
-    createPipelineInfo.renderPass = renderPass;
+    createPipelineInfo.pDynamicState = desc.dynamicViewport ? &dynamicState : nullptr;
+    createPipelineInfo.layout = desc.pipelineLayout;
+    createPipelineInfo.renderPass = desc.renderPass;
+
+    VK_CHECK(vkCreateGraphicsPipelines(device, pipelineCache, 1, &createPipelineInfo, nullptr, &pipeline.pipeline));
+
+    return pipeline;
+}
+
+// 16 bits per switch, kShaderSwitchDynamic and unset switches as 0xffff, so every permutation of up to
+// kMaxShaderSwitches switches with values below 0xffff has its own key
+uint64_t shaderPermutationKey(const ShaderPermutation& permutation){
+    assert(permutation.switchCount <= kMaxShaderSwitches);
+
+    uint64_t key{};
+    for (uint32_t i{}; i < kMaxShaderSwitches; i++){
+        uint32_t value{ i < permutation.switchCount ? permutation.switches[i] : kShaderSwitchDynamic };
+        assert(value == kShaderSwitchDynamic || value < 0xffff);
+
+        key |= (uint64_t)(value == kShaderSwitchDynamic ? 0xffff : value) << (i * 16);
+    }
+
+    return key;
+}
+
+// Creates the permutation's pipeline on first use, so look up every permutation a frame draws with ahead of the frames
+const GraphicsPipeline& getPermutedPipeline(VkDevice device, VkPipelineCache pipelineCache, PermutedPipelines& permuted,
+                                            const ShaderPermutation& permutation){
+    uint64_t key{ shaderPermutationKey(permutation) };
+
+    auto it{ permuted.pipelines.find(key) };
+    if (it == permuted.pipelines.end()){
+        GraphicsPipelineDesc desc{ permuted.desc };
+        desc.vertexPermutation = permutation;
+
+        it = permuted.pipelines.emplace(key, createGraphicsPipeline(device, pipelineCache, desc)).first;
+    }
+
+    return it->second;
+}
+
+// Compiles the variants on threadCount workers; the pipeline cache is internally synchronized
+std::vector<GraphicsPipeline> createGraphicsPipelines(VkDevice device, VkPipelineCache pipelineCache,
+                                                      const std::vector<GraphicsPipelineDesc>& descs, uint32_t threadCount){
+    std::vector<GraphicsPipeline> pipelines(descs.size());
+    std::atomic<uint32_t> nextPipelineID{};
+
+    auto compilePipelines = [&](){
+        for (uint32_t i{ nextPipelineID++ }; i < descs.size(); i = nextPipelineID++){
+            pipelines[i] = createGraphicsPipeline(device, pipelineCache, descs[i]);
+        }
+    };
+
+    std::vector<std::thread> workers{};
+    for (uint32_t i{ 1 }; i < std::min<size_t>(threadCount, descs.size()); i++){
+        workers.emplace_back(compilePipelines);
+    }
+
+    compilePipelines();
+
+    for (std::thread& worker : workers){
+        worker.join();
+    }
+
+    return pipelines;
+}
+
+ComputePipeline createComputePipeline(VkDevice device, VkPipelineCache pipelineCache, const char* computeShaderFile, VkPipelineLayout pipelineLayout){
+    ComputePipeline pipeline{};
+    pipeline.computeShader = createShaderModule(device, computeShaderFile);
+
+    VkComputePipelineCreateInfo createInfo{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+    createInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    createInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    createInfo.stage.module = pipeline.computeShader;
+    createInfo.stage.pName = "main";
+    createInfo.layout = pipelineLayout;
 
-    VK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &createPipelineInfo, nullptr, &pipeline.pipeline));
+    VK_CHECK(vkCreateComputePipelines(device, pipelineCache, 1, &createInfo, nullptr, &pipeline.pipeline));
 
     return pipeline;
 }
 
+VkPipelineLayout createComputePipelineLayout(VkDevice device, VkDescriptorSetLayout descrSetLayout, uint32_t pushConstantSize){
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.size = pushConstantSize;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{ VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descrSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    VkPipelineLayout pipelineLayout{};
+    VK_CHECK(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+    return pipelineLayout;
+}
+
+// Returns an empty cache if the file is missing, truncated or was written by a different driver or device
+VkPipelineCache loadPipelineCache(VulkanState vkState, const char* filename, bool* loaded = nullptr){
+    VkPhysicalDeviceProperties physDevProps{};
+    vkGetPhysicalDeviceProperties(vkState.physicalDevice, &physDevProps);
+
+    std::vector<uint8_t> cacheData{};
+
+    FILE* cacheFile{ fopen(filename, "rb") };
+    if (cacheFile){
+        fseek(cacheFile, 0l, SEEK_END);
+        long endOffset{ ftell(cacheFile) };
+        fseek(cacheFile, 0l, SEEK_SET);
+
+        if (endOffset >= (long)sizeof(VkPipelineCacheHeaderVersionOne)){
+            cacheData.resize(endOffset);
+            if (fread(cacheData.data(), cacheData.size(), 1, cacheFile) != 1){
+                cacheData.clear();
+            }
+        }
+
+        fclose(cacheFile);
+    }
+
+    if (!cacheData.empty()){
+        VkPipelineCacheHeaderVersionOne header{};
+        memcpy(&header, cacheData.data(), sizeof(header));
+
+        bool valid{ header.headerSize >= sizeof(VkPipelineCacheHeaderVersionOne) &&
+                    header.headerSize <= cacheData.size() &&
+                    header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                    header.vendorID == physDevProps.vendorID &&
+                    header.deviceID == physDevProps.deviceID &&
+                    memcmp(header.pipelineCacheUUID, physDevProps.pipelineCacheUUID, VK_UUID_SIZE) == 0 };
+
+        if (!valid){
+            fprintf(stderr, "Pipeline cache %s is stale or corrupt, starting with an empty cache\n", filename);
+            cacheData.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo createInfo{ VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+    createInfo.initialDataSize = cacheData.size();
+    createInfo.pInitialData = cacheData.data();
+
+    VkPipelineCache pipelineCache{};
+    VkResult createRes{ vkCreatePipelineCache(vkState.device, &createInfo, nullptr, &pipelineCache) };
+
+    // Drivers may still reject data that passed the header check
+    if (createRes != VK_SUCCESS && !cacheData.empty()){
+        cacheData.clear();
+        createInfo.initialDataSize = 0;
+        createInfo.pInitialData = nullptr;
+        createRes = vkCreatePipelineCache(vkState.device, &createInfo, nullptr, &pipelineCache);
+    }
+
+    VK_CHECK(createRes);
+
+    if (loaded){
+        *loaded = !cacheData.empty();
+    }
+
+    return pipelineCache;
+}
+
+void savePipelineCache(VkDevice device, VkPipelineCache pipelineCache, const char* filename){
+    size_t dataSize{};
+    VK_CHECK(vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr));
+
+    std::vector<uint8_t> cacheData(dataSize);
+    VK_CHECK(vkGetPipelineCacheData(device, pipelineCache, &dataSize, cacheData.data()));
+
+    // Write to a temporary file first so an interrupted write never leaves a truncated cache behind
+    std::string tempFile{ std::string(filename) + ".tmp" };
+    FILE* cacheFile{ fopen(tempFile.c_str(), "wb") };
+    if (!cacheFile){
+        return;
+    }
+
+    bool written{ fwrite(cacheData.data(), 1, dataSize, cacheFile) == dataSize };
+    written = (fclose(cacheFile) == 0) && written;
+
+    if (!written || rename(tempFile.c_str(), filename) != 0){
+        remove(tempFile.c_str());
+    }
+}
+
 void destroyPipeline(VkDevice device, GraphicsPipeline pipeline){
     vkDestroyPipeline(device, pipeline.pipeline, nullptr);
 
     vkDestroyShaderModule(device, pipeline.fragmentShader, nullptr);
     vkDestroyShaderModule(device, pipeline.vertexShader, nullptr);
+}
+
+void destroyPipeline(VkDevice device, ComputePipeline pipeline){
+    vkDestroyPipeline(device, pipeline.pipeline, nullptr);
+    vkDestroyShaderModule(device, pipeline.computeShader, nullptr);
+}
+
+void destroyPipelines(VkDevice device, PermutedPipelines& permuted){
+    for (auto& entry : permuted.pipelines){
+        destroyPipeline(device, entry.second);
+    }
+
+    permuted.pipelines.clear();
 }
\ No newline at end of file
@@ -1,4 +1,11 @@
 #include "vk_helpers.h"
+#include <stdio.h>
+#include <chrono>
+#include <algorithm>
+
+const uint32_t kGPUTraceThreadID{ 0 };
+const uint32_t kRenderThreadTraceID{ 1 };     // CPU threads follow in registration order
+const size_t kMaxTraceEvents{ 1 << 20 };
 
 VkQueryPool createTimestampQueryPool(VkDevice device, uint32_t queryCount){
     VkQueryPoolCreateInfo createInfo{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
@@ -11,6 +18,326 @@ VkQueryPool createTimestampQueryPool(VkDevice device, uint32_t queryCount){
     return queryPool;
 }
 
+// Each query counts input assembly vertices and vertex shader invocations, in that order
+const VkQueryPipelineStatisticFlags kVertexStatistics{ VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+                                                       VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT };
+
+VkQueryPool createVertexStatisticsQueryPool(VkDevice device, uint32_t queryCount){
+    VkQueryPoolCreateInfo createInfo{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+    createInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    createInfo.queryCount = queryCount;
+    createInfo.pipelineStatistics = kVertexStatistics;
+
+    VkQueryPool queryPool{};
+    VK_CHECK(vkCreateQueryPool(device, &createInfo, nullptr, &queryPool));
+
+    return queryPool;
+}
+
 void destroyQueryPool(VkDevice device, VkQueryPool queryPool){
     vkDestroyQueryPool(device, queryPool, nullptr);
+}
+
+double traceTimeUs(){
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Deltas are taken modulo the valid timestamp bits, so a wrap between the two samples is harmless
+int64_t timestampDelta(uint64_t timestampMask, uint64_t from, uint64_t to){
+    uint64_t delta{ (to - from) & timestampMask };
+
+    return delta > (timestampMask >> 1) ? -(int64_t)((from - to) & timestampMask) : (int64_t)delta;
+}
+
+bool supportsMonotonicTimeDomain(VkPhysicalDevice physicalDevice){
+#ifdef __linux__
+    uint32_t timeDomainCount{};
+    VK_CHECK(vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(physicalDevice, &timeDomainCount, nullptr));
+
+    std::vector<VkTimeDomainEXT> timeDomains(timeDomainCount);
+    VK_CHECK(vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(physicalDevice, &timeDomainCount, timeDomains.data()));
+
+    bool device{};
+    bool monotonic{};
+    for (VkTimeDomainEXT timeDomain : timeDomains){
+        device |= timeDomain == VK_TIME_DOMAIN_DEVICE_EXT;
+        monotonic |= timeDomain == VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+    }
+
+    return device && monotonic;
+#else
+    return false;
+#endif
+}
+
+// steady_clock is CLOCK_MONOTONIC on Linux, so the calibrated host time can be used as is
+bool calibrateWithExtension(GPUProfiler& profiler){
+#ifdef __linux__
+    VkCalibratedTimestampInfoEXT timestampInfos[2]{};
+    timestampInfos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    timestampInfos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    timestampInfos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    timestampInfos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+
+    uint64_t timestamps[2]{};
+    uint64_t maxDeviation{};
+    if (vkGetCalibratedTimestampsEXT(profiler.device, 2, timestampInfos, timestamps, &maxDeviation) != VK_SUCCESS){
+        return false;
+    }
+
+    profiler.calibrationTicks = timestamps[0];
+    profiler.calibrationUs = timestamps[1] * 1e-3;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Without the extension a timestamp is written by an empty submit and matched to the middle of the CPU wait
+void calibrateWithSubmit(GPUProfiler& profiler, VulkanState vkState){
+    VkCommandBuffer cmdBuffer{};
+    VkCommandPool cmdPool{ allocateCommandBuffers(vkState, &cmdBuffer, 1) };
+
+    VkQueryPool queryPool{ createTimestampQueryPool(vkState.device, 1) };
+
+    VkFenceCreateInfo fenceCreateInfo{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+    VkFence fence{};
+    VK_CHECK(vkCreateFence(vkState.device, &fenceCreateInfo, nullptr, &fence));
+
+    VkCommandBufferBeginInfo cmdBeginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    cmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &cmdBeginInfo));
+    vkCmdResetQueryPool(cmdBuffer, queryPool, 0, 1);
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+    VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+
+    VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cmdBuffer;
+
+    double submitUs{ traceTimeUs() };
+    VK_CHECK(vkQueueSubmit(vkState.renderQueue, 1, &submitInfo, fence));
+    VK_CHECK(vkWaitForFences(vkState.device, 1, &fence, VK_TRUE, -1));
+    double completeUs{ traceTimeUs() };
+
+    uint64_t timestamp{};
+    VK_CHECK(vkGetQueryPoolResults(vkState.device, queryPool, 0, 1, sizeof(timestamp), &timestamp, sizeof(timestamp),
+                                   VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+
+    profiler.calibrationTicks = timestamp;
+    profiler.calibrationUs = (submitUs + completeUs) * 0.5;
+
+    vkDestroyFence(vkState.device, fence, nullptr);
+    destroyQueryPool(vkState.device, queryPool);
+    vkDestroyCommandPool(vkState.device, cmdPool, nullptr);
+}
+
+GPUProfiler createGPUProfiler(VulkanState vkState, uint32_t frameCount, uint32_t maxZonesPerFrame){
+    GPUProfiler profiler{};
+    profiler.device = vkState.device;
+    profiler.physicalDevice = vkState.physicalDevice;
+    profiler.maxQueries = maxZonesPerFrame * 2;
+    profiler.resolvedFrameTimeMs = -1.0;
+
+    VkPhysicalDeviceProperties physDevProps{};
+    vkGetPhysicalDeviceProperties(vkState.physicalDevice, &physDevProps);
+    profiler.timestampPeriod = physDevProps.limits.timestampPeriod;
+
+    uint32_t queueFamilyCount{};
+    vkGetPhysicalDeviceQueueFamilyProperties(vkState.physicalDevice, &queueFamilyCount, nullptr);
+
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(vkState.physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    uint32_t validBits{ queueFamilies[vkState.renderQueueFamilyID].timestampValidBits };
+    assert(validBits > 0);
+    profiler.timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    profiler.frames.resize(frameCount);
+    for (GPUProfilerFrame& frame : profiler.frames){
+        frame.queryPool = createTimestampQueryPool(vkState.device, profiler.maxQueries);
+    }
+
+    profiler.calibratedTimestamps = vkState.caps.calibratedTimestamps && supportsMonotonicTimeDomain(vkState.physicalDevice) &&
+                                    calibrateWithExtension(profiler);
+    if (!profiler.calibratedTimestamps){
+        calibrateWithSubmit(profiler, vkState);
+    }
+
+    return profiler;
+}
+
+void destroyGPUProfiler(GPUProfiler& profiler){
+    for (GPUProfilerFrame& frame : profiler.frames){
+        destroyQueryPool(profiler.device, frame.queryPool);
+    }
+
+    profiler = GPUProfiler{};
+}
+
+// Reads back a ring slot without waiting; the caller must know the slot's submission has finished
+bool resolveGPUProfilerFrame(GPUProfiler& profiler, uint32_t frameIndex){
+    GPUProfilerFrame& frame{ profiler.frames[frameIndex] };
+
+    if (!frame.submitted){
+        return false;
+    }
+
+    frame.submitted = false;
+
+    std::vector<uint64_t> timestamps(frame.queryCount);
+    VkResult queryRes{ vkGetQueryPoolResults(profiler.device, frame.queryPool, 0, frame.queryCount,
+                                             timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t),
+                                             VK_QUERY_RESULT_64_BIT) };
+    assert(queryRes == VK_SUCCESS || queryRes == VK_NOT_READY);
+
+    if (queryRes != VK_SUCCESS || frame.zones.empty()){
+        return false;
+    }
+
+    // Re-anchoring every frame keeps clock drift out of long captures
+    if (profiler.calibratedTimestamps){
+        calibrateWithExtension(profiler);
+    }
+
+    const double usPerTick{ profiler.timestampPeriod * 1e-3 };
+
+    profiler.results.clear();
+
+    double frameBeginUs{};
+    double frameEndUs{};
+    for (const GPUZone& zone : frame.zones){
+        double beginUs{ profiler.calibrationUs +
+                        timestampDelta(profiler.timestampMask, profiler.calibrationTicks, timestamps[zone.beginQuery]) * usPerTick };
+        double durationUs{ timestampDelta(profiler.timestampMask, timestamps[zone.beginQuery], timestamps[zone.endQuery]) * usPerTick };
+
+        profiler.results.push_back({ zone.name, zone.depth, beginUs, durationUs * 1e-3 });
+
+        if (profiler.results.size() == 1){
+            frameBeginUs = beginUs;
+            frameEndUs = beginUs + durationUs;
+        } else if (zone.depth == 0){
+            frameBeginUs = std::min(frameBeginUs, beginUs);
+            frameEndUs = std::max(frameEndUs, beginUs + durationUs);
+        }
+
+        if (profiler.captureTrace && profiler.traceEvents.size() < kMaxTraceEvents){
+            profiler.traceEvents.push_back({ zone.name, kGPUTraceThreadID, beginUs, durationUs });
+        }
+    }
+
+    profiler.resolvedFrameID = frame.frameID;
+    profiler.resolvedFrameTimeMs = (frameEndUs - frameBeginUs) * 1e-3;
+
+    return true;
+}
+
+// Resolves the slot that is about to be reused (N frames old) and resets its queries
+bool beginGPUProfilerFrame(GPUProfiler& profiler, VkCommandBuffer cmdBuffer){
+    bool resolved{ resolveGPUProfilerFrame(profiler, profiler.frameIndex) };
+
+    GPUProfilerFrame& frame{ profiler.frames[profiler.frameIndex] };
+    frame.zones.clear();
+    frame.queryCount = 0;
+    frame.frameID = profiler.frameCounter;
+
+    profiler.zoneStack.clear();
+
+    vkCmdResetQueryPool(cmdBuffer, frame.queryPool, 0, profiler.maxQueries);
+
+    return resolved;
+}
+
+// Call once the frame's command buffer has been submitted
+void endGPUProfilerFrame(GPUProfiler& profiler){
+    assert(profiler.zoneStack.empty());
+
+    GPUProfilerFrame& frame{ profiler.frames[profiler.frameIndex] };
+    frame.submitted = true;
+
+    profiler.frameIndex = (profiler.frameIndex + 1) % profiler.frames.size();
+    profiler.frameCounter++;
+}
+
+void beginGPUZone(GPUProfiler& profiler, VkCommandBuffer cmdBuffer, const char* name){
+    GPUProfilerFrame& frame{ profiler.frames[profiler.frameIndex] };
+    assert(frame.queryCount + 2 <= profiler.maxQueries);
+
+    GPUZone zone{};
+    zone.name = name;
+    zone.depth = profiler.zoneStack.size();
+    zone.beginQuery = frame.queryCount++;
+    zone.endQuery = frame.queryCount++;
+
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.queryPool, zone.beginQuery);
+
+    profiler.zoneStack.push_back(frame.zones.size());
+    frame.zones.push_back(zone);
+}
+
+void endGPUZone(GPUProfiler& profiler, VkCommandBuffer cmdBuffer){
+    assert(!profiler.zoneStack.empty());
+
+    GPUProfilerFrame& frame{ profiler.frames[profiler.frameIndex] };
+    GPUZone& zone{ frame.zones[profiler.zoneStack.back()] };
+    profiler.zoneStack.pop_back();
+
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.queryPool, zone.endQuery);
+}
+
+struct GPUZoneScope{
+    GPUProfiler& profiler;
+    VkCommandBuffer cmdBuffer;
+
+    GPUZoneScope(GPUProfiler& profiler, VkCommandBuffer cmdBuffer, const char* name) : profiler(profiler), cmdBuffer(cmdBuffer){
+        beginGPUZone(profiler, cmdBuffer, name);
+    }
+
+    ~GPUZoneScope(){
+        endGPUZone(profiler, cmdBuffer);
+    }
+};
+
+#define GPU_ZONE_CONCAT_IMPL(a, b) a##b
+#define GPU_ZONE_CONCAT(a, b) GPU_ZONE_CONCAT_IMPL(a, b)
+#define GPU_ZONE(profiler, cmdBuffer, name) GPUZoneScope GPU_ZONE_CONCAT(gpuZone, __LINE__){ profiler, cmdBuffer, name }
+
+const char* traceThreadName(uint32_t threadID){
+    return threadID == kGPUTraceThreadID ? "GPU" : threadID == kRenderThreadTraceID ? "Render thread" : "Worker";
+}
+
+// Chrome trace / Perfetto JSON; open with chrome://tracing or ui.perfetto.dev
+bool writeChromeTrace(const char* filename, const std::vector<TraceEvent>& events){
+    FILE* file{ fopen(filename, "w") };
+    if (!file){
+        fprintf(stderr, "Could not open trace file %s\n", filename);
+        return false;
+    }
+
+    std::set<uint32_t> threadIDs;
+    for (const TraceEvent& event : events){
+        threadIDs.insert(event.threadID);
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    bool first{ true };
+    for (uint32_t threadID : threadIDs){
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", threadID, traceThreadName(threadID));
+        first = false;
+    }
+
+    for (const TraceEvent& event : events){
+        fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                first ? "" : ",\n", event.name, event.threadID, event.beginUs, event.durationUs);
+        first = false;
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    return true;
 }
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include "vk_helpers.h"
+#include <string.h>
+#include <algorithm>
+
+// Copies are aligned so the staging source offsets satisfy optimalBufferCopyOffsetAlignment on all common drivers
+const VkDeviceSize kStagingAlignment{ 16 };
+const uint32_t kStagingBatchCount{ 4 };
+
+StagingUploader createStagingUploader(VulkanState vkState, VkDeviceSize capacity, bool useTransferQueue){
+    StagingUploader uploader{};
+    uploader.capacity = capacity;
+
+    if (useTransferQueue && vkState.transferQueueFamilyID != -1){
+        uploader.queue = vkState.transferQueue;
+        uploader.queueFamilyID = vkState.transferQueueFamilyID;
+    } else {
+        uploader.queue = vkState.renderQueue;
+        uploader.queueFamilyID = vkState.renderQueueFamilyID;
+    }
+
+    uploader.stagingBuffer = createBuffer(vkState, capacity,
+                                          VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    VkCommandPoolCreateInfo cmdPoolCreateInfo{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+    cmdPoolCreateInfo.queueFamilyIndex = uploader.queueFamilyID;
+    cmdPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    VK_CHECK(vkCreateCommandPool(vkState.device, &cmdPoolCreateInfo, nullptr, &uploader.cmdPool));
+
+    VkCommandBuffer cmdBuffers[kStagingBatchCount]{};
+
+    VkCommandBufferAllocateInfo cmdBuffersAllocInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+    cmdBuffersAllocInfo.commandBufferCount = kStagingBatchCount;
+    cmdBuffersAllocInfo.commandPool = uploader.cmdPool;
+    cmdBuffersAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+
+    VK_CHECK(vkAllocateCommandBuffers(vkState.device, &cmdBuffersAllocInfo, cmdBuffers));
+
+    VkFenceCreateInfo fenceCreateInfo{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+
+    uploader.batches.resize(kStagingBatchCount);
+    for (uint32_t i{}; i < kStagingBatchCount; i++){
+        uploader.batches[i].cmdBuffer = cmdBuffers[i];
+        VK_CHECK(vkCreateFence(vkState.device, &fenceCreateInfo, nullptr, &uploader.batches[i].fence));
+        uploader.freeBatches.push_back(i);
+    }
+
+    return uploader;
+}
+
+// For buffers filled through the uploader: shared with its queue family when the copies run on the transfer queue,
+// since nothing transfers ownership back to the render queue after them
+Buffer createUploadBuffer(VulkanState vkState, const StagingUploader& uploader, VkDeviceSize size, VkBufferUsageFlags usage,
+                          VkMemoryPropertyFlags memoryFlags){
+    return createBuffer(vkState, size, usage, memoryFlags, nullptr, nullptr, uploader.queueFamilyID);
+}
+
+void destroyStagingUploader(VkDevice device, StagingUploader& uploader){
+    for (StagingBatch& batch : uploader.batches){
+        vkDestroyFence(device, batch.fence, nullptr);
+    }
+
+    vkDestroyCommandPool(device, uploader.cmdPool, nullptr);
+    destroyBuffer(device, uploader.stagingBuffer);
+
+    uploader = StagingUploader{};
+}
+
+// Retires finished batches in submission order and returns their staging space to the ring
+void retireStagingBatches(VkDevice device, StagingUploader& uploader, bool waitForOldest){
+    while (!uploader.pendingBatches.empty()){
+        uint32_t batchID{ uploader.pendingBatches.front() };
+        StagingBatch& batch{ uploader.batches[batchID] };
+
+        if (waitForOldest){
+            VK_CHECK(vkWaitForFences(device, 1, &batch.fence, VK_TRUE, -1));
+            waitForOldest = false;
+        } else if (vkGetFenceStatus(device, batch.fence) != VK_SUCCESS){
+            break;
+        }
+
+        VK_CHECK(vkResetFences(device, 1, &batch.fence));
+
+        uploader.tail = batch.endOffset;
+        uploader.pendingBatches.pop_front();
+        uploader.freeBatches.push_back(batchID);
+        uploader.retiredCount++;
+    }
+
+    // Nothing in flight or being recorded: restart at the beginning to avoid needless wrap-arounds
+    if (uploader.pendingBatches.empty() && !uploader.recording){
+        uploader.head = 0;
+        uploader.tail = 0;
+    }
+}
+
+// Ring invariant: head == tail means empty, so an allocation never lets head catch up with tail from below
+bool allocateStagingRange(StagingUploader& uploader, VkDeviceSize size, VkDeviceSize& offset){
+    VkDeviceSize head{ (uploader.head + kStagingAlignment - 1) & ~(kStagingAlignment - 1) };
+
+    if (uploader.head >= uploader.tail){
+        if (head + size <= uploader.capacity){
+            offset = head;
+            uploader.head = head + size;
+            return true;
+        }
+
+        if (size < uploader.tail){
+            offset = 0;
+            uploader.head = size;
+            return true;
+        }
+    } else if (head + size < uploader.tail){
+        offset = head;
+        uploader.head = head + size;
+        return true;
+    }
+
+    return false;
+}
+
+void submitUploads(VkDevice device, StagingUploader& uploader){
+    if (!uploader.recording){
+        return;
+    }
+
+    StagingBatch& batch{ uploader.batches[uploader.recordingBatch] };
+    batch.endOffset = uploader.head;
+
+    VK_CHECK(vkEndCommandBuffer(batch.cmdBuffer));
+
+    VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.cmdBuffer;
+
+    VK_CHECK(vkQueueSubmit(uploader.queue, 1, &submitInfo, batch.fence));
+
+    uploader.pendingBatches.push_back(uploader.recordingBatch);
+    uploader.recording = false;
+    uploader.submittedCount++;
+}
+
+void beginStagingBatch(VkDevice device, StagingUploader& uploader){
+    if (uploader.recording){
+        return;
+    }
+
+    if (uploader.freeBatches.empty()){
+        retireStagingBatches(device, uploader, true);
+    }
+
+    uploader.recordingBatch = uploader.freeBatches.back();
+    uploader.freeBatches.pop_back();
+    uploader.recording = true;
+
+    VkCommandBufferBeginInfo cmdBeginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    cmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VK_CHECK(vkBeginCommandBuffer(uploader.batches[uploader.recordingBatch].cmdBuffer, &cmdBeginInfo));
+}
+
+// Stages data and records the copy into the current batch; the copy is only executed after submitUploads
+void uploadBuffer(VkDevice device, StagingUploader& uploader, Buffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size){
+    // Large uploads are split so they can stream through the ring while earlier chunks are still in flight
+    const VkDeviceSize maxChunkSize{ uploader.capacity / 2 };
+
+    retireStagingBatches(device, uploader, false);
+
+    VkDeviceSize uploaded{};
+    while (uploaded < size){
+        VkDeviceSize chunkSize{ std::min(size - uploaded, maxChunkSize) };
+
+        beginStagingBatch(device, uploader);
+
+        // Out of space: flush what is recorded and wait for the oldest batch to free its range
+        VkDeviceSize stagingOffset{};
+        while (!allocateStagingRange(uploader, chunkSize, stagingOffset)){
+            submitUploads(device, uploader);
+            retireStagingBatches(device, uploader, true);
+            beginStagingBatch(device, uploader);
+        }
+
+        memcpy((uint8_t*)uploader.stagingBuffer.data + stagingOffset, (const uint8_t*)data + uploaded, chunkSize);
+
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = stagingOffset;
+        copyRegion.dstOffset = dstOffset + uploaded;
+        copyRegion.size = chunkSize;
+
+        vkCmdCopyBuffer(uploader.batches[uploader.recordingBatch].cmdBuffer,
+                        uploader.stagingBuffer.buffer, dst.buffer, 1, &copyRegion);
+
+        uploaded += chunkSize;
+    }
+}
+
+bool uploadsPending(VkDevice device, StagingUploader& uploader){
+    retireStagingBatches(device, uploader, false);
+
+    return uploader.recording || !uploader.pendingBatches.empty();
+}
+
+void waitForUploads(VkDevice device, StagingUploader& uploader){
+    submitUploads(device, uploader);
+
+    while (!uploader.pendingBatches.empty()){
+        retireStagingBatches(device, uploader, true);
+    }
+}
+
+// MemoryMoveCallback for buffers registered with setAllocationUserData(buffer.allocation, &buffer). Unmapped buffers
+// are copied on the uploader's queue, so they only move with TRANSFER_SRC and TRANSFER_DST usage and when that queue
+// may access them: created through createUploadBuffer, or the uploader uses the render queue. Others stay put.
+// Each move waits for its copy, which is fine for the occasional defragmentation pass, but the buffers must not be in
+// use by any queue.
+bool moveBufferMemory(const MemoryAllocation& src, const MemoryAllocation& dst, void* allocationUserData, void* callbackUserData){
+    BufferMover& mover{ *(BufferMover*)callbackUserData };
+    Buffer& buffer{ *(Buffer*)allocationUserData };
+
+    const VkBufferUsageFlags copyUsage{ VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT };
+    const bool uploaderQueueAccess{ buffer.sharedQueueFamilyID == mover.uploader->queueFamilyID ||
+                                    mover.uploader->queueFamilyID == mover.vkState.renderQueueFamilyID };
+
+    bool mapped{ src.data && dst.data };
+    if (!mapped && ((buffer.usage & copyUsage) != copyUsage || !uploaderQueueAccess)){
+        return false;
+    }
+
+    VkBuffer oldBuffer{ rebindBuffer(mover.vkState, buffer, dst) };
+
+    if (mapped){
+        memcpy(dst.data, src.data, buffer.size);
+    } else {
+        StagingUploader& uploader{ *mover.uploader };
+        beginStagingBatch(mover.vkState.device, uploader);
+
+        VkBufferCopy copyRegion{};
+        copyRegion.size = buffer.size;
+
+        vkCmdCopyBuffer(uploader.batches[uploader.recordingBatch].cmdBuffer, oldBuffer, buffer.buffer, 1, &copyRegion);
+
+        waitForUploads(mover.vkState.device, uploader);
+    }
+
+    vkDestroyBuffer(mover.vkState.device, oldBuffer, nullptr);
+    mover.moveCount++;
+
+    return true;
+}
\ No newline at end of file
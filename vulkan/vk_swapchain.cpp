@@ -1,42 +1,85 @@
 #include "vk_helpers.h"
 #include <GLFW/glfw3.h>
+#include <stdio.h>
 #include <vector>
+#include <algorithm>
 
-VulkanSwapchain createSwapchain(GLFWwindow* window, VulkanState vkState){
-    VulkanSwapchain swapchain{};
+const char* presentModeName(VkPresentModeKHR presentMode){
+    switch (presentMode){
+        case VK_PRESENT_MODE_IMMEDIATE_KHR: return "IMMEDIATE";
+        case VK_PRESENT_MODE_MAILBOX_KHR: return "MAILBOX";
+        case VK_PRESENT_MODE_FIFO_KHR: return "FIFO";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+        default: return "UNKNOWN";
+    }
+}
 
-    VK_CHECK(glfwCreateWindowSurface(vkState.instance, window, nullptr, &swapchain.surface));
+// FIFO is the only mode the spec guarantees, so anything unsupported falls back to it
+VkPresentModeKHR choosePresentMode(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, VkPresentModeKHR requestedMode){
+    uint32_t presentModeCount{};
+    VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, nullptr));
+
+    std::vector<VkPresentModeKHR> presentModes(presentModeCount);
+    VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, presentModes.data()));
+
+    for (VkPresentModeKHR presentMode : presentModes){
+        if (presentMode == requestedMode){
+            return requestedMode;
+        }
+    }
+
+    fprintf(stderr, "Present mode %s is not supported, falling back to FIFO\n", presentModeName(requestedMode));
+
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+// The surface reports its size, except on platforms where the swapchain decides it (currentExtent of 0xFFFFFFFF)
+VkExtent2D chooseSwapchainExtent(GLFWwindow* window, const VkSurfaceCapabilitiesKHR& surfaceCaps){
+    if (surfaceCaps.currentExtent.width != UINT32_MAX){
+        return surfaceCaps.currentExtent;
+    }
 
+    int width{}, height{};
+    glfwGetFramebufferSize(window, &width, &height);
+
+    VkExtent2D extent{};
+    extent.width = std::min(std::max((uint32_t)width, surfaceCaps.minImageExtent.width), surfaceCaps.maxImageExtent.width);
+    extent.height = std::min(std::max((uint32_t)height, surfaceCaps.minImageExtent.height), surfaceCaps.maxImageExtent.height);
+
+    return extent;
+}
+
+// Creates the swapchain images and views for the surface's current extent. A non-null oldSwapchain is retired by this,
+// but stays valid until the caller destroys it.
+void buildSwapchain(GLFWwindow* window, VulkanState vkState, VulkanSwapchain& swapchain, VkSwapchainKHR oldSwapchain){
     VkSurfaceCapabilitiesKHR surfaceCaps{};
     VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vkState.physicalDevice, swapchain.surface, &surfaceCaps));
     assert(surfaceCaps.supportedCompositeAlpha & VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR);
     assert(surfaceCaps.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR);
     assert(surfaceCaps.supportedUsageFlags & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
 
-    swapchain.extent = surfaceCaps.currentExtent;
+    swapchain.extent = chooseSwapchainExtent(window, surfaceCaps);
 
-    uint32_t surfaceFormatsCount{1};
-    VkResult surfaceQueryRes{ vkGetPhysicalDeviceSurfaceFormatsKHR(vkState.physicalDevice, swapchain.surface, &surfaceFormatsCount, &swapchain.surfaceFormat) };
-    assert(surfaceQueryRes == VK_SUCCESS || surfaceQueryRes == VK_INCOMPLETE);
-
-    if (swapchain.surfaceFormat.format == VK_FORMAT_UNDEFINED){
-        swapchain.surfaceFormat.format = VK_FORMAT_R8G8B8A8_UNORM;
+    // Mailbox needs a spare image to replace while one is on screen and another is being rendered
+    uint32_t imageCount{ std::max(swapchain.presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? 3u : 2u, surfaceCaps.minImageCount) };
+    if (surfaceCaps.maxImageCount > 0){
+        imageCount = std::min(imageCount, surfaceCaps.maxImageCount);
     }
 
     VkSwapchainCreateInfoKHR swapchainCreateInfo{ VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR };
     swapchainCreateInfo.surface = swapchain.surface;
-    swapchainCreateInfo.minImageCount = std::min(2u, surfaceCaps.minImageCount);
+    swapchainCreateInfo.minImageCount = imageCount;
     swapchainCreateInfo.imageFormat = swapchain.surfaceFormat.format;
     swapchainCreateInfo.imageColorSpace = swapchain.surfaceFormat.colorSpace;
-    swapchainCreateInfo.imageExtent.width = surfaceCaps.currentExtent.width;
-    swapchainCreateInfo.imageExtent.height = surfaceCaps.currentExtent.height;
+    swapchainCreateInfo.imageExtent = swapchain.extent;
     swapchainCreateInfo.imageArrayLayers = 1;
     swapchainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
     swapchainCreateInfo.queueFamilyIndexCount = 1;
     swapchainCreateInfo.pQueueFamilyIndices = (const uint32_t*)&vkState.renderQueueFamilyID;
-    swapchainCreateInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    swapchainCreateInfo.presentMode = swapchain.presentMode;
     swapchainCreateInfo.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
     swapchainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    swapchainCreateInfo.oldSwapchain = oldSwapchain;
 
     VK_CHECK(vkCreateSwapchainKHR(vkState.device, &swapchainCreateInfo, nullptr, &swapchain.swapchain));
 
@@ -60,10 +103,50 @@ VulkanSwapchain createSwapchain(GLFWwindow* window, VulkanState vkState){
 
         VK_CHECK(vkCreateImageView(vkState.device, &imageViewCreateInfo, nullptr, &swapchain.imageViews[i]));
     }
+}
+
+VulkanSwapchain createSwapchain(GLFWwindow* window, VulkanState vkState, VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR){
+    VulkanSwapchain swapchain{};
+
+    VK_CHECK(glfwCreateWindowSurface(vkState.instance, window, nullptr, &swapchain.surface));
+
+    uint32_t surfaceFormatsCount{1};
+    VkResult surfaceQueryRes{ vkGetPhysicalDeviceSurfaceFormatsKHR(vkState.physicalDevice, swapchain.surface, &surfaceFormatsCount, &swapchain.surfaceFormat) };
+    assert(surfaceQueryRes == VK_SUCCESS || surfaceQueryRes == VK_INCOMPLETE);
+
+    if (swapchain.surfaceFormat.format == VK_FORMAT_UNDEFINED){
+        swapchain.surfaceFormat.format = VK_FORMAT_R8G8B8A8_UNORM;
+    }
+
+    swapchain.presentMode = choosePresentMode(vkState.physicalDevice, swapchain.surface, presentMode);
+
+    buildSwapchain(window, vkState, swapchain, VK_NULL_HANDLE);
 
     return swapchain;
 }
 
+// Builds a new swapchain for the surface's current extent, keeping the surface, format and present mode. Returns the
+// old swapchain and its views, which frames in flight may still use; destroy them with destroyRetiredSwapchain once
+// those frames have completed. Nothing waits for the device.
+VulkanSwapchain recreateSwapchain(GLFWwindow* window, VulkanState vkState, VulkanSwapchain& swapchain){
+    VulkanSwapchain retired{ swapchain };
+    retired.surface = VK_NULL_HANDLE;
+
+    buildSwapchain(window, vkState, swapchain, retired.swapchain);
+
+    return retired;
+}
+
+void destroyRetiredSwapchain(VkDevice device, VulkanSwapchain& retired){
+    for (VkImageView imageView : retired.imageViews){
+        vkDestroyImageView(device, imageView, nullptr);
+    }
+
+    vkDestroySwapchainKHR(device, retired.swapchain, nullptr);
+
+    retired = VulkanSwapchain{};
+}
+
 void destroySwapchain(VkInstance instance, VkDevice device, VulkanSwapchain& swapchain){
     for (int i{}; i < swapchain.imageViews.size(); i++){
         vkDestroyImageView(device, swapchain.imageViews[i], nullptr);